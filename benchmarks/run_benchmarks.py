@@ -0,0 +1,401 @@
+"""
+Reproducible benchmarks for the live and offline pipelines.
+
+Every benchmark runs on data from core.synthetic_stream.SyntheticSession, so
+results only depend on the configuration (duration, rates, channel count,
+seed) and the machine. The JSON written to benchmarks/results/ records that
+configuration with the git commit and library versions next to the timings,
+and --compare prints the speed ratio against an earlier result file.
+
+    python benchmarks/run_benchmarks.py
+    python benchmarks/run_benchmarks.py --duration 300 --channels 32 --eeg-rate 256
+    python benchmarks/run_benchmarks.py --only cortex collector --compare benchmarks/results/old.json
+
+Benchmarks whose dependencies are missing (pandas, scipy, numba, ...) are
+recorded as skipped with the import error instead of failing the run.
+"""
+import os
+import sys
+import gc
+import json
+import time
+import shutil
+import argparse
+import platform
+import tempfile
+import subprocess
+import contextlib
+from datetime import datetime
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, REPO_ROOT)
+sys.path.insert(0, os.path.join(REPO_ROOT, 'data_analysis'))
+
+import numpy as np
+from core.synthetic_stream import SyntheticSession
+
+BENCHMARKS = []
+
+
+def benchmark(name):
+    def register(fn):
+        BENCHMARKS.append((name, fn))
+        return fn
+    return register
+
+
+@contextlib.contextmanager
+def quiet():
+    """Send the modules' progress prints to /dev/null while timing."""
+    with open(os.devnull, 'w') as devnull, contextlib.redirect_stdout(devnull):
+        yield
+
+
+def measure(run, repeat, setup=None):
+    """
+    Time run() repeat times, calling setup() untimed before each run and
+    passing its result to run. Returns the per-run times in seconds.
+    """
+    times = []
+    for _ in range(repeat):
+        state = setup() if setup is not None else None
+        gc.collect()
+        with quiet():
+            start = time.perf_counter()
+            run(state) if setup is not None else run()
+            times.append(time.perf_counter() - start)
+    return times
+
+
+def summarize(times, items=None, unit='samples'):
+    result = {'median_s': float(np.median(times)), 'min_s': float(np.min(times)), 'runs': len(times)}
+    if items:
+        result['items'] = items
+        result['unit'] = unit
+        result['per_second'] = items / result['median_s'] if result['median_s'] > 0 else None
+    return result
+
+
+class Context:
+    """Synthetic messages and the files written from them, shared by the benchmarks."""
+
+    def __init__(self, args):
+        rates = {'eeg': args.eeg_rate}
+        self.args = args
+        self.session = SyntheticSession(channels=args.channels, rates=rates, seed=args.seed,
+                                        start_time=1700000000.0)
+        self.streams = ['eeg', 'mot', 'dev', 'met', 'pow']
+        self.messages = self.session.encoded_messages(args.duration, self.streams)
+        self.n_eeg = int(args.duration * self.session.rates['eeg'])
+        self.workdir = tempfile.mkdtemp(prefix='emorobots_bench_')
+        self.session_dirs = {}
+        self.loaders = {}
+
+    def cleanup(self):
+        if not self.args.keep_files:
+            shutil.rmtree(self.workdir, ignore_errors=True)
+
+    def new_cortex(self, **kwargs):
+        from core.cortex import Cortex
+        with quiet():
+            cortex = Cortex('bench-client', 'bench-secret', **kwargs)
+            for stream_name in self.streams:
+                cortex.extract_data_labels(stream_name, self.session.columns(stream_name))
+        return cortex
+
+    def new_collector(self, output_directory, **kwargs):
+        from core.data_collector import DataCollector
+        # DataCollector creates ./collected_data on construction
+        cwd = os.getcwd()
+        os.chdir(self.workdir)
+        try:
+            with quiet():
+                collector = DataCollector('bench-client', 'bench-secret', stream_to_file=False, **kwargs)
+                collector.output_directory = output_directory
+                for stream_name in self.streams:
+                    collector.c.extract_data_labels(stream_name, self.session.columns(stream_name))
+        finally:
+            os.chdir(cwd)
+        return collector
+
+    def feed(self, cortex):
+        on_message = cortex.on_message
+        for message in self.messages:
+            on_message(None, message)
+
+    def recorded_session(self, file_format):
+        """Directory holding one saved session in file_format, written on first use."""
+        if file_format not in self.session_dirs:
+            directory = os.path.join(self.workdir, 'session_' + file_format)
+            os.makedirs(directory, exist_ok=True)
+            collector = self.new_collector(directory, file_format=file_format)
+            with quiet():
+                self.feed(collector.c)
+                collector.save_data_to_files()
+            self.session_dirs[file_format] = directory
+        return self.session_dirs[file_format]
+
+    def loader(self, file_format='npy'):
+        if file_format not in self.loaders:
+            from data_loader import DataLoader
+            loader = DataLoader(self.recorded_session(file_format))
+            with quiet():
+                loader.load_all_data()
+            self.loaders[file_format] = loader
+        return self.loaders[file_format]
+
+
+# live path
+
+@benchmark('cortex_on_message')
+def bench_cortex_on_message(ctx):
+    """Decode and route every message in sync dispatch mode, once per JSON backend."""
+    from core.cortex import JSON_DECODERS
+    results = {}
+    n = len(ctx.messages)
+    for backend in JSON_DECODERS:
+        for instrument in (False, True):
+            cortex = ctx.new_cortex(json_backend=backend, instrument=instrument)
+            times = measure(lambda: ctx.feed(cortex), ctx.args.repeat)
+            key = '{0}{1}'.format(backend, '+stats' if instrument else '')
+            results[key] = summarize(times, n, 'messages')
+    return results
+
+
+@benchmark('cortex_on_message_threaded')
+def bench_cortex_threaded(ctx):
+    """Enqueue every message and wait for the dispatcher thread to drain them as batches."""
+    n = len(ctx.messages)
+
+    def setup():
+        cortex = ctx.new_cortex(dispatch_mode='threaded', dispatch_queue_size=n + 1, instrument=False)
+        cortex.dispatcher.start()
+        return cortex
+
+    def run(cortex):
+        ctx.feed(cortex)
+        cortex.dispatcher.stop()
+
+    return summarize(measure(run, ctx.args.repeat, setup), n, 'messages')
+
+
+@benchmark('collector_ingest')
+def bench_collector_ingest(ctx):
+    """on_message through the DataCollector handlers into its StreamBuffers."""
+    directory = os.path.join(ctx.workdir, 'ingest')
+    times = measure(lambda collector: ctx.feed(collector.c), ctx.args.repeat,
+                    setup=lambda: ctx.new_collector(directory))
+    return summarize(times, len(ctx.messages), 'messages')
+
+
+@benchmark('collector_save')
+def bench_collector_save(ctx):
+    """save_data_to_files for a full in-memory session, per file format."""
+    results = {}
+    for file_format in ('csv', 'npy', 'ezs'):
+        directory = os.path.join(ctx.workdir, 'save_' + file_format)
+
+        def setup():
+            shutil.rmtree(directory, ignore_errors=True)
+            os.makedirs(directory)
+            collector = ctx.new_collector(directory, file_format=file_format)
+            with quiet():
+                ctx.feed(collector.c)
+            return collector
+
+        times = measure(lambda collector: collector.save_data_to_files(), ctx.args.repeat, setup)
+        results[file_format] = summarize(times, ctx.n_eeg, 'eeg samples')
+        results[file_format]['bytes'] = sum(os.path.getsize(os.path.join(directory, f)) for f in os.listdir(directory))
+    return results
+
+
+@benchmark('eeg_stream_process')
+def bench_eeg_stream(ctx):
+    """EEGStreamProcessor.process fed one sample at a time and in 64-sample blocks."""
+    from core.eeg_stream import EEGStreamProcessor
+    labels = ctx.session.columns('eeg')[:-1]
+    _, rows = ctx.session.stream_values('eeg', ctx.n_eeg)
+    samples = np.array([row[:-1] for row in rows], dtype=np.float64)
+    results = {}
+    for block in (1, 64):
+        def setup():
+            processor = EEGStreamProcessor(sampling_rate=ctx.session.rates['eeg'])
+            processor.set_labels(labels)
+            return processor
+
+        def run(processor):
+            for start in range(0, len(samples), block):
+                processor.process(samples[start:start + block])
+
+        results['block_{0}'.format(block)] = summarize(measure(run, ctx.args.repeat, setup), ctx.n_eeg)
+    return results
+
+
+# offline path
+
+@benchmark('loader_load')
+def bench_loader_load(ctx):
+    """DataLoader.load_all_data on a saved session, per file format."""
+    from data_loader import DataLoader
+    results = {}
+    for file_format in ('csv', 'npy', 'ezs'):
+        directory = ctx.recorded_session(file_format)
+        times = measure(lambda: DataLoader(directory).load_all_data(), ctx.args.repeat)
+        results[file_format] = summarize(times, ctx.n_eeg, 'eeg samples')
+    return results
+
+
+@benchmark('synchronize_data')
+def bench_synchronize(ctx):
+    """DataLoader.synchronize_data onto the eeg timeline for every method."""
+    from data_loader import SYNC_METHODS
+    loader = ctx.loader()
+    results = {}
+    for method in SYNC_METHODS:
+        times = measure(lambda: loader.synchronize_data(method=method), ctx.args.repeat)
+        results[method] = summarize(times, ctx.n_eeg, 'eeg samples')
+    return results
+
+
+@benchmark('eeg_analyze_all_channels')
+def bench_eeg_analysis(ctx):
+    """EEGAnalyzer.analyze_all_channels, vectorized against the per-channel pipeline."""
+    from eeg_analysis import EEGAnalyzer
+    loader = ctx.loader()
+    results = {}
+    for mode in ('matrix', 'per_channel'):
+        with quiet():
+            analyzer = EEGAnalyzer(loader)
+        # analyze_all_channels memoizes per mode: clear it so every run computes
+        times = measure(lambda _: analyzer.analyze_all_channels(mode=mode), ctx.args.repeat,
+                        setup=analyzer.channel_results.clear)
+        results[mode] = summarize(times, ctx.n_eeg * ctx.args.channels, 'channel samples')
+    return results
+
+
+@benchmark('motion_head_orientation')
+def bench_motion(ctx):
+    """MotionAnalyzer.calculate_head_orientation with the numpy and numba kernels."""
+    import motion_analysis
+    loader = ctx.loader()
+    with quiet():
+        analyzer = motion_analysis.MotionAnalyzer(loader)
+    n = len(analyzer.motion_data)
+
+    def reset():
+        # calculate_head_orientation memoizes its result: clear it so every run computes
+        analyzer.orientation = None
+
+    results = {'numpy': summarize(measure(lambda _: analyzer.calculate_head_orientation(), ctx.args.repeat,
+                                          setup=reset), n)}
+    if motion_analysis.numba is not None:
+        analyzer.calculate_head_orientation(use_numba=True)  # compile outside the timing
+        times = measure(lambda _: analyzer.calculate_head_orientation(use_numba=True), ctx.args.repeat,
+                        setup=reset)
+        results['numba'] = summarize(times, n)
+    else:
+        results['numba'] = {'skipped': 'numba is not installed'}
+    return results
+
+
+def environment(args):
+    try:
+        commit = subprocess.run(['git', 'rev-parse', 'HEAD'], cwd=REPO_ROOT, capture_output=True,
+                                text=True, timeout=10).stdout.strip()
+    except (OSError, subprocess.SubprocessError):
+        commit = ''
+    versions = {}
+    for module in ('numpy', 'pandas', 'scipy', 'numba', 'orjson', 'simdjson', 'zstandard', 'lz4'):
+        try:
+            versions[module] = __import__(module).__version__
+        except (ImportError, AttributeError):
+            pass
+    return {
+        'created': datetime.now().isoformat(timespec='seconds'),
+        'git_commit': commit,
+        'python': platform.python_version(),
+        'platform': platform.platform(),
+        'processor': platform.processor(),
+        'cpu_count': os.cpu_count(),
+        'versions': versions,
+        'config': {'duration': args.duration, 'channels': args.channels, 'eeg_rate': args.eeg_rate,
+                   'seed': args.seed, 'repeat': args.repeat},
+    }
+
+
+def flatten(results):
+    """{benchmark/variant: result} for printing and comparison."""
+    rows = {}
+    for name, result in results.items():
+        if 'median_s' in result or 'skipped' in result or 'error' in result:
+            rows[name] = result
+        else:
+            for variant, sub in result.items():
+                rows[name + '/' + variant] = sub
+    return rows
+
+
+def print_results(results, baseline=None):
+    old = flatten(baseline['results']) if baseline else {}
+    for name, result in flatten(results).items():
+        if 'median_s' not in result:
+            print('{0:<44} {1}'.format(name, result.get('skipped') or result.get('error')))
+            continue
+        line = '{0:<44} {1:>10.4f} s'.format(name, result['median_s'])
+        if result.get('per_second'):
+            line += '  {0:>14,.0f} {1}/s'.format(result['per_second'], result['unit'])
+        if name in old and 'median_s' in old[name]:
+            line += '  x{0:.2f} vs baseline'.format(old[name]['median_s'] / result['median_s'])
+        print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='EmoRobots benchmark harness')
+    parser.add_argument('--duration', type=float, default=60.0, help='seconds of synthetic data')
+    parser.add_argument('--channels', type=int, default=14, help='EEG channel count')
+    parser.add_argument('--eeg-rate', type=float, default=128.0, help='EEG sampling rate in Hz')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--repeat', type=int, default=5, help='runs per benchmark, the median is reported')
+    parser.add_argument('--only', nargs='*', help='run benchmarks whose name starts with one of these')
+    parser.add_argument('--output', help='result file, default benchmarks/results/<timestamp>.json')
+    parser.add_argument('--compare', help='earlier result file to compare against')
+    parser.add_argument('--keep-files', action='store_true', help='keep the temporary session files')
+    args = parser.parse_args()
+
+    ctx = Context(args)
+    print('{0} messages, {1} eeg samples x {2} channels, work dir {3}'.format(
+        len(ctx.messages), ctx.n_eeg, args.channels, ctx.workdir))
+
+    results = {}
+    try:
+        for name, fn in BENCHMARKS:
+            if args.only and not any(name.startswith(prefix) for prefix in args.only):
+                continue
+            print('running ' + name)
+            try:
+                results[name] = fn(ctx)
+            except ImportError as e:
+                results[name] = {'skipped': str(e)}
+            except Exception as e:
+                results[name] = {'error': '{0}: {1}'.format(type(e).__name__, e)}
+    finally:
+        ctx.cleanup()
+
+    report = {'environment': environment(args), 'results': results}
+    output = args.output or os.path.join(REPO_ROOT, 'benchmarks', 'results',
+                                         datetime.now().strftime('%Y%m%d_%H%M%S') + '.json')
+    os.makedirs(os.path.dirname(os.path.abspath(output)), exist_ok=True)
+    with open(output, 'w') as f:
+        json.dump(report, f, indent=2)
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    print()
+    print_results(results, baseline)
+    print('\nresults written to ' + output)
+
+
+if __name__ == '__main__':
+    main()
@@ -12,9 +12,17 @@ LICENSE = ''
 # Optional: Specific headset ID (leave empty for auto-detect)
 HEADSET_ID = ''
 
+# Optional: warm start cache of the cortexToken, last headset and profile
+# (True for ~/.emorobots/cortex_cache.json, a path, or False to always authorize)
+CORTEX_CACHE = False
+
 # Data Collection Settings
 COLLECTION_DURATION = 30  # seconds
 SAVE_TO_FILE = True
+STREAM_TO_FILE = True  # append samples to disk while collecting instead of at stop
+FLUSH_INTERVAL = 1.0   # seconds between writer batches
+FSYNC_INTERVAL = 5.0   # maximum seconds of data that a crash can lose
+FILE_FORMAT = 'csv'    # 'csv', 'npy' (memory-mapped binary) or 'ezs' (lossless compressed chunks), see core/session_format.py
 OUTPUT_DIRECTORY = 'collected_data'
 
 # Data Streams to Collect
@@ -0,0 +1,372 @@
+"""
+asyncio client for the Emotiv Cortex API.
+
+Every JSON-RPC call gets a unique request id and returns an awaitable that
+resolves to the call's result (or raises CortexError), so independent calls
+can be in flight at the same time:
+
+    async with AsyncCortex(client_id, client_secret) as cortex:
+        session_id = await cortex.prepare(streams=['met', 'pow'])
+        async for sample in cortex.stream('met'):
+            print(sample['time'], sample['met'])
+
+Stream samples have the same layout as the data of the Cortex new_*_data
+events. Requires the websockets package.
+"""
+import os
+import ssl
+import asyncio
+import itertools
+import json
+import warnings
+
+try:
+    import websockets
+except ImportError:
+    websockets = None
+
+from core.cortex import JSON_DECODERS, DEFAULT_JSON_BACKEND, ACCESS_RIGHT_GRANTED, CORTEX_URL
+
+
+class CortexError(Exception):
+    """Error response of a Cortex JSON-RPC call."""
+
+    def __init__(self, method, error):
+        self.method = method
+        self.code = error.get('code')
+        self.data = error.get('data')
+        super().__init__('{0} failed ({1}): {2}'.format(method, self.code, error.get('message')))
+
+
+def stream_sample(stream_name, recv_dic):
+    """Convert a stream message to the data dictionary of the matching Cortex event."""
+    values = recv_dic[stream_name]
+    if stream_name == 'com':
+        return {'action': values[0], 'power': values[1], 'time': recv_dic['time']}
+    if stream_name == 'fac':
+        return {'eyeAct': values[0], 'uAct': values[1], 'uPow': values[2],
+                'lAct': values[3], 'lPow': values[4], 'time': recv_dic['time']}
+    if stream_name == 'eeg':
+        # remove markers
+        return {'eeg': values[:-1], 'time': recv_dic['time']}
+    if stream_name == 'dev':
+        return {'signal': values[1], 'dev': values[2], 'batteryPercent': values[3], 'time': recv_dic['time']}
+    if stream_name == 'sys':
+        return {'sys': values}
+    return {stream_name: values, 'time': recv_dic.get('time')}
+
+
+class StreamSubscription:
+    """
+    Async iterator over the samples of one stream.
+
+    Samples are queued per subscription; when the consumer falls behind by
+    queue_size samples the oldest one is dropped and counted.
+    """
+
+    def __init__(self, client, stream_name, queue_size):
+        self.client = client
+        self.stream_name = stream_name
+        self.queue = asyncio.Queue(maxsize=queue_size)
+        self.dropped = 0
+
+    def put(self, sample):
+        if self.queue.full():
+            self.queue.get_nowait()
+            self.dropped += 1
+        self.queue.put_nowait(sample)
+
+    def close(self):
+        self.client._unregister(self)
+        self.put(None)
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        sample = await self.queue.get()
+        if sample is None:
+            raise StopAsyncIteration
+        return sample
+
+
+class AsyncCortex:
+    """
+    Coroutine-based Cortex client. One reader task receives every message and
+    resolves the pending future with the same id, or fans stream samples out
+    to the StreamSubscription iterators of that stream.
+    """
+
+    def __init__(self, client_id, client_secret, url=None, license='', debit=10,
+                 json_backend=DEFAULT_JSON_BACKEND, stream_queue_size=1024, debug=False):
+        if websockets is None:
+            raise RuntimeError('AsyncCortex requires the websockets package (pip install websockets)')
+        if client_id == '' or client_secret == '':
+            raise ValueError('Empty client id or secret. Please fill them in before running.')
+        self.client_id = client_id
+        self.client_secret = client_secret
+        # same default as Cortex: CORTEX_URL from the environment, else the local Cortex service
+        self.url = url or os.environ.get('CORTEX_URL', CORTEX_URL)
+        self.license = license
+        self.debit = debit
+        self.json_loads = JSON_DECODERS[json_backend]
+        self.stream_queue_size = stream_queue_size
+        self.debug = debug
+
+        self.ws = None
+        self.auth = ''
+        self.headset_id = ''
+        self.session_id = ''
+        self.data_labels = {}
+        self.warnings = asyncio.Queue(maxsize=256)
+        self._ids = itertools.count(1)
+        self._pending = {}
+        self._subscriptions = {}
+        self._reader = None
+
+    async def connect(self):
+        # Emotiv uses a self-signed certificate on localhost
+        sslopt = None
+        if self.url.startswith('wss'):
+            sslopt = ssl.create_default_context()
+            sslopt.check_hostname = False
+            sslopt.verify_mode = ssl.CERT_NONE
+        self.ws = await websockets.connect(self.url, ssl=sslopt, max_size=None)
+        self._reader = asyncio.ensure_future(self._read_loop())
+        return self
+
+    async def close(self):
+        if self.ws is not None:
+            await self.ws.close()
+        if self._reader is not None:
+            await asyncio.gather(self._reader, return_exceptions=True)
+        self.ws = None
+        self._reader = None
+
+    async def __aenter__(self):
+        return await self.connect()
+
+    async def __aexit__(self, *exc):
+        await self.close()
+
+    async def call(self, method, **params):
+        """Send one JSON-RPC request and wait for its result."""
+        request_id = next(self._ids)
+        future = asyncio.get_running_loop().create_future()
+        self._pending[request_id] = (method, future)
+        request = {"jsonrpc": "2.0", "id": request_id, "method": method, "params": params}
+        if self.debug:
+            print('{0} request \n'.format(method), json.dumps(request, indent=4))
+        try:
+            await self.ws.send(json.dumps(request))
+            return await future
+        finally:
+            self._pending.pop(request_id, None)
+
+    async def _read_loop(self):
+        try:
+            async for message in self.ws:
+                self._on_message(self.json_loads(message))
+        except websockets.exceptions.ConnectionClosed:
+            pass
+        finally:
+            error = ConnectionError('Cortex connection closed')
+            for method, future in list(self._pending.values()):
+                if not future.done():
+                    future.set_exception(error)
+            for subscriptions in self._subscriptions.values():
+                for subscription in list(subscriptions):
+                    subscription.put(None)
+
+    def _on_message(self, recv_dic):
+        if 'sid' in recv_dic:
+            for stream_name, subscriptions in self._subscriptions.items():
+                if stream_name in recv_dic and subscriptions:
+                    sample = stream_sample(stream_name, recv_dic)
+                    for subscription in subscriptions:
+                        subscription.put(sample)
+                    return
+            return
+        if self.debug:
+            print(recv_dic)
+        pending = self._pending.get(recv_dic.get('id'))
+        if pending is not None:
+            method, future = pending
+            if future.done():
+                return
+            if 'error' in recv_dic:
+                future.set_exception(CortexError(method, recv_dic['error']))
+            else:
+                future.set_result(recv_dic.get('result'))
+        elif 'warning' in recv_dic:
+            if self.warnings.full():
+                self.warnings.get_nowait()
+            self.warnings.put_nowait(recv_dic['warning'])
+        elif 'error' in recv_dic:
+            warnings.warn('Cortex error: ' + str(recv_dic['error']))
+
+    # streams
+
+    def stream(self, stream_name, queue_size=None):
+        """Async iterator over the samples of a subscribed stream."""
+        subscription = StreamSubscription(self, stream_name, queue_size or self.stream_queue_size)
+        self._subscriptions.setdefault(stream_name, []).append(subscription)
+        return subscription
+
+    def _unregister(self, subscription):
+        subscriptions = self._subscriptions.get(subscription.stream_name, [])
+        if subscription in subscriptions:
+            subscriptions.remove(subscription)
+
+    # JSON-RPC methods
+
+    def get_cortex_info(self):
+        return self.call('getCortexInfo')
+
+    def has_access_right(self):
+        return self.call('hasAccessRight', clientId=self.client_id, clientSecret=self.client_secret)
+
+    def request_access(self):
+        return self.call('requestAccess', clientId=self.client_id, clientSecret=self.client_secret)
+
+    async def authorize(self):
+        params = {'clientId': self.client_id, 'clientSecret': self.client_secret, 'debit': self.debit}
+        if self.license != '':
+            params['license'] = self.license
+        result = await self.call('authorize', **params)
+        self.auth = result['cortexToken']
+        return self.auth
+
+    def query_headsets(self, headset_id=None):
+        return self.call('queryHeadsets', **({'id': headset_id} if headset_id else {}))
+
+    def control_device(self, command, headset_id=None):
+        params = {'command': command}
+        if headset_id:
+            params['headset'] = headset_id
+        return self.call('controlDevice', **params)
+
+    async def create_session(self, headset_id=None, status='active'):
+        result = await self.call('createSession', cortexToken=self.auth,
+                                 headset=headset_id or self.headset_id, status=status)
+        self.session_id = result['id']
+        return self.session_id
+
+    async def close_session(self):
+        result = await self.call('updateSession', cortexToken=self.auth, session=self.session_id, status='close')
+        self.session_id = ''
+        return result
+
+    async def subscribe(self, streams):
+        result = await self.call('subscribe', cortexToken=self.auth, session=self.session_id, streams=streams)
+        for stream in result['success']:
+            stream_name = stream['streamName']
+            cols = stream['cols']
+            if stream_name == 'eeg':
+                # remove MARKERS
+                cols = cols[:-1]
+            elif stream_name == 'dev':
+                cols = cols[2]
+            self.data_labels[stream_name] = cols
+        for stream in result['failure']:
+            print('The data stream ' + stream['streamName'] + ' is subscribed unsuccessfully. Because: '
+                  + stream['message'])
+        return result
+
+    def unsubscribe(self, streams):
+        return self.call('unsubscribe', cortexToken=self.auth, session=self.session_id, streams=streams)
+
+    def create_record(self, title, **kwargs):
+        return self.call('createRecord', cortexToken=self.auth, session=self.session_id, title=title, **kwargs)
+
+    def stop_record(self):
+        return self.call('stopRecord', cortexToken=self.auth, session=self.session_id)
+
+    def export_record(self, folder, stream_types, export_format, record_ids, version, **kwargs):
+        params = {'cortexToken': self.auth, 'folder': folder, 'format': export_format,
+                  'streamTypes': stream_types, 'recordIds': record_ids}
+        if export_format == 'CSV':
+            params['version'] = version
+        params.update(kwargs)
+        return self.call('exportRecord', **params)
+
+    def inject_marker(self, time, value, label, **kwargs):
+        return self.call('injectMarker', cortexToken=self.auth, session=self.session_id,
+                         time=time, value=value, label=label, **kwargs)
+
+    def update_marker(self, marker_id, time, **kwargs):
+        return self.call('updateMarker', cortexToken=self.auth, session=self.session_id,
+                         markerId=marker_id, time=time, **kwargs)
+
+    def query_profile(self):
+        return self.call('queryProfile', cortexToken=self.auth)
+
+    def get_current_profile(self, headset_id=None):
+        return self.call('getCurrentProfile', cortexToken=self.auth, headset=headset_id or self.headset_id)
+
+    def setup_profile(self, profile_name, status, headset_id=None):
+        return self.call('setupProfile', cortexToken=self.auth, headset=headset_id or self.headset_id,
+                         profile=profile_name, status=status)
+
+    def training(self, detection, action, status):
+        return self.call('training', cortexToken=self.auth, session=self.session_id,
+                         detection=detection, action=action, status=status)
+
+    # prepare steps
+
+    async def _access_and_authorize(self, timeout):
+        result = await self.has_access_right()
+        if not result['accessGranted']:
+            result = await self.request_access()
+            if not result['accessGranted']:
+                # wait for the user to approve the app in Emotiv Launcher
+                warnings.warn(result['message'])
+                await self._wait_for_warning(ACCESS_RIGHT_GRANTED, timeout)
+        return await self.authorize()
+
+    async def _wait_for_warning(self, code, timeout):
+        async def wait():
+            while True:
+                warning = await self.warnings.get()
+                if warning['code'] == code:
+                    return warning
+        return await asyncio.wait_for(wait(), timeout)
+
+    async def _connected_headset(self, headset_id, timeout, poll_interval):
+        """Connect the wanted headset (or the first one) and wait until Cortex reports it connected."""
+        await self.control_device('refresh')
+        loop = asyncio.get_running_loop()
+        deadline = loop.time() + timeout
+        connect_sent = False
+        while True:
+            headsets = await self.query_headsets()
+            if headset_id:
+                headsets = [h for h in headsets if h['id'] == headset_id]
+            if headsets:
+                headset = headsets[0]
+                if headset['status'] == 'connected':
+                    return headset['id']
+                if headset['status'] == 'discovered' and not connect_sent:
+                    await self.control_device('connect', headset['id'])
+                    connect_sent = True
+            if loop.time() >= deadline:
+                raise TimeoutError('Headset ' + (headset_id or '(any)') + ' did not connect')
+            await asyncio.sleep(poll_interval)
+
+    async def prepare(self, headset_id=None, streams=None, timeout=60.0, poll_interval=0.5):
+        """
+        Authorize, connect a headset and create a session, then subscribe to streams.
+        The access/authorize chain and the headset connection do not depend on
+        each other and run concurrently.
+
+        Returns
+        -------
+        The session id.
+        """
+        _, self.headset_id = await asyncio.gather(
+            self._access_and_authorize(timeout),
+            self._connected_headset(headset_id or self.headset_id, timeout, poll_interval))
+        await self.create_session()
+        if streams:
+            await self.subscribe(streams)
+        return self.session_id
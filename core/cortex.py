@@ -21,11 +21,35 @@ except ImportError:
     sys.exit(1)
 # --- END: Simplified environment checks ---
 
+# Optional faster JSON decoders, used for incoming messages when installed.
+# Requests are still encoded with the json module.
+import json
+JSON_DECODERS = {'json': json.loads}
+try:
+    import orjson
+    JSON_DECODERS['orjson'] = orjson.loads
+except ImportError:
+    pass
+try:
+    import simdjson
+    JSON_DECODERS['simdjson'] = simdjson.loads
+except ImportError:
+    pass
+DEFAULT_JSON_BACKEND = 'orjson' if 'orjson' in JSON_DECODERS else 'simdjson' if 'simdjson' in JSON_DECODERS else 'json'
+
+import os
 import threading
 import ssl
 import time
-import json
 from datetime import datetime
+import numpy as np
+from core.stream_dispatcher import StreamDispatcher
+from core.stream_stats import StreamStats, StatsReporter
+from core.session_cache import SessionCache
+
+# Cortex service of the EMOTIV Launcher; the CORTEX_URL environment variable overrides it,
+# e.g. ws://localhost:6868 for the mock server in core.mock_cortex
+CORTEX_URL = "wss://localhost:6868"
 
 # define request id
 QUERY_HEADSET_ID                    =   1
@@ -53,6 +77,7 @@ GET_CORTEX_INFO_ID                  =   22
 UPDATE_MARKER_REQUEST_ID            =   23
 UNSUB_REQUEST_ID                    =   24
 REFRESH_HEADSET_LIST_ID             =   25
+QUERY_SESSIONS_ID                   =   26
 
 #define error_code
 ERR_PROFILE_ACCESS_DENIED = -32046
@@ -78,6 +103,13 @@ HEADSET_CANNOT_WORK_WITH_BTLE = 112
 HEADSET_CANNOT_CONNECT_DISABLE_MOTION = 113
 HEADSET_SCANNING_FINISHED = 142
 
+# define dispatch mode
+DISPATCH_SYNC = 'sync'          # emit on the websocket thread (default)
+DISPATCH_THREADED = 'threaded'  # enqueue on the websocket thread, emit from a dispatcher thread
+
+# numeric streams that also get a new_<stream>_batch event in threaded dispatch mode
+BATCH_STREAMS = ['eeg', 'mot', 'dev', 'met', 'pow']
+
 class Cortex(Dispatcher):
 
     _events_ = ['inform_error','create_session_done', 'query_profile_done', 'load_unload_profile_done', 
@@ -85,15 +117,43 @@ class Cortex(Dispatcher):
                 'mc_training_threshold_done', 'create_record_done', 'stop_record_done','warn_cortex_stop_all_sub', 'warn_record_post_processing_done',
                 'inject_marker_done', 'update_marker_done', 'export_record_done', 'new_data_labels', 
                 'new_com_data', 'new_fe_data', 'new_eeg_data', 'new_mot_data', 'new_dev_data', 
-                'new_met_data', 'new_pow_data', 'new_sys_data']
+                'new_met_data', 'new_pow_data', 'new_sys_data',
+                'new_eeg_batch', 'new_mot_batch', 'new_dev_batch', 'new_met_batch', 'new_pow_batch',
+                'connection_lost', 'session_resumed']
     def __init__(self, client_id, client_secret, debug_mode=False, **kwargs):
         
         self.session_id = ''
         self.headset_id = ''
+        self.url = os.environ.get('CORTEX_URL', CORTEX_URL)
         self.debug = debug_mode
         self.debit = 10
         self.license = ''
         self.isHeadsetConnected = False
+        self.dispatch_mode = DISPATCH_SYNC
+        self.dispatch_queue_size = 4096
+        self.dispatch_batch_size = 64
+        self.dispatch_interval = 0.005
+        self.emit_samples = True
+        self.dispatcher = None
+        self.owns_dispatcher = True
+        self.json_backend = DEFAULT_JSON_BACKEND
+        self.instrument = True
+        self.stats_log_interval = None
+        self.stats_port = None
+        self.stream_stats = None
+        self.stats_reporter = None
+        self.auto_reconnect = True
+        self.reconnect_delay = 0.5
+        self.max_reconnect_delay = 10.0
+        self.reconnects = 0
+        self.subscribed_streams = []
+        self.disconnected_at = None
+        self._closing = False
+        self._resuming = False
+        self.cache = None
+        self._warm_start = False
+        self._headset_scan_skipped = False
+        self._headset_from_cache = False
 
         if client_id == '':
             raise ValueError('Empty your_app_client_id. Please fill in your_app_client_id before running the example.')
@@ -113,15 +173,79 @@ class Cortex(Dispatcher):
                 self.debit = value
             elif  key == 'headset_id':
                 self.headset_id = value
+            elif key == 'url':
+                self.url = value
+            elif key == 'dispatch_mode':
+                self.dispatch_mode = value
+            elif key == 'dispatch_queue_size':
+                self.dispatch_queue_size = value
+            elif key == 'dispatch_batch_size':
+                self.dispatch_batch_size = value
+            elif key == 'dispatch_interval':
+                self.dispatch_interval = value
+            elif key == 'dispatcher':
+                # a StreamDispatcher shared with other connections (see core.cortex_pool);
+                # its deliver routes each message back with message['_source']
+                self.dispatcher = value
+                self.owns_dispatcher = False
+                self.dispatch_mode = DISPATCH_THREADED
+            elif key == 'emit_samples':
+                # in threaded mode, set False to get only new_<stream>_batch events
+                self.emit_samples = value
+            elif key == 'json_backend':
+                if value not in JSON_DECODERS:
+                    raise ValueError('JSON backend ' + str(value) + ' is not available. Installed: ' + str(list(JSON_DECODERS)))
+                self.json_backend = value
+            elif key == 'instrument':
+                # latency histograms, handler timing and gap detection, see get_stats()
+                self.instrument = value
+            elif key == 'auto_reconnect':
+                # reopen the websocket after a drop, reuse the token and session, re-subscribe
+                self.auto_reconnect = value
+            elif key == 'reconnect_delay':
+                self.reconnect_delay = value
+            elif key == 'max_reconnect_delay':
+                self.max_reconnect_delay = value
+            elif key == 'cache':
+                # True or a file path: persist token, headset and profile for a warm start (core.session_cache)
+                if value:
+                    self.cache = SessionCache(client_id, path=value if isinstance(value, str) else None)
+            elif key == 'stats_log_interval':
+                self.stats_log_interval = value
+            elif key == 'stats_port':
+                # serve get_stats() as Prometheus text on http://127.0.0.1:<port>/metrics
+                self.stats_port = value
+
+        self.json_loads = JSON_DECODERS[self.json_backend]
+        if self.instrument:
+            self.stream_stats = StreamStats()
+        # per-message decode cost of the selected backend, see get_stream_parse_stats()
+        self.stream_parse_stats = {'backend': self.json_backend, 'messages': 0, 'stream_messages': 0,
+                                   'decode_ns': 0, 'max_decode_ns': 0}
+        # stream key -> handler, so a stream message is routed with one dict lookup per key
+        self.stream_routes = {
+            'com': self.handle_com_data,
+            'fac': self.handle_fac_data,
+            'eeg': self.handle_eeg_data,
+            'mot': self.handle_mot_data,
+            'dev': self.handle_dev_data,
+            'met': self.handle_met_data,
+            'pow': self.handle_pow_data,
+            'sys': self.handle_sys_data,
+        }
 
-    def open(self):
-        url = "wss://localhost:6868"
-        # websocket.enableTrace(True)
-        self.ws = websocket.WebSocketApp(url, 
-                                        on_message=self.on_message,
-                                        on_open = self.on_open,
-                                        on_error=self.on_error,
-                                        on_close=self.on_close)
+        if self.dispatch_mode == DISPATCH_THREADED and self.dispatcher is None:
+            self.dispatcher = StreamDispatcher(self.dispatch_stream_batch,
+                                               queue_size=self.dispatch_queue_size,
+                                               batch_size=self.dispatch_batch_size,
+                                               interval=self.dispatch_interval)
+        elif self.dispatch_mode != DISPATCH_SYNC:
+            raise ValueError('Invalid dispatch_mode ' + str(self.dispatch_mode) + '. Use sync or threaded.')
+
+    def open(self, block=True):
+        """Connect to Cortex. With block=False the websocket thread runs in the background."""
+        self._closing = False
+        self.ws = self._create_websocket()
         thread_name = "WebsockThread:-{:%Y%m%d%H%M%S}".format(datetime.now())
         
         # As default, a Emotiv self-signed certificate is required.
@@ -129,12 +253,81 @@ class Cortex(Dispatcher):
         # Temporarily disabling certificate verification for debugging
         sslopt = {"cert_reqs": ssl.CERT_NONE}
 
-        self.websock_thread  = threading.Thread(target=self.ws.run_forever, args=(None, sslopt), name=thread_name)
+        if self.dispatcher is not None and self.owns_dispatcher:
+            self.dispatcher.start()
+        if self.stats_log_interval or self.stats_port is not None:
+            self.stats_reporter = StatsReporter(self.get_stats, log_interval=self.stats_log_interval,
+                                                port=self.stats_port)
+            self.stats_reporter.start()
+
+        self.websock_thread  = threading.Thread(target=self._run_websocket, args=(sslopt,), name=thread_name)
         self.websock_thread .start()
-        self.websock_thread.join()
+        if block:
+            self.websock_thread.join()
+
+    def _create_websocket(self):
+        # websocket.enableTrace(True)
+        return websocket.WebSocketApp(self.url, 
+                                      on_message=self.on_message,
+                                      on_open = self.on_open,
+                                      on_error=self.on_error,
+                                      on_close=self.on_close)
+
+    def _run_websocket(self, sslopt):
+        """Run the websocket, reopening it with a backoff after a drop unless close() was called."""
+        delay = self.reconnect_delay
+        while True:
+            opened_at = time.time()
+            self.ws.run_forever(None, sslopt)
+            if self._closing or not self.auto_reconnect:
+                break
+            if self.disconnected_at is None:
+                self.disconnected_at = time.time()
+            if time.time() - opened_at > self.max_reconnect_delay:
+                # it was up for a while: retry quickly
+                delay = self.reconnect_delay
+            print('websocket dropped, reconnecting in {0:.1f} s'.format(delay))
+            time.sleep(delay)
+            delay = min(delay * 2, self.max_reconnect_delay)
+            if self._closing:
+                break
+            self.reconnects += 1
+            self.ws = self._create_websocket()
 
     def close(self):
+        self._closing = True
         self.ws.close()
+        if self.dispatcher is not None and self.owns_dispatcher:
+            self.dispatcher.stop()
+        if self.stats_reporter is not None:
+            self.stats_reporter.stop()
+            self.stats_reporter = None
+
+    def emit(self, name, *args, **kwargs):
+        if self.stream_stats is None:
+            return super().emit(name, *args, **kwargs)
+        start_ns = time.perf_counter_ns()
+        result = super().emit(name, *args, **kwargs)
+        self.stream_stats.on_emit(name, time.perf_counter_ns() - start_ns)
+        return result
+
+    def get_stats(self):
+        """
+        Hot-path statistics: per-stream receive-to-handled latency and sample age
+        histograms, gaps (from timestamps) and missing eeg samples (from the
+        COUNTER column), per-event handler time, dispatcher queue and decode counters.
+        Durations are in milliseconds.
+        """
+        stats = self.stream_stats.snapshot() if self.stream_stats is not None else {}
+        stats['parse'] = self.get_stream_parse_stats()
+        stats['dispatch'] = self.get_dispatch_stats()
+        return stats
+
+    def get_dispatch_stats(self):
+        """Queue depth, drop and delivery counters of the threaded dispatcher, or None in sync mode."""
+        if self.dispatcher is None:
+            return None
+        return self.dispatcher.get_stats()
 
     def set_wanted_headset(self, headset_id):
         self.headset_id = headset_id
@@ -144,7 +337,16 @@ class Cortex(Dispatcher):
 
     def on_open(self, *args, **kwargs):
         print("websocket opened")
-        self.do_prepare_steps()
+        if self.disconnected_at is not None and getattr(self, 'auth', '') and self.session_id:
+            # reconnect: try the cached token and the existing session first.
+            # Without a session yet (first connect failed, or a drop before
+            # createSession) the normal steps run and emit create_session_done
+            self._resuming = True
+            self.query_sessions()
+        elif self.cache is not None and self.cache.get_token():
+            self.warm_start()
+        else:
+            self.do_prepare_steps()
 
     def on_error(self, *args):
         if len(args) == 2:
@@ -153,6 +355,10 @@ class Cortex(Dispatcher):
     def on_close(self, *args, **kwargs):
         print("on_close")
         print(args[1])
+        if not self._closing:
+            if self.disconnected_at is None:
+                self.disconnected_at = time.time()
+            self.emit('connection_lost', data={'time': self.disconnected_at, 'session_id': self.session_id})
 
     def handle_result(self, recv_dic):
         if self.debug:
@@ -182,6 +388,8 @@ class Cortex(Dispatcher):
         elif req_id == AUTHORIZE_ID:
             print("Authorize successfully.")
             self.auth = result_dic['cortexToken']
+            if self.cache is not None:
+                self.cache.update(cortex_token=self.auth)
             #After successful authorization, the app will call the API refresh headset list for the first time
             self.refresh_headset_list()
             # query headsets
@@ -198,8 +406,19 @@ class Cortex(Dispatcher):
                 if self.headset_id != '' and self.headset_id == hs_id:
                     found_headset = True
                     headset_status = status
-
-            if len(self.headset_list) == 0:
+                    eeg_rate = (ele.get('settings') or {}).get('eegRate')
+                    if eeg_rate and self.stream_stats is not None:
+                        # the eeg COUNTER wraps at the sampling rate
+                        self.stream_stats.stream('eeg').counter_modulus = int(eeg_rate)
+
+            if self._headset_scan_skipped and (len(self.headset_list) == 0 or (self.headset_id != '' and not found_headset)):
+                # warm start without a headset scan did not find it: scan as in the full flow
+                self._headset_scan_skipped = False
+                if self._headset_from_cache:
+                    self.headset_id = ''
+                self.refresh_headset_list()
+                self.query_headset()
+            elif len(self.headset_list) == 0:
                 self.isHeadsetConnected = False
                 warnings.warn("No headset available. Please turn on a headset.")
             elif self.headset_id == '':
@@ -225,7 +444,31 @@ class Cortex(Dispatcher):
         elif req_id == CREATE_SESSION_ID:
             self.session_id = result_dic['id']
             print("The session " + self.session_id + " is created successfully.")
-            self.emit('create_session_done', data=self.session_id)
+            self._headset_scan_skipped = False
+            if self.cache is not None:
+                self.cache.update(headset_id=self.headset_id)
+            if self._resuming:
+                self._resume_streams()
+            else:
+                # a drop before this point was not an outage of a session
+                self.disconnected_at = None
+                self.emit('create_session_done', data=self.session_id)
+        elif req_id == QUERY_SESSIONS_ID and self._warm_start:
+            # the cached token is accepted: skip access check, authorize and headset scan
+            print("Cached cortex token is valid.")
+            self._warm_start = False
+            self._headset_scan_skipped = True
+            self.query_headset()
+        elif req_id == QUERY_SESSIONS_ID:
+            session = next((ele for ele in result_dic if ele.get('id') == self.session_id), None)
+            if session is not None and session.get('status') != 'closed':
+                print("Reattached to session " + self.session_id)
+                self._resume_streams()
+            else:
+                # token is still valid but the session is gone: reconnect the headset and create a new one
+                print("Session " + self.session_id + " is gone, creating a new one")
+                self.session_id = ''
+                self.query_headset()
         elif req_id == SUB_REQUEST_ID:
             # handle data label
             for stream in result_dic['success']:
@@ -271,6 +514,8 @@ class Cortex(Dispatcher):
                     self.setup_profile(profile_name, 'load')
             elif action == 'load':
                 print('load profile successfully')
+                if self.cache is not None:
+                    self.cache.update(profile_name=self.profile_name)
                 self.emit('load_unload_profile_done', isLoaded=True)
             elif action == 'unload':
                 self.emit('load_unload_profile_done', isLoaded=False)
@@ -334,6 +579,16 @@ class Cortex(Dispatcher):
     def handle_error(self, recv_dic):
         req_id = recv_dic['id']
         print('handle_error: request Id ' + str(req_id))
+        if req_id == QUERY_SESSIONS_ID and (self._resuming or self._warm_start):
+            # cached token rejected: run the full prepare steps again
+            print('cached cortex token rejected, authorizing again')
+            self._warm_start = False
+            self.auth = ''
+            self.session_id = ''
+            if self.cache is not None:
+                self.cache.invalidate_token()
+            self.do_prepare_steps()
+            return
         self.emit('inform_error', error_data=recv_dic['error'])
     
     def handle_warning(self, warning_dic):
@@ -365,60 +620,137 @@ class Cortex(Dispatcher):
             if (self.isHeadsetConnected == False):
                 self.refresh_headset_list()
 
+    def _resume_streams(self):
+        """Re-subscribe after a reconnect and report the length of the outage."""
+        self._resuming = False
+        if self.subscribed_streams:
+            self.sub_request(list(self.subscribed_streams))
+        gap = {'start': self.disconnected_at, 'end': time.time(), 'session_id': self.session_id,
+               'streams': list(self.subscribed_streams)}
+        self.disconnected_at = None
+        print('Session resumed after {0:.2f} s'.format(gap['end'] - gap['start']))
+        self.emit('session_resumed', data=gap)
+
     def handle_stream_data(self, result_dic):
-        if result_dic.get('com') != None:
-            com_data = {}
-            com_data['action'] = result_dic['com'][0]
-            com_data['power'] = result_dic['com'][1]
-            com_data['time'] = result_dic['time']
-            self.emit('new_com_data', data=com_data)
-        elif result_dic.get('fac') != None:
-            fe_data = {}
-            fe_data['eyeAct'] = result_dic['fac'][0]    #eye action
-            fe_data['uAct'] = result_dic['fac'][1]      #upper action
-            fe_data['uPow'] = result_dic['fac'][2]      #upper action power
-            fe_data['lAct'] = result_dic['fac'][3]      #lower action
-            fe_data['lPow'] = result_dic['fac'][4]      #lower action power
-            fe_data['time'] = result_dic['time']
-            self.emit('new_fe_data', data=fe_data)
-        elif result_dic.get('eeg') != None:
-            eeg_data = {}
-            eeg_data['eeg'] = result_dic['eeg']
-            eeg_data['eeg'].pop() # remove markers
-            eeg_data['time'] = result_dic['time']
-            self.emit('new_eeg_data', data=eeg_data)
-        elif result_dic.get('mot') != None:
-            mot_data = {}
-            mot_data['mot'] = result_dic['mot']
-            mot_data['time'] = result_dic['time']
-            self.emit('new_mot_data', data=mot_data)
-        elif result_dic.get('dev') != None:
-            dev_data = {}
-            dev_data['signal'] = result_dic['dev'][1]
-            dev_data['dev'] = result_dic['dev'][2]
-            dev_data['batteryPercent'] = result_dic['dev'][3]
-            dev_data['time'] = result_dic['time']
-            self.emit('new_dev_data', data=dev_data)
-        elif result_dic.get('met') != None:
-            met_data = {}
-            met_data['met'] = result_dic['met']
-            met_data['time'] = result_dic['time']
-            self.emit('new_met_data', data=met_data)
-        elif result_dic.get('pow') != None:
-            pow_data = {}
-            pow_data['pow'] = result_dic['pow']
-            pow_data['time'] = result_dic['time']
-            self.emit('new_pow_data', data=pow_data)
-        elif result_dic.get('sys') != None:
-            sys_data = result_dic['sys']
-            self.emit('new_sys_data', data=sys_data)
-        else :
-            print(result_dic)
+        for key in result_dic:
+            handler = self.stream_routes.get(key)
+            if handler is not None:
+                handler(result_dic)
+                if self.stream_stats is not None:
+                    self.stream_stats.on_delivered(key, result_dic, time.perf_counter_ns())
+                return
+        print(result_dic)
+
+    def handle_com_data(self, result_dic):
+        com = result_dic['com']
+        self.emit('new_com_data', data={'action': com[0], 'power': com[1], 'time': result_dic['time']})
+
+    def handle_fac_data(self, result_dic):
+        fac = result_dic['fac']
+        fe_data = {
+            'eyeAct': fac[0],   #eye action
+            'uAct': fac[1],     #upper action
+            'uPow': fac[2],     #upper action power
+            'lAct': fac[3],     #lower action
+            'lPow': fac[4],     #lower action power
+            'time': result_dic['time']
+        }
+        self.emit('new_fe_data', data=fe_data)
+
+    def handle_eeg_data(self, result_dic):
+        eeg = result_dic['eeg']
+        eeg.pop() # remove markers
+        self.emit('new_eeg_data', data={'eeg': eeg, 'time': result_dic['time']})
+
+    def handle_mot_data(self, result_dic):
+        self.emit('new_mot_data', data={'mot': result_dic['mot'], 'time': result_dic['time']})
+
+    def handle_dev_data(self, result_dic):
+        dev = result_dic['dev']
+        dev_data = {
+            'signal': dev[1],
+            'dev': dev[2],
+            'batteryPercent': dev[3],
+            'time': result_dic['time']
+        }
+        self.emit('new_dev_data', data=dev_data)
+
+    def handle_met_data(self, result_dic):
+        self.emit('new_met_data', data={'met': result_dic['met'], 'time': result_dic['time']})
+
+    def handle_pow_data(self, result_dic):
+        self.emit('new_pow_data', data={'pow': result_dic['pow'], 'time': result_dic['time']})
+
+    def handle_sys_data(self, result_dic):
+        self.emit('new_sys_data', data=result_dic['sys'])
+
+    def dispatch_stream_batch(self, messages):
+        """
+        Deliver a micro-batch of stream messages on the dispatcher thread.
+        Each numeric stream in the batch is emitted once as new_<stream>_batch with
+        'time' as an (n,) array and the values as an (n, width) array; the usual
+        per-sample events follow unless emit_samples is False.
+        """
+        groups = {}
+        for recv_dic in messages:
+            for stream_name in BATCH_STREAMS:
+                if stream_name in recv_dic:
+                    groups.setdefault(stream_name, []).append(recv_dic)
+                    break
+
+        for stream_name, group in groups.items():
+            times = np.array([m['time'] for m in group], dtype=np.float64)
+            if stream_name == 'eeg':
+                # remove markers
+                batch = {'eeg': np.array([m['eeg'][:-1] for m in group], dtype=np.float64)}
+            elif stream_name == 'dev':
+                batch = {'signal': np.array([m['dev'][1] for m in group], dtype=np.float64),
+                         'dev': np.array([m['dev'][2] for m in group], dtype=np.float64),
+                         'batteryPercent': np.array([m['dev'][3] for m in group], dtype=np.float64)}
+            else:
+                batch = {stream_name: np.array([m[stream_name] for m in group], dtype=np.float64)}
+            batch['time'] = times
+            self.emit('new_' + stream_name + '_batch', data=batch)
+
+        if self.emit_samples:
+            for recv_dic in messages:
+                self.handle_stream_data(recv_dic)
+        else:
+            for recv_dic in messages:
+                if not any(stream_name in recv_dic for stream_name in BATCH_STREAMS):
+                    self.handle_stream_data(recv_dic)
+            if self.stream_stats is not None:
+                done_ns = time.perf_counter_ns()
+                for stream_name, group in groups.items():
+                    for recv_dic in group:
+                        self.stream_stats.on_delivered(stream_name, recv_dic, done_ns)
+
+    def get_stream_parse_stats(self):
+        """Decode counters of the selected JSON backend with the mean cost per message."""
+        stats = dict(self.stream_parse_stats)
+        messages = stats['messages']
+        stats['mean_decode_us'] = stats['decode_ns'] / messages / 1000.0 if messages else 0.0
+        return stats
 
     def on_message(self, *args):
-        recv_dic = json.loads(args[1])
+        start_ns = time.perf_counter_ns()
+        recv_dic = self.json_loads(args[1])
+        decode_ns = time.perf_counter_ns() - start_ns
+        stats = self.stream_parse_stats
+        stats['messages'] += 1
+        stats['decode_ns'] += decode_ns
+        if decode_ns > stats['max_decode_ns']:
+            stats['max_decode_ns'] = decode_ns
         if 'sid' in recv_dic:
-            self.handle_stream_data(recv_dic)
+            stats['stream_messages'] += 1
+            if self.stream_stats is not None:
+                recv_dic['_recv_ns'] = start_ns
+            if self.dispatcher is not None:
+                if not self.owns_dispatcher:
+                    recv_dic['_source'] = self
+                self.dispatcher.put(recv_dic)
+            else:
+                self.handle_stream_data(recv_dic)
         elif 'result' in recv_dic:
             self.handle_result(recv_dic)
         elif 'error' in recv_dic:
@@ -562,6 +894,21 @@ class Cortex(Dispatcher):
         None
         """
 
+    def warm_start(self):
+        """
+        Start from the cache: reuse the cached token (validated with querySessions),
+        the last headset unless another one was requested, and the last profile.
+        """
+        print('warm start from cache --------------------------------')
+        self.auth = self.cache.get_token()
+        if self.headset_id == '' and self.cache.get_headset():
+            self.headset_id = self.cache.get_headset()
+            self._headset_from_cache = True
+        if not getattr(self, 'profile_name', '') and self.cache.get_profile():
+            self.profile_name = self.cache.get_profile()
+        self._warm_start = True
+        self.query_sessions()
+
     def do_prepare_steps(self):
         print('do_prepare_steps--------------------------------')
         # check access right
@@ -581,8 +928,25 @@ class Cortex(Dispatcher):
 
         self.ws.send(json.dumps(disconnect_headset_request))
 
+    def query_sessions(self):
+        print('query sessions --------------------------------')
+        query_sessions_request = {
+            "jsonrpc": "2.0",
+            "id": QUERY_SESSIONS_ID,
+            "method": "querySessions",
+            "params": {
+                "cortexToken": self.auth
+            }
+        }
+
+        self.ws.send(json.dumps(query_sessions_request))
+
     def sub_request(self, stream):
         print('subscribe request --------------------------------')
+        # remembered so they can be re-subscribed after a reconnect
+        for stream_name in stream:
+            if stream_name not in self.subscribed_streams:
+                self.subscribed_streams.append(stream_name)
         sub_request_json = {
             "jsonrpc": "2.0", 
             "method": "subscribe", 
@@ -600,6 +964,7 @@ class Cortex(Dispatcher):
 
     def unsub_request(self, stream):
         print('unsubscribe request --------------------------------')
+        self.subscribed_streams = [s for s in self.subscribed_streams if s not in stream]
         unsub_request_json = {
             "jsonrpc": "2.0", 
             "method": "unsubscribe", 
@@ -0,0 +1,251 @@
+import os
+import re
+import threading
+from datetime import datetime
+from pydispatch import Dispatcher
+from core.cortex import Cortex
+from core.stream_dispatcher import StreamDispatcher
+from core.stream_buffer import StreamBuffer
+from core.stream_writer import StreamWriter
+from core.session_format import stream_filename
+from core.data_collector import NUMERIC_STREAMS, STREAM_HEAD_COLUMNS
+
+# per-sample events re-emitted by the pool with a 'headset' field added to data
+POOL_STREAM_EVENTS = ['new_data_labels', 'new_com_data', 'new_fe_data', 'new_eeg_data', 'new_mot_data',
+                      'new_dev_data', 'new_met_data', 'new_pow_data', 'new_sys_data',
+                      'new_eeg_batch', 'new_mot_batch', 'new_dev_batch', 'new_met_batch', 'new_pow_batch']
+# reconnect events of each connection (see Cortex), re-emitted with data['headset'] as well
+POOL_CONNECTION_EVENTS = ['connection_lost', 'session_resumed']
+
+
+class CortexPool(Dispatcher):
+    """
+    Drives several headsets at once from one process.
+
+    Each headset gets its own Cortex connection (a Cortex session belongs to
+    one headset, and the request ids of the Cortex class are fixed per
+    method, so sessions are not multiplexed on one socket). All connections
+    share a single StreamDispatcher thread (a shared one, whose put() is
+    locked for the several producers): the websocket threads only decode
+    and enqueue, and every stream event is emitted from that one thread, so
+    handlers never run concurrently for different headsets.
+
+    Every stream event of every connection is re-emitted by the pool with
+    data['headset'] set to the headset id, for example
+        pool.bind(new_met_data=on_met)   # data = {'met': [...], 'time': t, 'headset': 'INSIGHT-1234'}
+    sys data is emitted as {'sys': data, 'headset': ...}. connection_lost and
+    session_resumed are forwarded the same way; after a resume the recorded
+    buffers of that headset get a gap marker, as in DataCollector.
+
+    start_recording() streams the numeric streams of all headsets to disk with
+    one StreamWriter, one directory per headset:
+        {output_directory}/{headset}/data_{stream}_{timestamp}.{format}
+    """
+
+    _events_ = ['create_session_done', 'inform_error', 'all_sessions_ready'] + POOL_STREAM_EVENTS + POOL_CONNECTION_EVENTS
+
+    def __init__(self, client_id, client_secret, headset_ids, streams=None, **kwargs):
+        if not headset_ids:
+            raise ValueError('CortexPool needs at least one headset id')
+        self.headset_ids = list(headset_ids)
+        self.streams = list(streams) if streams else []
+        self.dispatcher = StreamDispatcher(self._deliver,
+                                           queue_size=kwargs.pop('dispatch_queue_size', 4096 * len(self.headset_ids)),
+                                           batch_size=kwargs.pop('dispatch_batch_size', 64),
+                                           interval=kwargs.pop('dispatch_interval', 0.005),
+                                           shared=True)
+        kwargs.pop('dispatch_mode', None)
+
+        self.connections = {}
+        self.sessions = {}
+        self.data_labels = {}
+        self.writer = None
+        self.buffers = {}
+        self._lock = threading.Lock()
+        # pydispatch keeps weak references to callbacks; the closures bound
+        # to the connections are kept alive here
+        self._callbacks = []
+
+        for headset_id in self.headset_ids:
+            cortex = Cortex(client_id, client_secret, headset_id=headset_id,
+                            dispatcher=self.dispatcher, **kwargs)
+            self._bind_connection(headset_id, cortex)
+            self.connections[headset_id] = cortex
+
+    def _bind_connection(self, headset_id, cortex):
+        def on_session(*args, **kwargs):
+            self._on_session(headset_id, kwargs.get('data'))
+
+        def on_error(*args, **kwargs):
+            self.emit('inform_error', headset=headset_id, error_data=kwargs.get('error_data'))
+
+        callbacks = {'create_session_done': on_session, 'inform_error': on_error}
+        for event in POOL_STREAM_EVENTS + POOL_CONNECTION_EVENTS:
+            callbacks[event] = self._forwarder(event, headset_id)
+        self._callbacks.extend(callbacks.values())
+        cortex.bind(**callbacks)
+
+    def _forwarder(self, event, headset_id):
+        if event == 'new_sys_data':
+            def forward(*args, **kwargs):
+                self.emit(event, data={'sys': kwargs.get('data'), 'headset': headset_id})
+        elif event == 'new_data_labels':
+            def forward(*args, **kwargs):
+                data = kwargs.get('data')
+                data['headset'] = headset_id
+                self._on_labels(headset_id, data)
+                self.emit(event, data=data)
+        elif event == 'session_resumed':
+            def forward(*args, **kwargs):
+                data = kwargs.get('data')
+                data['headset'] = headset_id
+                self._on_session_resumed(headset_id, data)
+                self.emit(event, data=data)
+        else:
+            def forward(*args, **kwargs):
+                data = kwargs.get('data')
+                # handler dicts are built per emit, so tagging in place does not copy
+                data['headset'] = headset_id
+                self.emit(event, data=data)
+        return forward
+
+    def _deliver(self, messages):
+        """Shared dispatcher callback: hand each message back to the connection that received it."""
+        groups = {}
+        for message in messages:
+            groups.setdefault(message['_source'], []).append(message)
+        for cortex, group in groups.items():
+            cortex.dispatch_stream_batch(group)
+
+    def open(self):
+        """Connect every headset in parallel; returns immediately."""
+        self.dispatcher.start()
+        for cortex in self.connections.values():
+            cortex.open(block=False)
+
+    def wait(self):
+        """Block until every websocket thread has finished."""
+        for cortex in self.connections.values():
+            cortex.websock_thread.join()
+
+    def close(self):
+        self.stop_recording()
+        for headset_id, cortex in self.connections.items():
+            if headset_id in self.sessions:
+                if self.streams:
+                    cortex.unsub_request(self.streams)
+                cortex.close_session()
+            cortex.close()
+        self.dispatcher.stop()
+
+    def subscribe(self, streams):
+        """Subscribe every open session now and every later session on creation."""
+        self.streams = list(streams)
+        for headset_id in list(self.sessions):
+            self.connections[headset_id].sub_request(self.streams)
+
+    def _on_session(self, headset_id, session_id):
+        with self._lock:
+            self.sessions[headset_id] = session_id
+            ready = len(self.sessions) == len(self.connections)
+        print('session {0} created for headset {1}'.format(session_id, headset_id))
+        if self.streams:
+            self.connections[headset_id].sub_request(self.streams)
+        self.emit('create_session_done', data=session_id, headset=headset_id)
+        if ready:
+            self.emit('all_sessions_ready', data=dict(self.sessions))
+
+    def _on_session_resumed(self, headset_id, gap):
+        print('headset {0} resumed after a {1:.2f} s gap'.format(headset_id, gap['end'] - gap['start']))
+        for (buf_headset, _), buf in list(self.buffers.items()):
+            if buf_headset == headset_id:
+                buf.mark_gap(gap['start'], gap['end'])
+
+    def _on_labels(self, headset_id, data):
+        stream_name = data['streamName']
+        self.data_labels[(headset_id, stream_name)] = data['labels']
+        buf = self.buffers.get((headset_id, stream_name))
+        if buf is not None and buf.total_samples == 0:
+            head = STREAM_HEAD_COLUMNS.get(stream_name, ['timestamp'])
+            buf.set_width(len(head) + len(data['labels']))
+
+    # recording
+
+    def start_recording(self, output_directory='collected_data', streams=None, **writer_kwargs):
+        """
+        Write the numeric streams of every headset with one shared StreamWriter.
+        writer_kwargs are passed to StreamWriter (flush_interval, file_format, ...).
+        """
+        streams = [s for s in (streams or self.streams or NUMERIC_STREAMS) if s in NUMERIC_STREAMS]
+        timestamp = datetime.now().strftime('%Y%m%d_%H%M%S')
+        self.buffers = {}
+        for headset_id in self.headset_ids:
+            for stream_name in streams:
+                buf = StreamBuffer()
+                labels = self.data_labels.get((headset_id, stream_name))
+                if labels is not None:
+                    buf.set_width(len(STREAM_HEAD_COLUMNS.get(stream_name, ['timestamp'])) + len(labels))
+                self.buffers[(headset_id, stream_name)] = buf
+        self.bind(new_eeg_data=self._record_sample, new_mot_data=self._record_sample,
+                  new_met_data=self._record_sample, new_pow_data=self._record_sample,
+                  new_dev_data=self._record_dev)
+
+        def filename_fn(key, file_format):
+            directory = os.path.join(output_directory, _safe_name(key[0]))
+            os.makedirs(directory, exist_ok=True)
+            return stream_filename(directory, key[1], timestamp, file_format)
+
+        writer_kwargs.setdefault('max_pending', 65536)
+        self.writer = StreamWriter(self.buffers, self._stream_headers, output_directory, timestamp,
+                                   metadata_fn=self._stream_metadata, filename_fn=filename_fn,
+                                   **writer_kwargs)
+        self.writer.start()
+
+    def stop_recording(self):
+        if self.writer is None:
+            return
+        self.unbind(self._record_sample, self._record_dev)
+        self.writer.stop()
+        self.writer = None
+
+    def _record_sample(self, *args, **kwargs):
+        data = kwargs.get('data')
+        for stream_name in ('eeg', 'mot', 'met', 'pow'):
+            if stream_name in data:
+                buf = self.buffers.get((data['headset'], stream_name))
+                if buf is not None:
+                    buf.append((data['time'],), data[stream_name])
+                return
+
+    def _record_dev(self, *args, **kwargs):
+        data = kwargs.get('data')
+        buf = self.buffers.get((data['headset'], 'dev'))
+        if buf is not None:
+            buf.append((data['time'], data['signal'], data['batteryPercent']), data['dev'])
+
+    def _stream_headers(self, key):
+        head = STREAM_HEAD_COLUMNS.get(key[1], ['timestamp'])
+        labels = self.data_labels.get(key)
+        if labels is not None:
+            return head + labels
+        return head + [f'value_{i}' for i in range(self.buffers[key].width - len(head))]
+
+    def _stream_metadata(self, key):
+        return {
+            'stream': key[1],
+            'headset_id': key[0],
+            'session_id': self.sessions.get(key[0], ''),
+        }
+
+    def get_stats(self):
+        """Per-headset Cortex.get_stats() plus the shared dispatcher and writer counters."""
+        stats = {'dispatch': self.dispatcher.get_stats(),
+                 'headsets': {headset_id: cortex.get_stats() for headset_id, cortex in self.connections.items()}}
+        if self.writer is not None:
+            stats['samples_written'] = {'{0}/{1}'.format(*key): n for key, n in self.writer.samples_written.items()}
+            stats['write_errors'] = {'{0}/{1}'.format(*key): n for key, n in self.writer.write_errors.items()}
+        return stats
+
+
+def _safe_name(headset_id):
+    return re.sub(r'[^A-Za-z0-9_.-]', '_', headset_id)
@@ -1,8 +1,20 @@
 import os
 import time
-import csv
 from datetime import datetime
 from core.cortex import Cortex
+from core.stream_buffer import StreamBuffer
+from core.stream_writer import StreamWriter
+from core.session_format import open_stream_file, stream_filename
+from core.signal_quality import SignalQualityMonitor, BAD_SEGMENT_TAG
+
+# streams whose samples are all numeric and are kept in float64 columns
+NUMERIC_STREAMS = ['eeg', 'mot', 'dev', 'met', 'pow']
+# leading columns written before the labelled values of each stream
+STREAM_HEAD_COLUMNS = {
+    'dev': ['timestamp', 'signal', 'batteryPercent'],
+}
+# sys row tag of a marker: [time, MARKER_TAG, start, end, label, value, id]
+MARKER_TAG = 'marker'
 
 class DataCollector:
     """
@@ -23,17 +35,40 @@ class DataCollector:
         print("Initializing Emotiv Data Collector")
         print("=" * 60)
         
+        # Per-stream capacity in samples. None keeps every sample (chunked growth),
+        # a number turns each buffer into a ring that keeps only the newest samples.
+        self.buffer_capacity = kwargs.pop('buffer_capacity', None)
+        # Append samples to disk from a background thread while collecting.
+        # Set stream_to_file=False to keep everything in memory and save at stop.
+        self.stream_to_file = kwargs.pop('stream_to_file', True)
+        self.flush_interval = kwargs.pop('flush_interval', 1.0)
+        self.fsync_interval = kwargs.pop('fsync_interval', 5.0)
+        self.max_pending = kwargs.pop('max_pending', 65536)
+        # 'csv', 'npy' (memory-mappable binary) or 'ezs' (lossless compressed chunks),
+        # see core.session_format
+        self.file_format = kwargs.pop('file_format', 'csv')
+        # None keeps the format's default: float32 for npy, float64 (exact) for ezs
+        self.value_dtype = kwargs.pop('value_dtype', None)
+        self.writer = None
+        # True or a dict of core.live_dashboard.LiveDashboard options: serve a live
+        # browser view of the streams while collecting
+        self.live_dashboard = kwargs.pop('live_dashboard', None)
+        self.dashboard = None
+        # True or a dict of core.signal_quality.SignalQualityMonitor options: track the
+        # per-channel signal quality and tag bad segments in the sys stream
+        self.signal_quality = kwargs.pop('signal_quality', None)
+        self.quality_monitor = None
+
         # Initialize data storage
-        self.data_buffer = {
-            'eeg': [],
-            'mot': [],
-            'dev': [],
-            'met': [],
-            'pow': [],
-            'fac': [],
-            'com': [],
-            'sys': []
-        }
+        self.data_buffer = {}
+        for stream_name in NUMERIC_STREAMS:
+            self.data_buffer[stream_name] = StreamBuffer(capacity=self.buffer_capacity)
+        self.data_buffer['fac'] = StreamBuffer(width=6, capacity=self.buffer_capacity, dtype=object)
+        self.data_buffer['com'] = StreamBuffer(width=3, capacity=self.buffer_capacity, dtype=object)
+        # sys events are sparse and of variable width, so they stay a plain list
+        self.data_buffer['sys'] = []
+        # markers injected through self.c, by uuid, until they are updated
+        self._markers = {}
         
         self.data_labels = {}
         self.collection_start_time = None
@@ -50,6 +85,16 @@ class DataCollector:
         
         # Bind event handlers
         self._bind_event_handlers()
+        if self.live_dashboard:
+            from core.live_dashboard import LiveDashboard
+            options = self.live_dashboard if isinstance(self.live_dashboard, dict) else {}
+            self.dashboard = LiveDashboard(self.c, **options)
+        if self.signal_quality:
+            options = self.signal_quality if isinstance(self.signal_quality, dict) else {}
+            self.quality_monitor = SignalQualityMonitor(**options)
+            self.quality_monitor.attach(self.c)
+            self.quality_monitor.bind(quality_changed=self.on_quality_changed)
+            self.quality_monitor.bind(bad_segment=self.on_bad_segment)
         
     def _bind_event_handlers(self):
         self.c.bind(create_session_done=self.on_create_session_done)
@@ -63,6 +108,10 @@ class DataCollector:
         self.c.bind(new_fe_data=self.on_new_fe_data)
         self.c.bind(new_com_data=self.on_new_com_data)
         self.c.bind(new_sys_data=self.on_new_sys_data)
+        self.c.bind(inject_marker_done=self.on_inject_marker_done)
+        self.c.bind(update_marker_done=self.on_update_marker_done)
+        self.c.bind(connection_lost=self.on_connection_lost)
+        self.c.bind(session_resumed=self.on_session_resumed)
         
     def start_collection(self, streams=None, duration=30, headset_id=''):
         if streams is None:
@@ -76,12 +125,24 @@ class DataCollector:
         print(f"  - Save to file: {self.save_to_file}")
         if headset_id:
             self.c.set_wanted_headset(headset_id)
+        if self.dashboard is not None:
+            self.dashboard.start()
         self.c.open()
         
     def subscribe_streams(self):
         print(f"\nSubscribing to data streams: {', '.join(self.streams)}")
         self.c.sub_request(self.streams)
         self.collection_start_time = time.time()
+        if self.save_to_file and self.stream_to_file:
+            self.writer = StreamWriter(self.data_buffer, self.get_stream_headers, self.output_directory,
+                                       datetime.now().strftime('%Y%m%d_%H%M%S'),
+                                       flush_interval=self.flush_interval,
+                                       fsync_interval=self.fsync_interval,
+                                       max_pending=self.max_pending,
+                                       file_format=self.file_format,
+                                       value_dtype=self.value_dtype,
+                                       metadata_fn=self.get_stream_metadata)
+            self.writer.start()
         print(f"Data collection started at: {datetime.now().strftime('%Y-%m-%d %H:%M:%S')}")
         import threading
         stop_timer = threading.Timer(self.collection_duration, self.stop_collection)
@@ -90,26 +151,53 @@ class DataCollector:
     def stop_collection(self):
         print(f"\nStopping data collection after {self.collection_duration} seconds...")
         self.c.unsub_request(self.streams)
-        if self.save_to_file:
+        if self.quality_monitor is not None:
+            self.quality_monitor.close_segment(self.quality_monitor.last_time)
+        if self.writer is not None:
+            self.writer.stop()
+            if self.writer.write_errors:
+                print(f"  Failed writes (retried): {self.writer.write_errors}, last: {self.writer.last_error}")
+            self.writer = None
+        elif self.save_to_file:
             self.save_data_to_files()
         self.print_collection_summary()
+        if self.dashboard is not None:
+            self.dashboard.stop()
         self.c.close()
         
     def save_data_to_files(self):
         timestamp = datetime.now().strftime('%Y%m%d_%H%M%S')
         for stream_name, data_list in self.data_buffer.items():
             if data_list:
-                filename = f"{self.output_directory}/data_{stream_name}_{timestamp}.csv"
-                with open(filename, 'w', newline='') as csvfile:
-                    if stream_name in self.data_labels:
-                        headers = ['timestamp'] + self.data_labels[stream_name]
-                    else:
-                        headers = ['timestamp'] + [f'value_{i}' for i in range(len(data_list[0]) - 1)]
-                    writer = csv.writer(csvfile)
-                    writer.writerow(headers)
-                    for data_point in data_list:
-                        writer.writerow(data_point)
+                kwargs = {}
+                file_format = 'csv'
+                if isinstance(data_list, StreamBuffer) and data_list.dtype.kind == 'f':
+                    file_format = self.file_format
+                if file_format in ('npy', 'ezs'):
+                    kwargs = {'metadata': self.get_stream_metadata(stream_name)}
+                    if self.value_dtype is not None:
+                        kwargs['value_dtype'] = self.value_dtype
+                filename = stream_filename(self.output_directory, stream_name, timestamp, file_format)
+                f = open_stream_file(file_format, filename, self.get_stream_headers(stream_name), **kwargs)
+                f.write(data_list.to_array() if isinstance(data_list, StreamBuffer) else data_list)
+                f.close()
                 print(f"  - Saved {len(data_list)} {stream_name} samples to {filename}")
+
+    def get_stream_headers(self, stream_name):
+        head = STREAM_HEAD_COLUMNS.get(stream_name, ['timestamp'])
+        if stream_name in self.data_labels:
+            return head + self.data_labels[stream_name]
+        data_list = self.data_buffer[stream_name]
+        width = data_list.width if isinstance(data_list, StreamBuffer) else len(data_list[0])
+        return head + [f'value_{i}' for i in range(width - len(head))]
+
+    def get_stream_metadata(self, stream_name):
+        return {
+            'stream': stream_name,
+            'headset_id': self.c.headset_id,
+            'session_id': self.c.session_id,
+            'collection_start_time': self.collection_start_time,
+        }
         
     def print_collection_summary(self):
         print("\n" + "=" * 60)
@@ -117,12 +205,16 @@ class DataCollector:
         print("=" * 60)
         total_samples = 0
         for stream_name, data_list in self.data_buffer.items():
-            count = len(data_list)
+            count = data_list.total_samples if isinstance(data_list, StreamBuffer) else len(data_list)
             if count > 0:
                 total_samples += count
                 print(f"  {stream_name.upper():>4}: {count:>6} samples")
         print(f"\n  Total samples collected: {total_samples}")
         print(f"  Collection duration: {self.collection_duration} seconds")
+        if self.c.reconnects:
+            gaps = [gap for gap in self.data_buffer['sys'] if gap[1:2] == ['connection_gap']]
+            lost = sum(gap[3] - gap[2] for gap in gaps)
+            print(f"  Reconnects: {self.c.reconnects}, {len(gaps)} gaps, {lost:.2f} seconds without data")
         if total_samples > 0:
             avg_rate = total_samples / self.collection_duration
             print(f"  Average sample rate: {avg_rate:.1f} samples/second")
@@ -136,67 +228,49 @@ class DataCollector:
         stream_name = data['streamName']
         labels = data['labels']
         self.data_labels[stream_name] = labels
+        if stream_name in NUMERIC_STREAMS and len(self.data_buffer[stream_name]) == 0:
+            head = STREAM_HEAD_COLUMNS.get(stream_name, ['timestamp'])
+            self.data_buffer[stream_name].set_width(len(head) + len(labels))
         print(f"✓ Received {stream_name} labels: {len(labels)} channels")
         
     def on_new_eeg_data(self, *args, **kwargs):
         data = kwargs.get('data')
-        timestamp = data['time']
-        eeg_values = data['eeg']
-        row = [timestamp] + eeg_values
-        self.data_buffer['eeg'].append(row)
-        if len(self.data_buffer['eeg']) % 32 == 0:
-            print(f"EEG: {len(self.data_buffer['eeg'])} samples collected")
+        buf = self.data_buffer['eeg']
+        buf.append((data['time'],), data['eeg'])
+        if buf.total_samples % 32 == 0:
+            print(f"EEG: {buf.total_samples} samples collected")
         
     def on_new_mot_data(self, *args, **kwargs):
         data = kwargs.get('data')
-        timestamp = data['time']
-        mot_values = data['mot']
-        row = [timestamp] + mot_values
-        self.data_buffer['mot'].append(row)
+        self.data_buffer['mot'].append((data['time'],), data['mot'])
         
     def on_new_dev_data(self, *args, **kwargs):
         data = kwargs.get('data')
-        timestamp = data['time']
         signal = data['signal']
-        dev_values = data['dev']
         battery = data['batteryPercent']
-        row = [timestamp, signal, battery] + dev_values
-        self.data_buffer['dev'].append(row)
-        if len(self.data_buffer['dev']) % 10 == 0:
+        buf = self.data_buffer['dev']
+        buf.append((data['time'], signal, battery), data['dev'])
+        if buf.total_samples % 10 == 0:
             print(f"Device: Battery {battery}%, Signal Quality {signal:.1f}")
         
     def on_new_met_data(self, *args, **kwargs):
         data = kwargs.get('data')
-        timestamp = data['time']
-        met_values = data['met']
-        row = [timestamp] + met_values
-        self.data_buffer['met'].append(row)
+        self.data_buffer['met'].append((data['time'],), data['met'])
         
     def on_new_pow_data(self, *args, **kwargs):
         data = kwargs.get('data')
-        timestamp = data['time']
-        pow_values = data['pow']
-        row = [timestamp] + pow_values
-        self.data_buffer['pow'].append(row)
+        self.data_buffer['pow'].append((data['time'],), data['pow'])
         
     def on_new_fe_data(self, *args, **kwargs):
         data = kwargs.get('data')
-        timestamp = data['time']
-        eye_act = data['eyeAct']
-        u_act = data['uAct']
-        u_pow = data['uPow']
-        l_act = data['lAct']
-        l_pow = data['lPow']
-        row = [timestamp, eye_act, u_act, u_pow, l_act, l_pow]
+        row = (data['time'], data['eyeAct'], data['uAct'], data['uPow'], data['lAct'], data['lPow'])
         self.data_buffer['fac'].append(row)
         
     def on_new_com_data(self, *args, **kwargs):
         data = kwargs.get('data')
-        timestamp = data['time']
         action = data['action']
         power = data['power']
-        row = [timestamp, action, power]
-        self.data_buffer['com'].append(row)
+        self.data_buffer['com'].append((data['time'], action, power))
         if action != 'neutral':
             print(f"Mental Command: {action} (power: {power:.2f})")
         
@@ -206,6 +280,60 @@ class DataCollector:
         row = [timestamp] + data if isinstance(data, list) else [timestamp, str(data)]
         self.data_buffer['sys'].append(row)
         
+    def add_marker(self, label, value='', timestamp=None, end=None, marker_id=''):
+        """
+        Record a marker in the sys stream, e.g. a stimulus onset. Markers are read
+        back with DataLoader.get_markers and epoched with SessionStore.around_marker.
+        """
+        timestamp = time.time() if timestamp is None else timestamp
+        self.data_buffer['sys'].append([time.time(), MARKER_TAG, timestamp, timestamp if end is None else end,
+                                        label, value, marker_id])
+
+    def on_inject_marker_done(self, *args, **kwargs):
+        marker = kwargs.get('data')
+        start = _iso_seconds(marker.get('startDatetime'))
+        self.add_marker(marker.get('label', ''), marker.get('value', ''), start, marker_id=marker.get('uuid', ''))
+        self._markers[marker.get('uuid', '')] = marker
+
+    def on_update_marker_done(self, *args, **kwargs):
+        update = kwargs.get('data')
+        marker = self._markers.get(update.get('uuid', ''))
+        if marker is None:
+            return
+        # written again with its end time, the last row of an id wins
+        self.add_marker(marker.get('label', ''), marker.get('value', ''), _iso_seconds(marker.get('startDatetime')),
+                        end=_iso_seconds(update.get('endDatetime')), marker_id=marker.get('uuid', ''))
+
+    def on_quality_changed(self, *args, **kwargs):
+        data = kwargs.get('data')
+        reasons = ', '.join(data['reasons'])
+        print(f"Signal quality {data['channel']}: {data['previous']} -> {data['state']}"
+              + (f" ({reasons})" if reasons else ''))
+
+    def on_bad_segment(self, *args, **kwargs):
+        segment = kwargs.get('data')
+        self.data_buffer['sys'].append([segment['end'], BAD_SEGMENT_TAG, segment['start'], segment['end'],
+                                        ' '.join(segment['channels'])])
+
+    def on_connection_lost(self, *args, **kwargs):
+        print("⚠️ Connection to Cortex lost, reconnecting...")
+        
+    def on_session_resumed(self, *args, **kwargs):
+        gap = kwargs.get('data')
+        print(f"✓ Collection resumed after a {gap['end'] - gap['start']:.2f} s gap")
+        for stream_name in self.streams:
+            buf = self.data_buffer.get(stream_name)
+            if isinstance(buf, StreamBuffer):
+                buf.mark_gap(gap['start'], gap['end'])
+        self.data_buffer['sys'].append([gap['end'], 'connection_gap', gap['start'], gap['end']])
+        
     def on_inform_error(self, *args, **kwargs):
         error_data = kwargs.get('error_data')
-        print(f"❌ Error: {error_data}") 
\ No newline at end of file
+        print(f"❌ Error: {error_data}") 
+
+
+def _iso_seconds(text):
+    """Unix seconds of a Cortex ISO 8601 datetime (startDatetime / endDatetime), now when missing."""
+    if not text:
+        return time.time()
+    return datetime.fromisoformat(text.replace('Z', '+00:00')).timestamp()
@@ -0,0 +1,243 @@
+from functools import lru_cache
+import numpy as np
+from scipy import signal
+from pydispatch import Dispatcher
+
+# same bands as data_analysis/eeg_analysis.py
+FREQUENCY_BANDS = {
+    'delta': (0.5, 4),
+    'theta': (4, 8),
+    'alpha': (8, 13),
+    'beta': (13, 30),
+    'gamma': (30, 100)
+}
+
+# eeg labels that are not electrodes
+NON_CHANNEL_LABELS = ['COUNTER', 'INTERPOLATED', 'RAW_CQ', 'MARKER_HARDWARE']
+
+
+def channel_indices(labels):
+    """Positions of the electrode columns among the eeg labels."""
+    return np.array([i for i, label in enumerate(labels) if label not in NON_CHANNEL_LABELS], dtype=np.intp)
+
+
+class StreamStage:
+    """
+    attach() of the live stages. A stage lists the streams it consumes in
+    _streams_ and provides on_new_data_labels and, per stream, the
+    on_new_<stream>_batch and on_new_<stream>_data handlers.
+    """
+
+    _streams_ = []
+
+    def attach(self, source):
+        """Bind to a Cortex or CortexPool, using batch events when it runs threaded dispatch."""
+        source.bind(new_data_labels=self.on_new_data_labels)
+        kind = 'batch' if getattr(source, 'dispatcher', None) is not None else 'data'
+        for stream in self._streams_:
+            event = 'new_{0}_{1}'.format(stream, kind)
+            source.bind(**{event: getattr(self, 'on_' + event)})
+
+
+@lru_cache(maxsize=32)
+def design_eeg_sos(sampling_rate, lowpass=50.0, highpass=0.5, notch=60.0, order=4):
+    """
+    Second-order sections for the high-pass, low-pass and notch cascade of
+    the live EEGStreamProcessor and the offline EEGAnalyzer, so both filter
+    alike. Designs are cached per parameter set.
+    """
+    nyquist = sampling_rate / 2
+    sections = []
+    if highpass > 0:
+        sections.append(signal.butter(order, highpass / nyquist, btype='high', output='sos'))
+    if lowpass < nyquist:
+        sections.append(signal.butter(order, lowpass / nyquist, btype='low', output='sos'))
+    if 0 < notch < nyquist:
+        b, a = signal.iirnotch(notch, 30, sampling_rate)
+        sections.append(signal.tf2sos(b, a))
+    if not sections:
+        return np.array([[1.0, 0.0, 0.0, 1.0, 0.0, 0.0]])
+    return np.vstack(sections)
+
+
+def epoch_length(seconds, sampling_rate):
+    """
+    Samples of an epoch spanning seconds, both ends included. SessionStore
+    epochs and the live InferenceStage windows use the same length, so a model
+    trained on recorded epochs gets inputs of the same shape live.
+    """
+    return int(round(seconds * sampling_rate)) + 1
+
+
+def epoch_band_powers(epochs, sampling_rate, bands=None):
+    """
+    Welch band powers of unfiltered epochs, the band power features of
+    data_analysis/feature_extraction.py and of InferenceStage's 'band_power'
+    input, so offline training and live decisions see the same values.
+
+    epochs has shape (n_epochs, n_samples, n_channels); returns
+    (n_epochs, n_channels, n_bands) in uV^2.
+    """
+    bands = bands or FREQUENCY_BANDS
+    n_epochs, n_samples, n_channels = epochs.shape
+    nperseg = min(n_samples, int(2 * sampling_rate))
+    frequencies, psd = signal.welch(epochs, fs=sampling_rate, nperseg=nperseg,
+                                    noverlap=nperseg // 2, axis=1)
+    powers = np.zeros((n_epochs, n_channels, len(bands)))
+    for i, (low_freq, high_freq) in enumerate(bands.values()):
+        freq_mask = (frequencies >= low_freq) & (frequencies <= high_freq)
+        if np.any(freq_mask):
+            powers[:, :, i] = np.trapz(psd[:, freq_mask, :], frequencies[freq_mask], axis=1)
+    return powers
+
+
+class WindowRing:
+    """
+    The last window_length samples of every channel, for the stages that act
+    on a sliding window every step_length samples (EEGStreamProcessor,
+    InferenceStage).
+    """
+
+    def __init__(self, window_length, step_length, n_channels):
+        self.window_length = window_length
+        self.step_length = step_length
+        self.ring = np.zeros((window_length, n_channels))
+        self.pos = 0
+        self.filled = 0
+        self.since = 0
+
+    def append(self, x, on_step):
+        """
+        Add an (n, n_channels) block; on_step() is called at every step
+        boundary once the window is full, with the ring as of that sample.
+        """
+        n = len(x)
+        start = 0
+        while start < n:
+            # copy up to the next step boundary or the end of the ring
+            count = min(n - start, self.window_length - self.pos, self.step_length - self.since)
+            self.ring[self.pos:self.pos + count] = x[start:start + count]
+            self.pos = (self.pos + count) % self.window_length
+            self.filled = min(self.filled + count, self.window_length)
+            self.since += count
+            start += count
+            if self.since == self.step_length:
+                self.since = 0
+                if self.filled == self.window_length:
+                    on_step()
+
+    def ordered(self, out):
+        """Write the window into out (window_length, n_channels), oldest sample first."""
+        tail = self.window_length - self.pos
+        out[:tail] = self.ring[self.pos:]
+        out[tail:] = self.ring[:self.pos]
+        return out
+
+
+class EEGStreamProcessor(StreamStage, Dispatcher):
+    """
+    Live filter and band-power stage for the Cortex eeg stream.
+
+    Samples of all channels are filtered together with a cached SOS cascade
+    whose state (zi) is carried from one call to the next, so the output is
+    the same whether samples arrive one at a time or in batches. Filtered
+    samples go into a window_seconds ring; every step_seconds the band power
+    of the window is computed with a Hann-windowed FFT across all channels
+    at once and emitted as new_band_power.
+
+    new_band_power data:
+        {'time': timestamp of the newest sample, 'channels': [...], 'bands': [...],
+         'power': (n_channels, n_bands) array in uV^2}
+    """
+
+    _events_ = ['new_band_power']
+    _streams_ = ['eeg']
+
+    def __init__(self, sampling_rate=128.0, lowpass=50.0, highpass=0.5, notch=60.0,
+                 window_seconds=2.0, step_seconds=0.0625, bands=None):
+        self.sampling_rate = float(sampling_rate)
+        self.sos = design_eeg_sos(self.sampling_rate, lowpass, highpass, notch)
+        self.bands = dict(bands or FREQUENCY_BANDS)
+        self.band_names = list(self.bands)
+        self.window_length = int(round(window_seconds * self.sampling_rate))
+        self.step_length = max(1, int(round(step_seconds * self.sampling_rate)))
+
+        freqs = np.fft.rfftfreq(self.window_length, 1.0 / self.sampling_rate)
+        self.freq_resolution = freqs[1] - freqs[0]
+        self.band_masks = np.array([(freqs >= lo) & (freqs <= hi) for lo, hi in self.bands.values()],
+                                   dtype=np.float64)
+        self.taper = np.hanning(self.window_length)
+        one_sided = np.full(len(freqs), 2.0)
+        one_sided[0] = 1.0
+        if self.window_length % 2 == 0:
+            one_sided[-1] = 1.0
+        self.psd_scale = one_sided / (self.sampling_rate * np.sum(self.taper ** 2))
+
+        self.channels = []
+        self.channel_index = None
+        self.zi = None
+        self.window = None
+        self.ordered = None
+        self.band_power = None
+        self.last_time = None
+
+    def set_labels(self, labels):
+        self.channel_index = channel_indices(labels)
+        self.channels = [labels[i] for i in self.channel_index]
+        n_channels = len(self.channels)
+        self.window = WindowRing(self.window_length, self.step_length, n_channels)
+        self.ordered = np.zeros((self.window_length, n_channels))
+        self.zi = None
+
+    def on_new_data_labels(self, *args, **kwargs):
+        data = kwargs.get('data')
+        if data['streamName'] == 'eeg':
+            self.set_labels(data['labels'])
+
+    def on_new_eeg_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process(np.asarray(data['eeg'], dtype=np.float64)[None, :], data['time'])
+
+    def on_new_eeg_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process(data['eeg'], data['time'][-1])
+
+    def process(self, samples, timestamp=None):
+        """
+        Filter an (n, n_values) block of eeg rows (as laid out by the eeg labels)
+        and update the band power.
+
+        Returns
+        -------
+        The filtered (n, n_channels) block.
+        """
+        if self.channel_index is None:
+            self.set_labels(['ch{0}'.format(i) for i in range(samples.shape[1])])
+        x = samples[:, self.channel_index]
+        if self.zi is None:
+            # start from steady state at the first sample to avoid the step transient
+            self.zi = signal.sosfilt_zi(self.sos)[:, :, None] * x[0][None, None, :]
+        filtered, self.zi = signal.sosfilt(self.sos, x, axis=0, zi=self.zi)
+        self.last_time = timestamp
+
+        self.window.append(filtered, self._update_band_power)
+        return filtered
+
+    def _update_band_power(self):
+        ordered = self.window.ordered(self.ordered)
+        spectrum = np.fft.rfft(ordered * self.taper[:, None], axis=0)
+        psd = (spectrum.real ** 2 + spectrum.imag ** 2) * self.psd_scale[:, None]
+        # (n_bands, n_freqs) @ (n_freqs, n_channels) -> (n_channels, n_bands)
+        self.band_power = (self.band_masks @ psd).T * self.freq_resolution
+        self.emit('new_band_power', data={
+            'time': self.last_time,
+            'channels': self.channels,
+            'bands': self.band_names,
+            'power': self.band_power
+        })
+
+    def get_band_power(self, band):
+        """Latest power of one band for every channel, or None before the first window is full."""
+        if self.band_power is None:
+            return None
+        return self.band_power[:, self.band_names.index(band)]
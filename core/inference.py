@@ -0,0 +1,225 @@
+import time
+import numpy as np
+from pydispatch import Dispatcher
+
+from core.eeg_stream import (FREQUENCY_BANDS, StreamStage, WindowRing, channel_indices, epoch_length,
+                             epoch_band_powers)
+from core.stream_stats import LatencyHistogram
+
+INPUT_MODES = ['window', 'band_power']
+
+
+class OnnxModel:
+    """
+    ONNX Runtime model for InferenceStage (requires onnxruntime).
+
+    Runs on one intra-op thread by default: decisions are small and frequent,
+    and a thread pool wake-up costs more than it saves at these sizes.
+    """
+
+    def __init__(self, path, providers=None, output=0, intra_op_threads=1):
+        import onnxruntime
+        options = onnxruntime.SessionOptions()
+        options.intra_op_num_threads = intra_op_threads
+        self.session = onnxruntime.InferenceSession(path, sess_options=options,
+                                                    providers=providers or ['CPUExecutionProvider'])
+        self.input_name = self.session.get_inputs()[0].name
+        self.output_names = [self.session.get_outputs()[output].name]
+
+    def __call__(self, batch):
+        return self.session.run(self.output_names, {self.input_name: batch})[0]
+
+
+class InferenceStage(StreamStage, Dispatcher):
+    """
+    Runs a user-supplied mental command model on the live eeg stream and
+    emits its decisions as new_custom_com_data, next to Cortex's own com
+    stream.
+
+    model is any callable from a float32 batch to scores of shape
+    (batch, n_actions) (or class indices of shape (batch,)), for example
+    OnnxModel('model.onnx') or a wrapped scikit-learn predict_proba.
+    Its input per decision is, by input_mode:
+    - 'window': the last window_seconds of raw eeg, (n_samples, n_channels),
+      with n_samples = epoch_length(window_seconds, rate), the shape of
+      SessionStore.epochs(pre=0, post=window_seconds);
+    - 'band_power': log10 epoch_band_powers of every channel over that window,
+      channel-major (n_channels * n_bands), the band power columns of
+      data_analysis/feature_extraction.py computed by the same routine.
+    A decision is due every step_seconds of samples.
+
+    Every headset attached (one Cortex, or a CortexPool whose events carry
+    data['headset']) owns one row of a preallocated input tensor. Rows that
+    are due are run together in one model call, when every headset is due
+    or max_batch_delay seconds after the first one, so the cost per
+    decision drops with more headsets. In 'window' mode nothing is allocated
+    per decision besides the model's own output. Every headset must give the
+    same channels; set_labels raises ValueError otherwise.
+
+    new_custom_com_data data:
+        {'action': label, 'power': score of the label, 'time': time of the
+         newest sample, 'headset': headset id ('' for a single Cortex),
+         'scores': per-action scores, 'latency_ms': model call duration,
+         'batch': rows in that call}
+    """
+
+    _events_ = ['new_custom_com_data']
+    _streams_ = ['eeg']
+
+    def __init__(self, model, actions, input_mode='band_power', sampling_rate=128.0, window_seconds=2.0,
+                 step_seconds=0.25, max_batch_delay=0.005, max_headsets=4, dtype=np.float32, bands=None):
+        if input_mode not in INPUT_MODES:
+            raise ValueError('Unknown input mode ' + str(input_mode) + '. Use one of ' + str(INPUT_MODES))
+        self.model = model
+        self.actions = list(actions)
+        self.input_mode = input_mode
+        self.sampling_rate = float(sampling_rate)
+        self.window_length = epoch_length(window_seconds, self.sampling_rate)
+        self.step_length = max(1, int(round(step_seconds * self.sampling_rate)))
+        self.max_batch_delay = max_batch_delay
+        self.max_headsets = max_headsets
+        self.dtype = np.dtype(dtype)
+        self.bands = dict(bands or FREQUENCY_BANDS)
+
+        self.headsets = {}
+        self.inputs = None
+        self.due = np.zeros(max_headsets, dtype=bool)
+        self.due_times = [None] * max_headsets
+        self.first_due = None
+        self.latency = LatencyHistogram()
+        self.batches = 0
+        self.decisions = 0
+
+    def _row_shape(self, n_channels):
+        if self.input_mode == 'window':
+            return (self.window_length, n_channels)
+        return (n_channels * len(self.bands),)
+
+    def set_labels(self, labels, headset=''):
+        channel_index = channel_indices(labels)
+        if headset not in self.headsets and len(self.headsets) >= self.max_headsets:
+            raise ValueError('InferenceStage holds at most ' + str(self.max_headsets) + ' headsets')
+        row_shape = self._row_shape(len(channel_index))
+        if self.inputs is not None and self.inputs.shape[1:] != row_shape:
+            if any(other != headset for other in self.headsets):
+                # reallocating would zero the rows of the headsets already attached
+                raise ValueError('Headset ' + str(headset) + ' gives inputs of shape ' + str(row_shape)
+                                 + ', the attached headsets ' + str(self.inputs.shape[1:])
+                                 + '; one InferenceStage needs the same channels on every headset')
+            self.inputs = None
+        if self.inputs is None:
+            # one row per headset, and the batch handed to the model
+            self.inputs = np.zeros((self.max_headsets,) + row_shape, dtype=self.dtype)
+            self.batch = np.zeros_like(self.inputs)
+        row = self.headsets[headset]['row'] if headset in self.headsets else len(self.headsets)
+        state = {'row': row, 'channel_index': channel_index, 'window': None,
+                 'ring': WindowRing(self.window_length, self.step_length, len(channel_index))}
+        if self.input_mode == 'band_power':
+            # the window in time order, for the band powers
+            state['window'] = np.zeros((1, self.window_length, len(channel_index)))
+        # new labels restart the window, an older decision of the row is stale
+        self.due[row] = False
+        self.headsets[headset] = state
+
+    def on_new_data_labels(self, *args, **kwargs):
+        data = kwargs.get('data')
+        if data['streamName'] == 'eeg':
+            self.set_labels(data['labels'], data.get('headset', ''))
+
+    def on_new_eeg_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process(np.asarray(data['eeg'], dtype=np.float64)[None, :], data['time'], data.get('headset', ''))
+
+    def on_new_eeg_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process(data['eeg'], data['time'][-1], data.get('headset', ''))
+
+    def process(self, samples, timestamp=None, headset=''):
+        """
+        Feed an (n, n_values) block of eeg rows (as laid out by the eeg labels)
+        of one headset, and run the model when decisions are due.
+        Returns the decisions it emitted.
+        """
+        if headset not in self.headsets:
+            self.set_labels(['ch{0}'.format(i) for i in range(samples.shape[1])], headset)
+        state = self.headsets[headset]
+        self._append_window(state, samples[:, state['channel_index']], timestamp)
+        return self._maybe_run()
+
+    def _append_window(self, state, x, timestamp):
+        def on_step():
+            self._write_row(state)
+            self._mark_due(state['row'], timestamp)
+        state['ring'].append(x, on_step)
+
+    def _write_row(self, state):
+        row = self.inputs[state['row']]
+        if state['window'] is None:
+            state['ring'].ordered(row)
+            return
+        state['ring'].ordered(state['window'][0])
+        powers = epoch_band_powers(state['window'], self.sampling_rate, self.bands)
+        with np.errstate(divide='ignore'):
+            np.log10(powers.reshape(-1), out=row, casting='unsafe')
+
+    def _mark_due(self, row, timestamp):
+        if not self.due.any():
+            self.first_due = time.perf_counter()
+        self.due[row] = True
+        self.due_times[row] = timestamp
+
+    def _maybe_run(self):
+        if not self.due.any():
+            return []
+        n_due = int(self.due.sum())
+        if n_due < len(self.headsets) and time.perf_counter() - self.first_due < self.max_batch_delay:
+            return []
+        return self.run_due()
+
+    def run_due(self):
+        """Run the model on every due row now."""
+        rows = np.flatnonzero(self.due)
+        if not len(rows):
+            return []
+        n = len(rows)
+        # mode='clip' lets take write into out without an intermediate buffer
+        np.take(self.inputs, rows, axis=0, out=self.batch[:n], mode='clip')
+        start_ns = time.perf_counter_ns()
+        scores = np.asarray(self.model(self.batch[:n]))
+        duration_ns = time.perf_counter_ns() - start_ns
+        self.latency.record_ns(duration_ns)
+        self.batches += 1
+        self.due[rows] = False
+
+        headsets = {state['row']: headset for headset, state in self.headsets.items()}
+        latency_ms = duration_ns / 1e6
+        decisions = []
+        for i, row in enumerate(rows):
+            if scores.ndim == 1:
+                index, power, row_scores = int(scores[i]), 1.0, None
+            else:
+                row_scores = scores[i]
+                index = int(np.argmax(row_scores))
+                power = float(row_scores[index])
+            decision = {
+                'action': self.actions[index] if 0 <= index < len(self.actions) else str(index),
+                'power': power,
+                'time': self.due_times[row],
+                'headset': headsets.get(row, ''),
+                'scores': row_scores,
+                'latency_ms': latency_ms,
+                'batch': n,
+            }
+            decisions.append(decision)
+        self.decisions += len(decisions)
+        for decision in decisions:
+            self.emit('new_custom_com_data', data=decision)
+        return decisions
+
+    def get_stats(self):
+        return {
+            'headsets': len(self.headsets),
+            'decisions': self.decisions,
+            'batches': self.batches,
+            'latency': self.latency.snapshot(),
+        }
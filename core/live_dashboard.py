@@ -0,0 +1,377 @@
+"""
+Live dashboard for a running Cortex session.
+
+LiveDashboard binds to the Cortex stream events and serves a browser page
+(http://<host>:<http_port>/) that is updated over a WebSocket at a fixed
+frame rate. The work is split so the ingest path does not depend on the
+number of viewers:
+- the event handlers only append (time, values) to a bounded deque per
+  stream, one O(1) append per sample on the socket or dispatcher thread;
+- once per frame the dashboard thread drains the deques, reduces eeg and mot
+  to min/max envelopes of points_per_second buckets (dev, met and pow are
+  slow and sent as they are) and serializes one JSON frame;
+- the same frame text is broadcast to every viewer. New viewers get the
+  labels and the last history seconds of frames on connect.
+
+    dashboard = LiveDashboard(cortex, port=8765, http_port=8080)
+    dashboard.start()
+    cortex.open()
+
+Requires the websockets package.
+"""
+import os
+import json
+import time
+import asyncio
+import threading
+import collections
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+import numpy as np
+
+try:
+    import websockets
+except ImportError:
+    websockets = None
+
+from core.loop_server import LoopThreadServer
+
+# streams reduced to min/max envelopes; the others are at most a few Hz
+ENVELOPE_STREAMS = ['eeg', 'mot']
+NUMERIC_STREAMS = ['eeg', 'mot', 'dev', 'met', 'pow']
+# leading dev values before the contact quality of each channel
+DEV_HEAD_LABELS = ['signal', 'batteryPercent']
+PAGE_PATH = os.path.join(os.path.dirname(__file__), 'live_dashboard.html')
+# decimals kept in frames; EEG is in uV, so 0.01 is below the noise floor
+FRAME_DECIMALS = 2
+
+
+def _json_rows(values):
+    """Rounded rows with NaN/inf as null (JSON has no NaN)."""
+    values = np.round(values, FRAME_DECIMALS)
+    finite = np.isfinite(values)
+    if finite.all():
+        return values.tolist()
+    return np.where(finite, values, None).tolist()
+
+
+class LiveDashboard(LoopThreadServer):
+    """WebSocket broadcaster of pre-aggregated Cortex frames for a browser page."""
+
+    _thread_name = 'LiveDashboard'
+
+    def __init__(self, cortex, host='127.0.0.1', port=8765, http_port=8080, fps=10.0,
+                 points_per_second=64, history=10.0, queue_size=16384):
+        """
+        Bind to the events of a Cortex (or AsyncCortex-compatible emitter).
+
+        cortex             emitter of new_data_labels and new_<stream>_data events
+        host, port         WebSocket address frames are served on (port 0 picks one)
+        http_port          port of the page, None to serve only the WebSocket
+        fps                frames per second
+        points_per_second  envelope buckets per second for eeg and mot
+        history            seconds of frames replayed to a new viewer
+        queue_size         samples (batches for batch events) kept per stream between
+                           two frames; older ones are dropped and counted if frames fall behind
+        """
+        if websockets is None:
+            raise RuntimeError('LiveDashboard requires the websockets package (pip install websockets)')
+        self.cortex = cortex
+        self.host = host
+        self.port = port
+        self.http_port = http_port
+        self.fps = fps
+        self.points_per_second = points_per_second
+        self.queue_size = queue_size
+        self.history = collections.deque(maxlen=max(1, int(history * fps)))
+
+        self.labels = {}
+        self.queues = {name: collections.deque(maxlen=queue_size) for name in NUMERIC_STREAMS + ['com']}
+        # written by the Cortex thread only
+        self.received = dict.fromkeys(self.queues, 0)
+        self.dropped = dict.fromkeys(self.queues, 0)
+        # written by the dashboard thread only
+        self.frames = 0
+        self.bytes_sent = 0
+        self.viewers = set()
+        self._labels_sent = None
+
+        self._server = None
+        self._http_server = None
+        self._frame_task = None
+        self._loop = None
+        self._thread = None
+        self._bind()
+
+    def _bind(self):
+        self.cortex.bind(new_data_labels=self.on_new_data_labels)
+        self.cortex.bind(new_com_data=self.on_new_com_data)
+        if getattr(self.cortex, 'dispatcher', None) is not None and not getattr(self.cortex, 'emit_samples', True):
+            # threaded Cortex that only emits new_<stream>_batch for the numeric streams
+            self.cortex.bind(new_eeg_batch=self.on_new_eeg_batch)
+            self.cortex.bind(new_mot_batch=self.on_new_mot_batch)
+            self.cortex.bind(new_dev_batch=self.on_new_dev_batch)
+            self.cortex.bind(new_met_batch=self.on_new_met_batch)
+            self.cortex.bind(new_pow_batch=self.on_new_pow_batch)
+        else:
+            self.cortex.bind(new_eeg_data=self.on_new_eeg_data)
+            self.cortex.bind(new_mot_data=self.on_new_mot_data)
+            self.cortex.bind(new_dev_data=self.on_new_dev_data)
+            self.cortex.bind(new_met_data=self.on_new_met_data)
+            self.cortex.bind(new_pow_data=self.on_new_pow_data)
+
+    @property
+    def url(self):
+        if self.http_port is None:
+            return 'ws://{0}:{1}'.format(self.host, self.port)
+        return 'http://{0}:{1}/'.format(self.host, self.http_port)
+
+    # ingest, on the Cortex thread
+
+    def _put(self, stream_name, sample_time, values):
+        queue = self.queues[stream_name]
+        if len(queue) == self.queue_size:
+            self.dropped[stream_name] += 1
+        queue.append((sample_time, values))
+        self.received[stream_name] += 1
+
+    def on_new_data_labels(self, *args, **kwargs):
+        data = kwargs.get('data')
+        labels = data['labels']
+        if data['streamName'] == 'dev':
+            labels = DEV_HEAD_LABELS + list(labels)
+        self.labels[data['streamName']] = labels
+
+    def on_new_eeg_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put('eeg', data['time'], data['eeg'])
+
+    def on_new_mot_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put('mot', data['time'], data['mot'])
+
+    def on_new_dev_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put('dev', data['time'], [data['signal'], data['batteryPercent']] + list(data['dev']))
+
+    def on_new_met_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put('met', data['time'], data['met'])
+
+    def on_new_pow_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put('pow', data['time'], data['pow'])
+
+    def on_new_com_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put('com', data['time'], [data['action'], data['power']])
+
+    def _put_batch(self, stream_name, times, values):
+        # one queue entry per batch; counted in samples
+        queue = self.queues[stream_name]
+        if len(queue) == self.queue_size:
+            oldest = queue[0][0]
+            self.dropped[stream_name] += len(oldest) if isinstance(oldest, np.ndarray) else 1
+        queue.append((times, values))
+        self.received[stream_name] += len(times)
+
+    def on_new_eeg_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put_batch('eeg', data['time'], data['eeg'])
+
+    def on_new_mot_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put_batch('mot', data['time'], data['mot'])
+
+    def on_new_dev_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put_batch('dev', data['time'], np.column_stack((data['signal'], data['batteryPercent'], data['dev'])))
+
+    def on_new_met_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put_batch('met', data['time'], data['met'])
+
+    def on_new_pow_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self._put_batch('pow', data['time'], data['pow'])
+
+    # aggregation, on the dashboard thread
+
+    def _drain(self, stream_name):
+        """(times, values) of every queued sample of a numeric stream, or None."""
+        queue = self.queues[stream_name]
+        chunks = []
+        singles = []
+        for _ in range(len(queue)):
+            sample_time, values = queue.popleft()
+            if isinstance(sample_time, np.ndarray):
+                if singles:
+                    chunks.append(self._stack(singles))
+                    singles = []
+                chunks.append((sample_time, np.asarray(values, dtype=np.float64)))
+            else:
+                singles.append((sample_time, values))
+        if singles:
+            chunks.append(self._stack(singles))
+        chunks = [chunk for chunk in chunks if chunk is not None]
+        if not chunks:
+            return None
+        # after a re-subscription the width can change; keep the samples of the newest shape
+        width = chunks[-1][1].shape[1]
+        chunks = [chunk for chunk in chunks if chunk[1].shape[1] == width]
+        return np.concatenate([chunk[0] for chunk in chunks]), np.concatenate([chunk[1] for chunk in chunks])
+
+    @staticmethod
+    def _stack(samples):
+        try:
+            values = np.array([sample[1] for sample in samples], dtype=np.float64)
+        except (TypeError, ValueError):
+            # rows of different widths
+            return None
+        if values.ndim != 2:
+            return None
+        return np.array([sample[0] for sample in samples], dtype=np.float64), values
+
+    def _envelope(self, times, values):
+        """Min/max of each points_per_second bucket, NaN ignored."""
+        bucket = np.floor(times * self.points_per_second).astype(np.int64)
+        starts = np.flatnonzero(np.concatenate(([True], bucket[1:] != bucket[:-1])))
+        return {
+            't': np.round(times[starts], 3).tolist(),
+            'min': _json_rows(np.fmin.reduceat(values, starts, axis=0)),
+            'max': _json_rows(np.fmax.reduceat(values, starts, axis=0)),
+        }
+
+    def build_frame(self):
+        """Frame dictionary of the samples received since the previous frame."""
+        streams = {}
+        for stream_name in NUMERIC_STREAMS:
+            drained = self._drain(stream_name)
+            if drained is None:
+                continue
+            times, values = drained
+            if stream_name in ENVELOPE_STREAMS and len(times) > 1:
+                streams[stream_name] = self._envelope(times, values)
+            else:
+                streams[stream_name] = {'t': np.round(times, 3).tolist(), 'v': _json_rows(values)}
+
+        queue = self.queues['com']
+        com = []
+        for _ in range(len(queue)):
+            sample_time, (action, power) = queue.popleft()
+            com.append([sample_time, action, power])
+
+        self.frames += 1
+        return {
+            'type': 'frame',
+            'seq': self.frames,
+            'time': time.time(),
+            'streams': streams,
+            'com': com,
+            'stats': {'received': dict(self.received), 'dropped': dict(self.dropped),
+                      'viewers': len(self.viewers)},
+        }
+
+    def _broadcast(self, message):
+        if not self.viewers:
+            return
+        self.bytes_sent += len(message) * len(self.viewers)
+        if hasattr(websockets, 'broadcast'):
+            # writes without waiting, so a slow viewer does not hold up the others
+            websockets.broadcast(self.viewers, message)
+            return
+        for websocket in list(self.viewers):
+            asyncio.ensure_future(self._send(websocket, message))
+
+    @staticmethod
+    async def _send(websocket, message):
+        try:
+            await websocket.send(message)
+        except websockets.exceptions.ConnectionClosed:
+            pass
+
+    def _labels_message(self):
+        return json.dumps({'type': 'labels', 'labels': self.labels, 'fps': self.fps,
+                           'history': self.history.maxlen / self.fps})
+
+    async def _frame_loop(self):
+        loop = asyncio.get_event_loop()
+        interval = 1.0 / self.fps
+        next_time = loop.time()
+        while True:
+            next_time += interval
+            delay = next_time - loop.time()
+            if delay < -interval:
+                # fell behind (suspended, overloaded): skip the missed frames
+                next_time = loop.time()
+                delay = 0.0
+            await asyncio.sleep(max(delay, 0.0))
+            if self.labels != self._labels_sent:
+                self._labels_sent = {name: list(labels) for name, labels in self.labels.items()}
+                self._broadcast(self._labels_message())
+            try:
+                message = json.dumps(self.build_frame(), separators=(',', ':'))
+            except Exception as e:
+                print('dashboard frame error: ' + str(e))
+                continue
+            self.history.append(message)
+            self._broadcast(message)
+
+    async def _handle(self, websocket, path=None):
+        try:
+            await websocket.send(self._labels_message())
+            for message in list(self.history):
+                await websocket.send(message)
+            self.viewers.add(websocket)
+            # viewers do not send anything; this returns when the page closes
+            async for _ in websocket:
+                pass
+        except websockets.exceptions.ConnectionClosed:
+            pass
+        finally:
+            self.viewers.discard(websocket)
+
+    # running
+
+    async def serve(self):
+        """Start the WebSocket server and the frame loop on the running event loop."""
+        await self._listen(self._handle)
+        self._frame_task = asyncio.ensure_future(self._frame_loop())
+        if self.http_port is not None:
+            self._start_http()
+        print('live dashboard on ' + self.url)
+
+    def _start_http(self):
+        with open(PAGE_PATH, 'rb') as f:
+            page = f.read().replace(b'{{WS_PORT}}', str(self.port).encode('ascii'))
+
+        class PageHandler(BaseHTTPRequestHandler):
+            def do_GET(self):
+                if self.path.split('?')[0] not in ('/', '/index.html'):
+                    self.send_error(404)
+                    return
+                self.send_response(200)
+                self.send_header('Content-Type', 'text/html; charset=utf-8')
+                self.send_header('Content-Length', str(len(page)))
+                self.end_headers()
+                self.wfile.write(page)
+
+            def log_message(self, *args):
+                pass
+
+        self._http_server = ThreadingHTTPServer((self.host, self.http_port), PageHandler)
+        self.http_port = self._http_server.server_port
+        threading.Thread(target=self._http_server.serve_forever, name='DashboardHttpThread', daemon=True).start()
+
+    async def _shutdown(self):
+        if self._frame_task is not None:
+            self._frame_task.cancel()
+        await super()._shutdown()
+        if self._http_server is not None:
+            self._http_server.shutdown()
+            self._http_server.server_close()
+            self._http_server = None
+
+    def get_stats(self):
+        return {'viewers': len(self.viewers), 'frames': self.frames, 'bytes_sent': self.bytes_sent,
+                'received': dict(self.received), 'dropped': dict(self.dropped)}
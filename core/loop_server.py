@@ -0,0 +1,79 @@
+import asyncio
+import threading
+
+try:
+    import websockets
+except ImportError:
+    websockets = None
+
+
+class LoopThreadServer:
+    """
+    WebSocket server run on its own event loop thread, shared by
+    MockCortexServer and LiveDashboard.
+
+    A subclass has host and port attributes, sets _server, _loop and
+    _thread to None, implements serve() (start listening on the running
+    loop, usually through _listen) and may extend _shutdown().
+    """
+
+    _thread_name = 'LoopThreadServer'
+    # seconds start() waits for serve() before giving up
+    start_timeout = 10.0
+
+    async def _listen(self, handler, **kwargs):
+        self._server = await websockets.serve(handler, self.host, self.port, **kwargs)
+        # port 0 picks a free port
+        self.port = self._server.sockets[0].getsockname()[1]
+
+    async def serve(self):
+        raise NotImplementedError
+
+    def start(self):
+        """
+        Run the server on its own event loop thread; returns once it listens.
+        Raises what serve() raised (e.g. OSError for a port in use), or
+        TimeoutError when it does not listen within start_timeout.
+        """
+        started = threading.Event()
+        failure = []
+        loop = asyncio.new_event_loop()
+
+        def run():
+            asyncio.set_event_loop(loop)
+            try:
+                loop.run_until_complete(self.serve())
+            except BaseException as e:
+                failure.append(e)
+                if self._server is not None:
+                    # e.g. the dashboard page port was taken after the socket listened
+                    loop.run_until_complete(self._shutdown())
+                return
+            finally:
+                started.set()
+            loop.run_forever()
+
+        self._thread = threading.Thread(target=run, name=self._thread_name, daemon=True)
+        self._thread.start()
+        if not started.wait(self.start_timeout):
+            loop.call_soon_threadsafe(loop.stop)
+            raise TimeoutError(self._thread_name + ' did not start listening within '
+                               + str(self.start_timeout) + ' s')
+        if failure:
+            self._thread.join()
+            loop.close()
+            raise failure[0]
+        self._loop = loop
+
+    def stop(self):
+        if self._loop is None:
+            return
+        asyncio.run_coroutine_threadsafe(self._shutdown(), self._loop).result()
+        self._loop.call_soon_threadsafe(self._loop.stop)
+        self._thread.join()
+        self._loop.close()
+        self._loop = None
+
+    async def _shutdown(self):
+        self._server.close()
+        await self._server.wait_closed()
@@ -0,0 +1,173 @@
+import numpy as np
+from pydispatch import Dispatcher
+
+from core.eeg_stream import StreamStage
+
+DETECTION_METHODS = ['cusum', 'page_hinkley']
+
+
+class MetStateDetector(StreamStage, Dispatcher):
+    """
+    Online change-point and anomaly detector for the Cortex met stream.
+
+    All metrics are tracked together as numpy vectors, so each sample costs
+    a fixed number of vector operations whatever the history length:
+    - the first warmup samples initialise the mean and variance (Welford),
+    - after that the baseline mean and variance follow an EWMA with
+      alpha = 2 / (span + 1),
+    - the standardised residual z = (x - mean) / std drives a two-sided
+      CUSUM (g+ = max(0, g+ + z - drift)) or Page-Hinkley test, which reports
+      a level shift once the accumulated deviation exceeds threshold,
+    - a single |z| above anomaly_threshold is reported as an anomaly.
+
+    After a shift the baseline jumps to the new value and the test restarts,
+    so each regime change is reported once. The .isActive flag columns of
+    the met stream are ignored, and metrics that Cortex sends as null
+    (inactive) are skipped for that sample.
+
+    met_state_change data:
+        {'time': sample time, 'metric': label, 'kind': 'shift' or 'anomaly',
+         'direction': 'up' or 'down', 'value': x, 'baseline': mean before the change,
+         'score': CUSUM/Page-Hinkley statistic or |z|}
+    """
+
+    _events_ = ['met_state_change']
+    _streams_ = ['met']
+
+    def __init__(self, method='cusum', warmup=20, span=60, drift=0.5, threshold=5.0,
+                 anomaly_threshold=4.0, min_std=1e-3):
+        if method not in DETECTION_METHODS:
+            raise ValueError('Unknown method ' + str(method) + '. Use one of ' + str(DETECTION_METHODS))
+        self.method = method
+        self.warmup = warmup
+        self.alpha = 2.0 / (span + 1.0)
+        self.drift = drift
+        self.threshold = threshold
+        self.anomaly_threshold = anomaly_threshold
+        self.min_std = min_std
+
+        self.labels = []
+        self.metric_index = None
+        self.metrics = []
+        self.changes = 0
+        self.anomalies = 0
+        self.n = None
+
+    def set_labels(self, labels):
+        self.labels = list(labels)
+        self.metric_index = np.array([i for i, label in enumerate(labels) if not str(label).endswith('.isActive')],
+                                     dtype=np.intp)
+        self.metrics = [labels[i] for i in self.metric_index]
+        self.reset()
+
+    def reset(self):
+        n_metrics = len(self.metrics)
+        self.n = np.zeros(n_metrics)
+        self.mean = np.zeros(n_metrics)
+        self.m2 = np.zeros(n_metrics)      # Welford sum of squares during warmup
+        self.var = np.zeros(n_metrics)
+        self.g_up = np.zeros(n_metrics)
+        self.g_down = np.zeros(n_metrics)
+        # Page-Hinkley running sums and their extremes
+        self.ph_up = np.zeros(n_metrics)
+        self.ph_up_min = np.zeros(n_metrics)
+        self.ph_down = np.zeros(n_metrics)
+        self.ph_down_min = np.zeros(n_metrics)
+
+    def on_new_data_labels(self, *args, **kwargs):
+        data = kwargs.get('data')
+        if data['streamName'] == 'met':
+            self.set_labels(data['labels'])
+
+    def on_new_met_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.update(data['met'], data['time'])
+
+    def on_new_met_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        for row, timestamp in zip(data['met'], data['time']):
+            self.update(row, timestamp)
+
+    def update(self, values, timestamp=None):
+        """Feed one met sample (laid out as the met labels). Returns the list of changes it triggered."""
+        if self.metric_index is None:
+            self.set_labels(['met{0}'.format(i) for i in range(len(values))])
+        x = np.array([np.nan if values[i] is None else values[i] for i in self.metric_index], dtype=np.float64)
+        valid = ~np.isnan(x)
+
+        warming = valid & (self.n < self.warmup)
+        if warming.any():
+            # Welford
+            self.n[warming] += 1
+            delta = x[warming] - self.mean[warming]
+            self.mean[warming] += delta / self.n[warming]
+            self.m2[warming] += delta * (x[warming] - self.mean[warming])
+            self.var[warming] = self.m2[warming] / np.maximum(self.n[warming] - 1, 1)
+
+        active = valid & ~warming
+        if not active.any():
+            return []
+
+        std = np.sqrt(np.maximum(self.var, self.min_std ** 2))
+        z = np.where(active, (np.where(valid, x, 0.0) - self.mean) / std, 0.0)
+
+        if self.method == 'cusum':
+            self.g_up = np.where(active, np.maximum(0.0, self.g_up + z - self.drift), self.g_up)
+            self.g_down = np.where(active, np.maximum(0.0, self.g_down - z - self.drift), self.g_down)
+            score_up, score_down = self.g_up, self.g_down
+        else:
+            self.ph_up = np.where(active, self.ph_up + z - self.drift, self.ph_up)
+            self.ph_down = np.where(active, self.ph_down - z - self.drift, self.ph_down)
+            self.ph_up_min = np.minimum(self.ph_up_min, self.ph_up)
+            self.ph_down_min = np.minimum(self.ph_down_min, self.ph_down)
+            score_up = self.ph_up - self.ph_up_min
+            score_down = self.ph_down - self.ph_down_min
+
+        shift_up = active & (score_up > self.threshold)
+        shift_down = active & (score_down > self.threshold) & ~shift_up
+        shifted = shift_up | shift_down
+        anomaly = active & ~shifted & (np.abs(z) > self.anomaly_threshold)
+
+        events = []
+        if shifted.any() or anomaly.any():
+            for i in np.flatnonzero(shifted | anomaly):
+                event = {
+                    'time': timestamp,
+                    'metric': self.metrics[i],
+                    'kind': 'shift' if shifted[i] else 'anomaly',
+                    'direction': 'up' if (shift_up[i] or (anomaly[i] and z[i] > 0)) else 'down',
+                    'value': float(x[i]),
+                    'baseline': float(self.mean[i]),
+                    'score': float(score_up[i] if shift_up[i] else score_down[i] if shift_down[i] else abs(z[i])),
+                }
+                events.append(event)
+            self.changes += int(shifted.sum())
+            self.anomalies += int(anomaly.sum())
+
+        # EWMA baseline; anomalies are left out so a single spike does not move it
+        learn = active & ~anomaly
+        diff = np.where(learn, x - self.mean, 0.0)
+        incr = self.alpha * diff
+        self.mean += incr
+        self.var = np.where(learn, (1 - self.alpha) * (self.var + diff * incr), self.var)
+
+        if shifted.any():
+            # restart the test from the new level
+            self.mean[shifted] = x[shifted]
+            self.g_up[shifted] = 0.0
+            self.g_down[shifted] = 0.0
+            self.ph_up[shifted] = 0.0
+            self.ph_up_min[shifted] = 0.0
+            self.ph_down[shifted] = 0.0
+            self.ph_down_min[shifted] = 0.0
+
+        for event in events:
+            self.emit('met_state_change', data=event)
+        return events
+
+    def get_baseline(self):
+        """Current baseline mean and std per metric."""
+        if self.metric_index is None:
+            return {}
+        std = np.sqrt(self.var)
+        return {metric: (float(self.mean[i]), float(std[i])) for i, metric in enumerate(self.metrics)}
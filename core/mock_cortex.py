@@ -0,0 +1,564 @@
+"""
+Local stand-in for the Cortex service, for load tests and for reproducing
+field sessions without a headset.
+
+MockCortexServer speaks the JSON-RPC calls used by core.cortex.Cortex and
+core.async_cortex.AsyncCortex (access right, authorize, headsets, sessions,
+subscribe, profiles, training, records and markers) over a plain ws://
+socket, or wss:// with a certificate. Subscribed streams are served from a
+source:
+- SyntheticSession (core.synthetic_stream): generated data at any rate and
+  channel count,
+- RecordedSession: a session saved by DataCollector (csv, npy or ezs files).
+
+Streams are sent at speed x real time (speed=None sends as fast as the
+client reads). Sample timestamps keep the spacing of the source and start
+at the subscribe time, so at speed > 1 they run ahead of the wall clock.
+
+    server = MockCortexServer(RecordedSession('collected_data'), speed=10)
+    server.start()                       # background thread
+    cortex = Cortex(client_id, client_secret, url=server.url)
+
+Clients pick it up without code changes through the environment:
+    CORTEX_URL=ws://localhost:6868 python scripts/sub_data.py
+
+Requires the websockets package.
+"""
+import os
+import re
+import csv
+import json
+import time
+import uuid
+import asyncio
+from datetime import datetime, timezone
+
+try:
+    import websockets
+except ImportError:
+    websockets = None
+
+from core.loop_server import LoopThreadServer
+from core.synthetic_stream import SyntheticSession
+from core.session_format import load_npy_stream, CompressedStreamReader
+
+# error codes returned by the mock, as documented for Cortex
+ERR_PARSE = -32700
+ERR_METHOD_NOT_FOUND = -32601
+ERR_INVALID_PARAMS = -32602
+ERR_HEADSET_UNAVAILABLE = -32004
+ERR_SESSION_NOT_FOUND = -32005
+ERR_INVALID_TOKEN = -32014
+ERR_STREAM_UNAVAILABLE = -32016
+
+# warning codes, see core.cortex
+WARN_CORTEX_STOP_ALL_STREAMS = 0
+WARN_HEADSET_CONNECTED = 104
+
+STREAM_FILE_PATTERN = re.compile(r'^data_([a-z]+)_(\d{8}_\d{6})\.(csv|npy|ezs)$')
+# leading file columns before the labelled values, see core.data_collector.STREAM_HEAD_COLUMNS
+FILE_HEAD_COLUMNS = {'dev': ['timestamp', 'signal', 'batteryPercent']}
+# com and fac files have no labels; these are the subscribe cols of Cortex
+STREAM_COLS = {'com': ['act', 'pow'], 'fac': ['eyeAct', 'uAct', 'uPow', 'lAct', 'lPow']}
+TRAINING_PREFIX = {'mentalCommand': 'MC', 'facialExpression': 'FE'}
+
+
+class RecordedSession:
+    """
+    A session saved by DataCollector, read back as Cortex stream messages.
+
+    directory holds data_{stream}_{timestamp}.csv/.npy/.ezs files; timestamp picks
+    the session when there are several (default: the newest). Gap marker
+    rows written after a reconnect are skipped.
+    """
+
+    def __init__(self, directory, timestamp=None, session_id='recorded-session'):
+        self.directory = directory
+        self.session_id = session_id
+        files = {}
+        for name in sorted(os.listdir(directory)):
+            match = STREAM_FILE_PATTERN.match(name)
+            if match:
+                files.setdefault(match.group(2), {})[match.group(1)] = os.path.join(directory, name)
+        if not files:
+            raise ValueError('No collected session files in ' + str(directory))
+        self.timestamp = timestamp or max(files)
+        if self.timestamp not in files:
+            raise ValueError('No session ' + str(self.timestamp) + ' in ' + str(directory))
+        self.files = files[self.timestamp]
+
+        self.labels = {}
+        self.samples = {}
+        self.rates = {}
+        for stream_name, path in self.files.items():
+            if stream_name == 'sys':
+                continue
+            header, rows = self._read(path)
+            head = FILE_HEAD_COLUMNS.get(stream_name, ['timestamp'])
+            self.labels[stream_name] = header[len(head):]
+            samples = [self._message_values(stream_name, header, row) for row in rows
+                       if not _is_gap_row(row, len(head))]
+            self.samples[stream_name] = [sample for sample in samples if sample[0] is not None]
+            times = [t for t, _ in self.samples[stream_name]]
+            if len(times) > 1 and times[-1] > times[0]:
+                self.rates[stream_name] = (len(times) - 1) / (times[-1] - times[0])
+            else:
+                self.rates[stream_name] = 1.0
+
+    @staticmethod
+    def _read(path):
+        if path.endswith('.npy'):
+            records, _ = load_npy_stream(path)
+            return list(records.dtype.names), [list(record) for record in records.tolist()]
+        if path.endswith('.ezs'):
+            reader = CompressedStreamReader(path)
+            times, values = reader.read()
+            return reader.columns, [[t] + row for t, row in zip(times.tolist(), values.tolist())]
+        with open(path, newline='') as f:
+            reader = csv.reader(f)
+            header = next(reader, [])
+            return header, [[_parse_cell(cell) for cell in row] for row in reader]
+
+    def _message_values(self, stream_name, header, row):
+        """(time, values) with values laid out as in a Cortex stream message."""
+        timestamp = row[0]
+        if stream_name == 'dev':
+            signal, battery_percent = row[1], row[2]
+            battery = None if battery_percent is None else min(4, int(battery_percent // 25))
+            return timestamp, [battery, signal, row[3:], battery_percent]
+        values = row[1:]
+        if stream_name == 'eeg':
+            # MARKERS, popped by the client
+            return timestamp, values + [[]]
+        if stream_name == 'met':
+            labels = header[1:]
+            values = [bool(v) if str(label).endswith('.isActive') and v is not None else v
+                      for label, v in zip(labels, values)]
+        return timestamp, values
+
+    def columns(self, stream_name):
+        """The 'cols' of a stream as returned by a Cortex subscribe request."""
+        labels = list(self.labels[stream_name])
+        if stream_name == 'eeg':
+            return labels + ['MARKERS']
+        if stream_name == 'dev':
+            return ['Battery', 'Signal', labels, 'BatteryPercent']
+        if stream_name in STREAM_COLS:
+            return list(STREAM_COLS[stream_name])
+        return labels
+
+    def subscribe_result(self, streams):
+        success = [{'streamName': s, 'cols': self.columns(s), 'sid': self.session_id}
+                   for s in streams if s in self.samples]
+        failure = [{'streamName': s, 'code': ERR_STREAM_UNAVAILABLE, 'message': 'Stream was not recorded'}
+                   for s in streams if s not in self.samples]
+        return {'success': success, 'failure': failure}
+
+    def messages(self, duration=None, streams=None):
+        """Stream messages in time order, optionally only the first duration seconds."""
+        streams = [s for s in (streams or list(self.samples)) if s in self.samples]
+        start = min((self.samples[s][0][0] for s in streams if self.samples[s]), default=0.0)
+        per_stream = [[(t, i, s, values) for i, (t, values) in enumerate(self.samples[s])
+                       if duration is None or t - start < duration] for s in streams]
+        merged = sorted((item for items in per_stream for item in items), key=lambda item: (item[0], item[1]))
+        for t, _, stream_name, values in merged:
+            yield {stream_name: list(values), 'sid': self.session_id, 'time': t}
+
+
+def _parse_cell(cell):
+    if cell == '' or cell.lower() == 'nan':
+        return None
+    try:
+        return float(cell)
+    except ValueError:
+        return cell
+
+
+def _is_gap_row(row, head_width):
+    """StreamBuffer.mark_gap rows: a timestamp followed by NaN (or empty) values only."""
+    return all(v is None or (isinstance(v, float) and v != v) for v in row[head_width:])
+
+
+def _nan_to_none(values):
+    return [None if isinstance(v, float) and v != v else v for v in values]
+
+
+class RpcError(Exception):
+
+    def __init__(self, code, message):
+        super().__init__(message)
+        self.code = code
+        self.message = message
+
+
+class MockCortexServer(LoopThreadServer):
+    """
+    JSON-RPC server with the behaviour of the Cortex service that the
+    clients rely on. Tokens and sessions live on the server, not on a
+    connection, so a client can reconnect and resume its session;
+    drop_connections() and revoke_tokens() exercise those paths.
+    """
+
+    _thread_name = 'MockCortexServer'
+
+    def __init__(self, source=None, host='localhost', port=6868, speed=1.0, loop=False, duration=3600.0,
+                 headset_id='INSIGHT-MOCK0001', connect_delay=0.2, ssl_context=None):
+        if websockets is None:
+            raise RuntimeError('MockCortexServer requires the websockets package (pip install websockets)')
+        self.source = source or SyntheticSession()
+        self.host = host
+        self.port = port
+        self.speed = speed
+        self.loop = loop
+        # length of each pass over a SyntheticSession, which has no end of its own
+        self.duration = duration
+        self.connect_delay = connect_delay
+        self.ssl_context = ssl_context
+        self.headsets = {headset_id: 'discovered'}
+        self.tokens = set()
+        self.sessions = {}
+        self.profiles = {'mock-profile': False}
+        self.loaded_profile = None
+        self.records = {}
+        self.connections = set()
+        self.messages_sent = {}
+        self._tasks = {}
+        self._server = None
+        self._loop = None
+        self._thread = None
+
+    @property
+    def url(self):
+        return '{0}://{1}:{2}'.format('wss' if self.ssl_context else 'ws', self.host, self.port)
+
+    # running
+
+    async def serve(self):
+        """Start listening on the running event loop."""
+        await self._listen(self._handle, ssl=self.ssl_context, max_size=None)
+        print('mock Cortex listening on ' + self.url)
+
+    async def serve_forever(self):
+        await self.serve()
+        await asyncio.Future()
+
+    async def _shutdown(self):
+        for task in list(self._tasks.values()):
+            task.cancel()
+        await super()._shutdown()
+
+    def drop_connections(self):
+        """Close every client socket, keeping tokens and sessions (reconnect testing)."""
+        asyncio.run_coroutine_threadsafe(self._drop_connections(), self._loop).result()
+
+    async def _drop_connections(self):
+        for websocket in list(self.connections):
+            await websocket.close()
+
+    def revoke_tokens(self):
+        """Reject every issued token, so clients have to authorize again."""
+        self.tokens.clear()
+
+    def get_stats(self):
+        return {'connections': len(self.connections), 'sessions': len(self.sessions),
+                'streams': len(self._tasks), 'messages_sent': dict(self.messages_sent)}
+
+    # protocol
+
+    async def _handle(self, websocket, path=None):
+        self.connections.add(websocket)
+        try:
+            async for text in websocket:
+                try:
+                    request = json.loads(text)
+                except ValueError:
+                    await websocket.send(json.dumps({'jsonrpc': '2.0', 'id': None,
+                                                     'error': {'code': ERR_PARSE, 'message': 'Parse error'}}))
+                    continue
+                response = {'jsonrpc': '2.0', 'id': request.get('id')}
+                try:
+                    response['result'] = await self._call(websocket, request.get('method'),
+                                                          request.get('params') or {})
+                except RpcError as e:
+                    response['error'] = {'code': e.code, 'message': e.message}
+                await websocket.send(json.dumps(response))
+        except websockets.exceptions.ConnectionClosed:
+            pass
+        finally:
+            self.connections.discard(websocket)
+            for key in [key for key in self._tasks if key[0] is websocket]:
+                self._tasks.pop(key).cancel()
+
+    async def _call(self, websocket, method, params):
+        handler = getattr(self, 'rpc_' + str(method), None)
+        if handler is None:
+            raise RpcError(ERR_METHOD_NOT_FOUND, 'Method not found: ' + str(method))
+        return await handler(websocket, params)
+
+    def _check_token(self, params):
+        if params.get('cortexToken') not in self.tokens:
+            raise RpcError(ERR_INVALID_TOKEN, 'The access token is invalid.')
+
+    def _session(self, params):
+        self._check_token(params)
+        session = self.sessions.get(params.get('session'))
+        if session is None or session['status'] == 'closed':
+            raise RpcError(ERR_SESSION_NOT_FOUND, 'The session does not exist.')
+        return session
+
+    async def _send_warning(self, websocket, code, message):
+        try:
+            await websocket.send(json.dumps({'warning': {'code': code, 'message': message}}))
+        except websockets.exceptions.ConnectionClosed:
+            pass
+
+    async def rpc_getCortexInfo(self, websocket, params):
+        return {'buildDate': '', 'buildNumber': 'mock', 'version': 'mock'}
+
+    async def rpc_hasAccessRight(self, websocket, params):
+        return {'accessGranted': True, 'message': 'The User has granted access right to this application.'}
+
+    async def rpc_requestAccess(self, websocket, params):
+        return {'accessGranted': True, 'message': 'The access right to this application is granted.'}
+
+    async def rpc_authorize(self, websocket, params):
+        token = 'mock-token-' + uuid.uuid4().hex
+        self.tokens.add(token)
+        return {'cortexToken': token}
+
+    async def rpc_queryHeadsets(self, websocket, params):
+        eeg_rate = int(round(getattr(self.source, 'rates', {}).get('eeg', 128)))
+        return [{'id': headset_id, 'status': status, 'connectedBy': 'dongle', 'customName': '',
+                 'sensors': list(getattr(self.source, 'channels', [])), 'settings': {'eegRate': eeg_rate}}
+                for headset_id, status in self.headsets.items()
+                if not params.get('id') or params['id'] == headset_id]
+
+    async def rpc_controlDevice(self, websocket, params):
+        command = params.get('command')
+        if command == 'refresh':
+            return {'command': 'refresh', 'message': 'Refreshing the headset list.'}
+        headset_id = params.get('headset')
+        if headset_id not in self.headsets:
+            raise RpcError(ERR_HEADSET_UNAVAILABLE, 'The headset ' + str(headset_id) + ' is not available.')
+        if command == 'connect':
+            self.headsets[headset_id] = 'connecting'
+
+            async def connected():
+                await asyncio.sleep(self.connect_delay)
+                self.headsets[headset_id] = 'connected'
+                await self._send_warning(websocket, WARN_HEADSET_CONNECTED,
+                                         {'behavior': 'Headset connected', 'headsetId': headset_id})
+
+            asyncio.ensure_future(connected())
+            return {'command': 'connect', 'message': 'Start connecting to the headset ' + headset_id}
+        if command == 'disconnect':
+            self.headsets[headset_id] = 'discovered'
+            return {'command': 'disconnect', 'message': 'Disconnected the headset ' + headset_id}
+        raise RpcError(ERR_INVALID_PARAMS, 'Unknown controlDevice command ' + str(command))
+
+    async def rpc_createSession(self, websocket, params):
+        self._check_token(params)
+        headset_id = params.get('headset') or next(iter(self.headsets))
+        if self.headsets.get(headset_id) != 'connected':
+            raise RpcError(ERR_HEADSET_UNAVAILABLE, 'The headset ' + str(headset_id) + ' is not connected.')
+        session = {'id': str(uuid.uuid4()), 'status': 'activated', 'headset': {'id': headset_id},
+                   'owner': 'mock', 'started': _iso_now(), 'stopped': None, 'streams': [],
+                   'token': params['cortexToken']}
+        self.sessions[session['id']] = session
+        return _public(session)
+
+    async def rpc_updateSession(self, websocket, params):
+        session = self._session(params)
+        if params.get('status') == 'close':
+            session['status'] = 'closed'
+            session['stopped'] = _iso_now()
+            for key in [key for key in self._tasks if key[1] == session['id']]:
+                self._tasks.pop(key).cancel()
+            session['streams'] = []
+        return _public(session)
+
+    async def rpc_querySessions(self, websocket, params):
+        self._check_token(params)
+        return [_public(session) for session in self.sessions.values()]
+
+    async def rpc_subscribe(self, websocket, params):
+        session = self._session(params)
+        streams = list(params.get('streams') or [])
+        result = self.source.subscribe_result(streams)
+        for stream in result['success']:
+            stream['sid'] = session['id']
+            stream_name = stream['streamName']
+            key = (websocket, session['id'], stream_name)
+            if key not in self._tasks:
+                self._tasks[key] = asyncio.ensure_future(self._stream(websocket, session['id'], stream_name))
+            if stream_name not in session['streams']:
+                session['streams'].append(stream_name)
+        return result
+
+    async def rpc_unsubscribe(self, websocket, params):
+        session = self._session(params)
+        success = []
+        for stream_name in params.get('streams') or []:
+            task = self._tasks.pop((websocket, session['id'], stream_name), None)
+            if task is not None:
+                task.cancel()
+            if stream_name in session['streams']:
+                session['streams'].remove(stream_name)
+            success.append({'streamName': stream_name, 'message': 'Unsubscribe successfully'})
+        return {'success': success, 'failure': []}
+
+    async def rpc_queryProfile(self, websocket, params):
+        self._check_token(params)
+        return [{'name': name, 'readOnly': read_only} for name, read_only in self.profiles.items()]
+
+    async def rpc_getCurrentProfile(self, websocket, params):
+        self._check_token(params)
+        return {'name': self.loaded_profile, 'loadedByThisApp': self.loaded_profile is not None}
+
+    async def rpc_setupProfile(self, websocket, params):
+        self._check_token(params)
+        action = params.get('status')
+        name = params.get('profile')
+        if action == 'create':
+            self.profiles[name] = False
+        elif action == 'load':
+            self.loaded_profile = name
+        elif action == 'unload':
+            self.loaded_profile = None
+        elif action == 'delete':
+            self.profiles.pop(name, None)
+        return {'action': action, 'name': name, 'message': 'Profile ' + str(action) + ' successfully'}
+
+    async def rpc_training(self, websocket, params):
+        session = self._session(params)
+        detection = params.get('detection', 'mentalCommand')
+        status = params.get('status')
+        prefix = TRAINING_PREFIX.get(detection, 'MC')
+        events = {'start': ['Started', 'Succeeded'], 'accept': ['Completed'], 'reject': ['Rejected'],
+                  'reset': ['Reset'], 'erase': ['DataErased']}.get(status, [])
+        if events and 'sys' in session['streams']:
+            async def report():
+                for i, event in enumerate(events):
+                    if i:
+                        # the real training takes 8 seconds
+                        await asyncio.sleep(8.0 / (self.speed or 8.0))
+                    await self._send_stream(websocket, 'sys', {'sys': [detection, prefix + '_' + event],
+                                                               'sid': session['id'], 'time': time.time()})
+
+            asyncio.ensure_future(report())
+        return {'action': status, 'message': 'Set up training successfully'}
+
+    async def rpc_createRecord(self, websocket, params):
+        session = self._session(params)
+        record = {'uuid': str(uuid.uuid4()), 'title': params.get('title', ''), 'startDatetime': _iso_now(),
+                  'sessionId': session['id']}
+        self.records[record['uuid']] = record
+        session['record'] = record['uuid']
+        return {'record': record, 'sessionId': session['id']}
+
+    async def rpc_stopRecord(self, websocket, params):
+        session = self._session(params)
+        record = self.records.get(session.pop('record', None))
+        if record is None:
+            raise RpcError(ERR_INVALID_PARAMS, 'There is no record in progress.')
+        record['endDatetime'] = _iso_now()
+        return {'record': record, 'sessionId': session['id']}
+
+    async def rpc_exportRecord(self, websocket, params):
+        self._check_token(params)
+        record_ids = params.get('recordIds') or []
+        return {'success': [{'recordId': r} for r in record_ids if r in self.records],
+                'failure': [{'recordId': r, 'message': 'Record not found'} for r in record_ids
+                            if r not in self.records]}
+
+    async def rpc_injectMarker(self, websocket, params):
+        session = self._session(params)
+        marker = {'uuid': str(uuid.uuid4()), 'label': params.get('label'), 'value': params.get('value'),
+                  'port': params.get('port', ''), 'startDatetime': _iso_time(params.get('time')),
+                  'type': 'instance', 'recordId': session.get('record')}
+        return {'marker': marker}
+
+    async def rpc_updateMarker(self, websocket, params):
+        self._session(params)
+        return {'marker': {'uuid': params.get('markerId'), 'endDatetime': _iso_time(params.get('time')),
+                           'type': 'interval'}}
+
+    async def rpc_mentalCommandActiveAction(self, websocket, params):
+        self._check_token(params)
+        if params.get('status') == 'set':
+            return {'action': 'set', 'message': 'Set active actions successfully'}
+        return ['neutral', 'push', 'pull']
+
+    async def rpc_mentalCommandBrainMap(self, websocket, params):
+        self._check_token(params)
+        return [{'action': action, 'coordinates': [0.0, 0.0]} for action in ('neutral', 'push', 'pull')]
+
+    async def rpc_mentalCommandTrainingThreshold(self, websocket, params):
+        self._check_token(params)
+        return {'currentThreshold': 0.5, 'lastTrainingScore': 0.6}
+
+    async def rpc_mentalCommandActionSensitivity(self, websocket, params):
+        self._check_token(params)
+        if params.get('status') == 'set':
+            return 'success'
+        return [5, 5, 5, 5]
+
+    # streaming
+
+    def _source_messages(self, stream_name):
+        if isinstance(self.source, SyntheticSession):
+            return self.source.messages(self.duration, [stream_name])
+        return self.source.messages(None, [stream_name])
+
+    async def _send_stream(self, websocket, stream_name, message):
+        await websocket.send(json.dumps(message))
+        self.messages_sent[stream_name] = self.messages_sent.get(stream_name, 0) + 1
+
+    async def _stream(self, websocket, session_id, stream_name):
+        """Pace one stream of the source to one subscriber."""
+        wall_start = time.monotonic()
+        stream_start = time.time()
+        time_offset = None
+        first = None
+        try:
+            while True:
+                last = prev = None
+                for i, message in enumerate(self._source_messages(stream_name)):
+                    t = message['time']
+                    if first is None:
+                        first = t
+                        time_offset = stream_start - t
+                    message['sid'] = session_id
+                    message['time'] = t + time_offset
+                    message[stream_name] = _nan_to_none(message[stream_name])
+                    if self.speed:
+                        delay = wall_start + (message['time'] - stream_start) / self.speed - time.monotonic()
+                        if delay > 0:
+                            await asyncio.sleep(delay)
+                    elif i % 64 == 0:
+                        # let other streams and requests through at full speed
+                        await asyncio.sleep(0)
+                    await self._send_stream(websocket, stream_name, message)
+                    prev, last = last, t
+                if not self.loop or last is None:
+                    return
+                # next pass continues the timeline one sample period later
+                time_offset += last - first + (last - prev if prev is not None else 1.0)
+        except websockets.exceptions.ConnectionClosed:
+            pass
+
+
+def _public(session):
+    return {key: value for key, value in session.items() if key not in ('token', 'record')}
+
+
+def _iso_now():
+    return datetime.now(timezone.utc).isoformat()
+
+
+def _iso_time(timestamp):
+    if timestamp is None:
+        return _iso_now()
+    # markers are sent with epoch milliseconds
+    seconds = timestamp / 1000.0 if timestamp > 1e11 else timestamp
+    return datetime.fromtimestamp(seconds, timezone.utc).isoformat()
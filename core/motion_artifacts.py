@@ -0,0 +1,361 @@
+import collections
+import numpy as np
+from pydispatch import Dispatcher
+
+from core.eeg_stream import StreamStage, channel_indices
+
+REJECTION_MODES = ['mask', 'regress']
+QUATERNION_LABELS = ['Q0', 'Q1', 'Q2', 'Q3']
+ACCELEROMETER_LABELS = ['ACCX', 'ACCY', 'ACCZ']
+# columns of the motion reference that EEG is regressed on
+REFERENCE_LABELS = ACCELEROMETER_LABELS + ['angular_speed']
+
+
+# Vectorized kernels, shared by the live filter below and the batch rejector
+# of data_analysis/artifact_rejection.py.
+
+def motion_features(times, q, acc, previous=None):
+    """
+    Movement features of a block of motion samples.
+
+    Args:
+        times: (n,) sample times in seconds
+        q: (n, 4) quaternions Q0..Q3
+        acc: (n, 3) accelerometer ACCX..ACCZ
+        previous: (time, q row, acc row) of the sample before the block, for
+                  blocks of a live stream; None starts the differences at 0
+
+    Returns:
+        angular_speed: (n,) rotation between consecutive samples in deg/s
+        jerk: (n,) change of the acceleration magnitude per second
+        reference: (n, 4) regression reference ACCX, ACCY, ACCZ, angular_speed
+    """
+    times = np.asarray(times, dtype=np.float64)
+    q = np.asarray(q, dtype=np.float64)
+    acc = np.asarray(acc, dtype=np.float64)
+    if previous is not None:
+        t_all = np.concatenate(([previous[0]], times))
+        q_all = np.vstack((previous[1][None, :], q))
+        acc_all = np.vstack((previous[2][None, :], acc))
+    else:
+        t_all, q_all, acc_all = times, q, acc
+
+    norms = np.linalg.norm(q_all, axis=1)
+    with np.errstate(divide='ignore', invalid='ignore'):
+        cos_half = np.abs(np.sum(q_all[1:] * q_all[:-1], axis=1)) / (norms[1:] * norms[:-1])
+    angle = 2.0 * np.degrees(np.arccos(np.clip(np.nan_to_num(cos_half, nan=1.0), -1.0, 1.0)))
+    magnitude = np.linalg.norm(acc_all, axis=1)
+    dt = np.diff(t_all)
+    with np.errstate(divide='ignore', invalid='ignore'):
+        angular_speed = np.where(dt > 0, angle / dt, 0.0)
+        jerk = np.where(dt > 0, np.abs(np.diff(magnitude)) / dt, 0.0)
+    if previous is None:
+        angular_speed = np.concatenate(([0.0], angular_speed))
+        jerk = np.concatenate(([0.0], jerk))
+    reference = np.column_stack((acc, angular_speed))
+    return angular_speed, jerk, reference
+
+
+def flag_windows(times, flags, pad_before, pad_after):
+    """
+    Merge flagged samples into contaminated windows.
+
+    Every flagged sample contaminates [t - pad_before, t + pad_after];
+    overlapping windows are merged.
+
+    Returns:
+        (starts, ends) arrays of the merged windows, in time order
+    """
+    t = np.asarray(times, dtype=np.float64)[np.asarray(flags, dtype=bool)]
+    if len(t) == 0:
+        return np.empty(0), np.empty(0)
+    starts = t - pad_before
+    ends = t + pad_after
+    new = np.concatenate(([True], starts[1:] > ends[:-1]))
+    last = np.concatenate((new[1:], [True]))
+    return starts[new], ends[last]
+
+
+def window_mask(times, starts, ends):
+    """Boolean mask of the times inside any of the sorted, non-overlapping windows."""
+    times = np.asarray(times, dtype=np.float64)
+    if len(starts) == 0:
+        return np.zeros(len(times), dtype=bool)
+    i = np.searchsorted(starts, times, side='right') - 1
+    return (i >= 0) & (times <= np.asarray(ends)[np.maximum(i, 0)])
+
+
+def regression_weights(cov_rr, cov_rx, ridge=1e-3):
+    """Least-squares weights of the reference for each channel, with a small ridge."""
+    k = len(cov_rr)
+    scale = np.trace(cov_rr) / k if k else 0.0
+    return np.linalg.solve(cov_rr + (ridge * scale + 1e-12) * np.eye(k), cov_rx)
+
+
+def fit_regression(reference, eeg, ridge=1e-3):
+    """
+    Fit the motion-explained part of every EEG channel.
+
+    Args:
+        reference: (n, k) motion reference (see motion_features)
+        eeg: (n, channels) EEG samples
+
+    Returns:
+        (weights (k, channels), reference mean (k,))
+    """
+    reference_mean = reference.mean(axis=0)
+    r = reference - reference_mean
+    x = eeg - eeg.mean(axis=0)
+    n = max(len(r), 1)
+    return regression_weights(r.T @ r / n, r.T @ x / n, ridge), reference_mean
+
+
+def regress_out(eeg, reference, weights, reference_mean):
+    """EEG minus its motion-explained part."""
+    return eeg - (reference - reference_mean) @ weights
+
+
+class MotionArtifactFilter(StreamStage, Dispatcher):
+    """
+    Live motion-artifact rejection stage between the Cortex eeg stream and
+    downstream processing.
+
+    Every mot sample whose rotation speed exceeds angular_speed_threshold
+    (deg/s) or whose acceleration magnitude changes faster than
+    jerk_threshold (per second) contaminates the EEG from pad_before
+    seconds before it to pad_after seconds after it. EEG is held back until
+    the motion data covering pad_before after it has arrived (or max_delay
+    has passed without motion data), so the output lags the input by about
+    pad_before. Released EEG is then
+    - 'mask': emitted without the contaminated samples, so downstream stages
+      only process clean data,
+    - 'regress': emitted in full, with the part of the electrode channels
+      explained by the motion reference (accelerometer and rotation speed,
+      interpolated to the EEG times) subtracted in contaminated windows. The
+      weights come from exponentially weighted covariances over span_seconds.
+
+    new_clean_eeg data has the layout of new_eeg_batch, so EEGStreamProcessor
+    and SignalQualityMonitor can take it as their input:
+        {'time': (n,) array, 'eeg': (n, n_values) array,
+         'contaminated': (n,) bool, True for regressed samples}
+
+    motion_artifact data, once a window is final:
+        {'start': time, 'end': time, 'peak_angular_speed': deg/s, 'peak_jerk': per second}
+    """
+
+    _events_ = ['new_clean_eeg', 'motion_artifact']
+    _streams_ = ['mot', 'eeg']
+
+    def __init__(self, mode='mask', pad_before=0.25, pad_after=0.5, angular_speed_threshold=30.0,
+                 jerk_threshold=2.0, max_delay=1.0, sampling_rate=128.0, span_seconds=30.0, ridge=1e-3):
+        if mode not in REJECTION_MODES:
+            raise ValueError('Unknown mode ' + str(mode) + '. Use one of ' + str(REJECTION_MODES))
+        self.mode = mode
+        self.pad_before = pad_before
+        self.pad_after = pad_after
+        self.angular_speed_threshold = angular_speed_threshold
+        self.jerk_threshold = jerk_threshold
+        self.max_delay = max_delay
+        self.alpha = 1.0 / (span_seconds * sampling_rate)
+        self.ridge = ridge
+
+        self.channel_index = None
+        self.quaternion_index = None
+        self.accelerometer_index = None
+        self.samples_in = 0
+        self.samples_rejected = 0
+        self.samples_regressed = 0
+        self.artifacts = 0
+        self.reset()
+
+    def reset(self):
+        self.pending = []
+        self.windows = collections.deque()
+        self.open_window = None
+        self.previous_mot = None
+        self.last_mot_time = None
+        self.reference_history = collections.deque()
+        self.moments = None
+
+    def set_labels(self, labels):
+        self.channel_index = channel_indices(labels)
+        self.pending = []
+        self.moments = None
+
+    def set_mot_labels(self, labels):
+        labels = list(labels)
+        if all(label in labels for label in QUATERNION_LABELS + ACCELEROMETER_LABELS):
+            self.quaternion_index = np.array([labels.index(label) for label in QUATERNION_LABELS])
+            self.accelerometer_index = np.array([labels.index(label) for label in ACCELEROMETER_LABELS])
+        else:
+            print('motion artifact filter: no quaternion/accelerometer columns in ' + str(labels))
+            self.quaternion_index = None
+            self.accelerometer_index = None
+        self.previous_mot = None
+
+    def on_new_data_labels(self, *args, **kwargs):
+        data = kwargs.get('data')
+        if data['streamName'] == 'eeg':
+            self.set_labels(data['labels'])
+        elif data['streamName'] == 'mot':
+            self.set_mot_labels(data['labels'])
+
+    def on_new_mot_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process_mot(np.array([data['time']], dtype=np.float64),
+                         np.asarray(data['mot'], dtype=np.float64)[None, :])
+
+    def on_new_mot_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process_mot(data['time'], data['mot'])
+
+    def on_new_eeg_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process_eeg(np.array([data['time']], dtype=np.float64),
+                         np.asarray(data['eeg'], dtype=np.float64)[None, :])
+
+    def on_new_eeg_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process_eeg(data['time'], data['eeg'])
+
+    def process_mot(self, times, samples):
+        """Feed an (n, n_values) block of mot rows (as laid out by the mot labels)."""
+        if self.quaternion_index is None or len(times) == 0:
+            return
+        q = samples[:, self.quaternion_index]
+        acc = samples[:, self.accelerometer_index]
+        angular_speed, jerk, reference = motion_features(times, q, acc, self.previous_mot)
+        self.previous_mot = (times[-1], q[-1].copy(), acc[-1].copy())
+        self.last_mot_time = times[-1]
+        if self.mode == 'regress':
+            self.reference_history.append((np.asarray(times, dtype=np.float64), reference))
+
+        flags = (angular_speed > self.angular_speed_threshold) | (jerk > self.jerk_threshold)
+        if flags.any():
+            starts, ends = flag_windows(times, flags, self.pad_before, self.pad_after)
+            flagged_times = np.asarray(times, dtype=np.float64)[flags]
+            for start, end in zip(starts, ends):
+                inside = (flagged_times >= start + self.pad_before) & (flagged_times <= end - self.pad_after)
+                peak_speed = float(angular_speed[flags][inside].max(initial=0.0))
+                peak_jerk = float(jerk[flags][inside].max(initial=0.0))
+                window = self.open_window
+                if window is not None and start <= window['end']:
+                    window['end'] = max(window['end'], end)
+                else:
+                    self._close_window()
+                    window = self.open_window = {'start': start, 'end': end,
+                                                 'peak_angular_speed': 0.0, 'peak_jerk': 0.0}
+                window['peak_angular_speed'] = max(window['peak_angular_speed'], peak_speed)
+                window['peak_jerk'] = max(window['peak_jerk'], peak_jerk)
+        # no later flag can reach back into the open window any more
+        if self.open_window is not None and self.last_mot_time - self.pad_before > self.open_window['end']:
+            self._close_window()
+        self._release()
+
+    def _close_window(self):
+        window = self.open_window
+        if window is None:
+            return
+        self.open_window = None
+        self.windows.append((window['start'], window['end']))
+        self.artifacts += 1
+        self.emit('motion_artifact', data=dict(window))
+
+    def process_eeg(self, times, samples):
+        """Feed an (n, n_values) block of eeg rows; clean samples are emitted as they are released."""
+        if len(times) == 0:
+            return
+        if self.channel_index is None:
+            self.set_labels(['ch{0}'.format(i) for i in range(samples.shape[1])])
+        self.pending.append((np.asarray(times, dtype=np.float64), np.asarray(samples, dtype=np.float64)))
+        self.samples_in += len(times)
+        self._release()
+
+    def _release(self):
+        if not self.pending:
+            return
+        newest = self.pending[-1][0][-1]
+        if self.last_mot_time is None or newest - self.last_mot_time > self.max_delay:
+            # no (recent) motion data: nothing can contaminate the held samples
+            cutoff = newest
+        else:
+            cutoff = self.last_mot_time - self.pad_before
+        if self.pending[0][0][0] > cutoff:
+            return
+
+        times = np.concatenate([block[0] for block in self.pending])
+        samples = np.concatenate([block[1] for block in self.pending])
+        n = np.searchsorted(times, cutoff, side='right')
+        self.pending = [(times[n:], samples[n:])] if n < len(times) else []
+        times, samples = times[:n], samples[:n]
+
+        windows = list(self.windows)
+        if self.open_window is not None:
+            windows.append((self.open_window['start'], self.open_window['end']))
+        starts = np.array([w[0] for w in windows])
+        ends = np.array([w[1] for w in windows])
+        contaminated = window_mask(times, starts, ends)
+        # windows that end before the released samples cannot reach the held ones
+        while self.windows and self.windows[0][1] < times[-1]:
+            self.windows.popleft()
+
+        if self.mode == 'mask':
+            keep = ~contaminated
+            self.samples_rejected += int(contaminated.sum())
+            if not keep.any():
+                return
+            self.emit('new_clean_eeg', data={'time': times[keep], 'eeg': samples[keep],
+                                             'contaminated': np.zeros(int(keep.sum()), dtype=bool)})
+            return
+
+        reference = self._reference_at(times)
+        if reference is not None:
+            x = samples[:, self.channel_index]
+            weights, reference_mean = self._update_regression(reference, x)
+            if contaminated.any():
+                samples = samples.copy()
+                rows = np.flatnonzero(contaminated)
+                samples[np.ix_(rows, self.channel_index)] = regress_out(
+                    x[contaminated], reference[contaminated], weights, reference_mean)
+                self.samples_regressed += len(rows)
+        else:
+            contaminated = np.zeros(len(times), dtype=bool)
+        self.emit('new_clean_eeg', data={'time': times, 'eeg': samples, 'contaminated': contaminated})
+
+    def _reference_at(self, times):
+        """Motion reference interpolated to the EEG times, or None without motion data."""
+        history = self.reference_history
+        # keep a second before the released samples for the interpolation
+        while len(history) > 1 and history[1][0][0] < times[0] - 1.0:
+            history.popleft()
+        if not history:
+            return None
+        ref_times = np.concatenate([block[0] for block in history])
+        references = np.concatenate([block[1] for block in history])
+        return np.column_stack([np.interp(times, ref_times, references[:, j])
+                                for j in range(references.shape[1])])
+
+    def _update_regression(self, reference, x):
+        """Exponentially weighted covariances of reference and EEG; returns the current weights."""
+        w = 1.0 - (1.0 - self.alpha) ** len(x)
+        block = (reference.mean(axis=0), x.mean(axis=0),
+                 reference.T @ reference / len(x), reference.T @ x / len(x))
+        if self.moments is None:
+            self.moments = block
+        else:
+            self.moments = tuple((1.0 - w) * old + w * new for old, new in zip(self.moments, block))
+        mean_r, mean_x, s_rr, s_rx = self.moments
+        cov_rr = s_rr - np.outer(mean_r, mean_r)
+        cov_rx = s_rx - np.outer(mean_r, mean_x)
+        return regression_weights(cov_rr, cov_rx, self.ridge), mean_r
+
+    def flush(self):
+        """Release every held sample (for example when the stream stops)."""
+        self._close_window()
+        self.last_mot_time = None
+        self._release()
+
+    def get_stats(self):
+        return {'mode': self.mode, 'samples_in': self.samples_in, 'samples_rejected': self.samples_rejected,
+                'samples_regressed': self.samples_regressed, 'artifacts': self.artifacts,
+                'held': sum(len(block[0]) for block in self.pending)}
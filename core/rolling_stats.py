@@ -0,0 +1,215 @@
+import collections
+import numpy as np
+
+
+class RollingStatistics:
+    """
+    Time-window mean, standard deviation, minimum and maximum of several
+    metrics, updated one sample at a time.
+
+    The window is (t - window_seconds, t], as pandas' rolling('30s'). Only
+    the samples inside the window are kept:
+    - a ring of (time, values) rows, whose leaving rows are subtracted from
+      running sums of x and x^2 (the sums are rebuilt from the ring once per
+      ring length of evictions, so rounding errors cannot accumulate);
+    - one monotonic deque per metric for the minimum and one for the
+      maximum, so each sample is pushed and popped at most once.
+    Each update is O(1) amortized per metric, whatever the window length.
+    NaN (or None) values are ignored, per metric.
+
+    The ring starts with capacity rows and doubles when the window holds
+    more samples, so memory is bounded by the window, not the session.
+    """
+
+    def __init__(self, metrics, window_seconds=30.0, capacity=256):
+        self.metrics = list(metrics)
+        self.window_seconds = float(window_seconds)
+        n_metrics = len(self.metrics)
+        self.times = np.zeros(capacity)
+        self.values = np.zeros((capacity, n_metrics))
+        self.start = 0
+        self.size = 0
+        self.sums = np.zeros(n_metrics)
+        self.squares = np.zeros(n_metrics)
+        self.counts = np.zeros(n_metrics, dtype=np.int64)
+        self.minima = [collections.deque() for _ in range(n_metrics)]
+        self.maxima = [collections.deque() for _ in range(n_metrics)]
+        self.samples = 0
+        self.last_time = None
+        self._evicted = 0
+
+    def _grow(self):
+        order = (self.start + np.arange(self.size)) % len(self.times)
+        self.times = np.concatenate((self.times[order], np.zeros(len(self.times))))
+        self.values = np.vstack((self.values[order], np.zeros_like(self.values)))
+        self.start = 0
+
+    def _rebuild_sums(self):
+        order = (self.start + np.arange(self.size)) % len(self.times)
+        window = self.values[order]
+        valid = ~np.isnan(window)
+        self.sums = np.where(valid, window, 0.0).sum(axis=0)
+        self.squares = np.where(valid, window * window, 0.0).sum(axis=0)
+        self.counts = valid.sum(axis=0)
+        self._evicted = 0
+
+    def update(self, values, timestamp):
+        """
+        Add one sample.
+
+        Args:
+            values: Metric values in self.metrics order, or a dict metric -> value
+            timestamp: Sample time in seconds, non-decreasing
+        """
+        if isinstance(values, dict):
+            values = [values.get(metric, np.nan) for metric in self.metrics]
+        x = np.array([np.nan if v is None else v for v in values], dtype=np.float64)
+        self.last_time = timestamp
+
+        # samples that left the window
+        cutoff = timestamp - self.window_seconds
+        capacity = len(self.times)
+        while self.size and self.times[self.start] <= cutoff:
+            old = self.values[self.start]
+            valid = ~np.isnan(old)
+            self.sums -= np.where(valid, old, 0.0)
+            self.squares -= np.where(valid, old * old, 0.0)
+            self.counts -= valid
+            self.start = (self.start + 1) % capacity
+            self.size -= 1
+            self._evicted += 1
+        if self._evicted >= capacity:
+            self._rebuild_sums()
+
+        if self.size == capacity:
+            self._grow()
+        end = (self.start + self.size) % len(self.times)
+        self.times[end] = timestamp
+        self.values[end] = x
+        self.size += 1
+        valid = ~np.isnan(x)
+        self.sums += np.where(valid, x, 0.0)
+        self.squares += np.where(valid, x * x, 0.0)
+        self.counts += valid
+
+        for i, value in enumerate(x.tolist()):
+            minima, maxima = self.minima[i], self.maxima[i]
+            while minima and minima[0][0] <= cutoff:
+                minima.popleft()
+            while maxima and maxima[0][0] <= cutoff:
+                maxima.popleft()
+            if value != value:
+                continue
+            while minima and minima[-1][1] >= value:
+                minima.pop()
+            minima.append((timestamp, value))
+            while maxima and maxima[-1][1] <= value:
+                maxima.pop()
+            maxima.append((timestamp, value))
+        self.samples += 1
+
+    def update_many(self, times, values):
+        """
+        Add an (n_samples, n_metrics) block.
+
+        Returns:
+            Dictionary of (n_samples, n_metrics) arrays mean, std, min and max,
+            the statistics of the window ending at each sample
+        """
+        values = np.asarray(values, dtype=np.float64)
+        n = len(values)
+        results = {name: np.empty((n, len(self.metrics))) for name in ('mean', 'std', 'min', 'max')}
+        for k in range(n):
+            self.update(values[k], float(times[k]))
+            results['mean'][k] = self.mean()
+            results['std'][k] = self.std()
+            results['min'][k] = self.min()
+            results['max'][k] = self.max()
+        return results
+
+    def mean(self):
+        with np.errstate(divide='ignore', invalid='ignore'):
+            return np.where(self.counts > 0, self.sums / self.counts, np.nan)
+
+    def std(self):
+        """Sample standard deviation (ddof=1, as pandas), NaN below two samples."""
+        with np.errstate(divide='ignore', invalid='ignore'):
+            variance = (self.squares - self.sums * self.sums / self.counts) / (self.counts - 1)
+        return np.where(self.counts > 1, np.sqrt(np.maximum(variance, 0.0)), np.nan)
+
+    def min(self):
+        return np.array([d[0][1] if d else np.nan for d in self.minima])
+
+    def max(self):
+        return np.array([d[0][1] if d else np.nan for d in self.maxima])
+
+    def get_summary(self):
+        """Current window statistics per metric."""
+        mean, std, minimum, maximum = self.mean(), self.std(), self.min(), self.max()
+        return {metric: {'mean': float(mean[i]), 'std': float(std[i]), 'min': float(minimum[i]),
+                         'max': float(maximum[i]), 'count': int(self.counts[i])}
+                for i, metric in enumerate(self.metrics)}
+
+
+class StreamingCovariance:
+    """
+    Covariance and correlation matrices of several metrics over every sample
+    seen, in constant memory.
+
+    Like pandas' DataFrame.corr, each pair of metrics uses the samples where
+    both are present. For every pair the count, the means and the sums of
+    squared deviations are kept and merged block by block with the parallel
+    (Chan et al.) update, so a block costs O(n_samples * n_metrics^2) and the
+    result does not depend on how the samples were split into blocks.
+    """
+
+    def __init__(self, metrics):
+        self.metrics = list(metrics)
+        n_metrics = len(self.metrics)
+        # [i, j]: statistics of metric i over the samples where i and j are both present
+        self.n = np.zeros((n_metrics, n_metrics))
+        self.means = np.zeros((n_metrics, n_metrics))
+        self.m2 = np.zeros((n_metrics, n_metrics))
+        self.comoments = np.zeros((n_metrics, n_metrics))
+
+    def update(self, values):
+        """Add one sample (metric values in self.metrics order, None for missing)."""
+        x = np.array([np.nan if v is None else v for v in values], dtype=np.float64)
+        self.update_many(x[None, :])
+
+    def update_many(self, values):
+        """Add an (n_samples, n_metrics) block."""
+        values = np.asarray(values, dtype=np.float64)
+        if not len(values):
+            return
+        valid = ~np.isnan(values)
+        x = np.where(valid, values, 0.0)
+        # pair masks (n, m, m) and the block statistics of each pair
+        pairs = valid[:, :, None] & valid[:, None, :]
+        n_block = pairs.sum(axis=0).astype(np.float64)
+        with np.errstate(divide='ignore', invalid='ignore'):
+            mean_block = np.where(n_block > 0, np.einsum('nij,ni->ij', pairs.astype(np.float64), x) / n_block, 0.0)
+        deviation_i = np.where(pairs, x[:, :, None] - mean_block[None, :, :], 0.0)
+        deviation_j = np.where(pairs, x[:, None, :] - mean_block.T[None, :, :], 0.0)
+        m2_block = np.einsum('nij,nij->ij', deviation_i, deviation_i)
+        comoment_block = np.einsum('nij,nij->ij', deviation_i, deviation_j)
+
+        total = self.n + n_block
+        with np.errstate(divide='ignore', invalid='ignore'):
+            weight = np.where(total > 0, self.n * n_block / total, 0.0)
+            delta = mean_block - self.means
+            self.means = np.where(total > 0, self.means + delta * n_block / total, 0.0)
+        self.m2 += m2_block + delta * delta * weight
+        self.comoments += comoment_block + delta * delta.T * weight
+        self.n = total
+
+    def covariance(self):
+        """(n_metrics, n_metrics) sample covariance (ddof=1)."""
+        with np.errstate(divide='ignore', invalid='ignore'):
+            return np.where(self.n > 1, self.comoments / (self.n - 1), np.nan)
+
+    def correlation(self):
+        """(n_metrics, n_metrics) Pearson correlation of the pairwise complete samples."""
+        with np.errstate(divide='ignore', invalid='ignore'):
+            corr = self.comoments / np.sqrt(self.m2 * self.m2.T)
+        return np.where(self.n > 1, np.clip(corr, -1.0, 1.0), np.nan)
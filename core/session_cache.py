@@ -0,0 +1,75 @@
+import os
+import json
+import time
+import hashlib
+
+DEFAULT_CACHE_PATH = os.path.join(os.path.expanduser('~'), '.emorobots', 'cortex_cache.json')
+# Cortex does not report when a token expires; cached tokens older than this are not tried
+DEFAULT_TOKEN_TTL = 24 * 3600
+
+
+class SessionCache:
+    """
+    On-disk cache of the Cortex startup state: the cortexToken with its
+    expiry, the last headset and the last profile, stored per client id.
+
+    The file holds a live access token, so it is written with mode 0600 and
+    replaced atomically. A cached token is only a hint: Cortex validates it
+    on a warm start and falls back to the full authorize flow when it is
+    rejected.
+    """
+
+    def __init__(self, client_id, path=None, token_ttl=DEFAULT_TOKEN_TTL):
+        self.path = path or DEFAULT_CACHE_PATH
+        self.token_ttl = token_ttl
+        # the client id itself is not written to disk
+        self.key = hashlib.sha256(client_id.encode('utf-8')).hexdigest()[:16]
+        self.entry = self._load().get(self.key, {})
+
+    def _load(self):
+        try:
+            with open(self.path) as f:
+                return json.load(f)
+        except (OSError, ValueError):
+            return {}
+
+    def _save(self):
+        data = self._load()
+        data[self.key] = self.entry
+        directory = os.path.dirname(self.path)
+        if directory:
+            os.makedirs(directory, exist_ok=True)
+        tmp_path = self.path + '.tmp'
+        fd = os.open(tmp_path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o600)
+        with os.fdopen(fd, 'w') as f:
+            json.dump(data, f, indent=2)
+        os.replace(tmp_path, self.path)
+
+    def get_token(self):
+        """The cached token, or '' when there is none or it has expired."""
+        if self.entry.get('token_expires', 0) <= time.time():
+            return ''
+        return self.entry.get('cortex_token', '')
+
+    def get_headset(self):
+        return self.entry.get('headset_id', '')
+
+    def get_profile(self):
+        return self.entry.get('profile_name', '')
+
+    def update(self, **fields):
+        """Store cortex_token, headset_id and/or profile_name."""
+        if 'cortex_token' in fields:
+            fields['token_expires'] = time.time() + self.token_ttl
+        self.entry.update(fields)
+        self.entry['saved_at'] = time.time()
+        try:
+            self._save()
+        except OSError as e:
+            print('session cache: cannot write ' + self.path + ': ' + str(e))
+
+    def invalidate_token(self):
+        if 'cortex_token' in self.entry:
+            self.entry.pop('cortex_token', None)
+            self.entry.pop('token_expires', None)
+            self.update()
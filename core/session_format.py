@@ -0,0 +1,437 @@
+"""
+Output formats for collected stream data.
+
+csv: data_{stream}_{timestamp}.csv, one text row per sample (the original format).
+
+npy: data_{stream}_{timestamp}.npy, a standard numpy .npy file holding a
+     structured array with one record per sample. The record has a float64
+     'timestamp' field followed by one field per data label, in the stream's
+     value dtype (float32 by default). The .npy header is the label header.
+     Per-stream metadata is written next to it as data_{stream}_{timestamp}.json.
+
+     Records are appended while collecting. The shape in the header is
+     rewritten on every fsync, so after a crash np.load() still returns every
+     sample up to the last fsync. Files are read back with
+     np.load(path, mmap_mode='r') without copying or parsing.
+
+ezs: data_{stream}_{timestamp}.ezs, lossless compressed chunks of samples,
+     with the same .json sidecar as npy. Values are float64 by default, the
+     precision Cortex sends; a narrower value_dtype has to be asked for and
+     rounds the samples before they are compressed. The file starts with b'EZS1', a
+     uint32 length and a JSON header (columns, value dtype, codec, predictor),
+     followed by independent chunks of up to chunk_rows samples:
+         b'EZSC', rows (uint32), payload bytes (uint32), first and last
+         timestamp (float64), payload
+     The payload is the compressed (zstd, lz4 or zlib, whichever is
+     installed first) residuals of a per-column integer predictor on the
+     bit patterns of the values: delta (x[n] - x[n-1]) or linear
+     (x[n] - 2 x[n-1] + x[n-2]), always linear for the evenly spaced
+     timestamps. Residuals are zigzag encoded and byte-shuffled so the
+     mostly zero high bytes compress well. Working on the bit patterns keeps
+     every value (NaN included) exact in the value dtype.
+
+     A chunk is written every chunk_rows samples and on every fsync, so a
+     crash loses at most the samples since the last fsync. Readers seek from
+     chunk header to chunk header and decode only the chunks that overlap the
+     requested time range.
+"""
+import os
+import csv
+import json
+import zlib
+import struct
+from datetime import datetime
+import numpy as np
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+try:
+    import lz4.frame
+except ImportError:
+    lz4 = None
+
+FILE_FORMATS = ['csv', 'npy', 'ezs']
+NPY_FORMAT_NAME = 'emorobots-npy-1'
+EZS_FORMAT_NAME = 'emorobots-ezs-1'
+EZS_MAGIC = b'EZS1'
+EZS_CHUNK_MAGIC = b'EZSC'
+EZS_CHUNK_HEADER = struct.Struct('<4sIIdd')
+# residual order of the predictors
+EZS_PREDICTORS = {'delta': 1, 'linear': 2}
+EZS_CHUNK_ROWS = 4096
+# reserved space for the .npy header, so the shape can grow in place
+_NPY_SHAPE_DIGITS = 20
+
+
+def stream_filename(output_directory, stream_name, timestamp, file_format):
+    return f"{output_directory}/data_{stream_name}_{timestamp}.{file_format}"
+
+
+def record_dtype(columns, value_dtype='float32'):
+    """Structured dtype for a stream: float64 timestamp then one field per label."""
+    fields = [('timestamp', '<f8')]
+    seen = {'timestamp'}
+    for col in columns[1:]:
+        name = str(col)
+        i = 1
+        while name in seen:
+            name = f"{col}_{i}"
+            i += 1
+        seen.add(name)
+        fields.append((name, np.dtype(value_dtype).str))
+    return np.dtype(fields)
+
+
+class CsvStreamFile:
+    """Appends sample rows to a CSV file."""
+
+    def __init__(self, filename, columns, **kwargs):
+        self.filename = filename
+        self.rows = 0
+        self.f = open(filename, 'a', newline='')
+        self.writer = csv.writer(self.f)
+        if self.f.tell() == 0:
+            self.writer.writerow(columns)
+
+    def write(self, rows):
+        if isinstance(rows, np.ndarray):
+            rows = rows.tolist()
+        self.writer.writerows(rows)
+        self.rows += len(rows)
+
+    def flush(self):
+        self.f.flush()
+
+    def fsync(self):
+        self.f.flush()
+        os.fsync(self.f.fileno())
+
+    def close(self):
+        self.f.close()
+
+
+class NpyStreamFile:
+    """Appends sample rows to a structured .npy file and keeps its metadata sidecar."""
+
+    def __init__(self, filename, columns, value_dtype='float32', metadata=None):
+        self.filename = filename
+        self.meta_filename = os.path.splitext(filename)[0] + '.json'
+        self.dtype = record_dtype(columns, value_dtype)
+        self.rows = 0
+        self.metadata = {
+            'format': NPY_FORMAT_NAME,
+            'columns': list(self.dtype.names),
+            'value_dtype': np.dtype(value_dtype).name,
+            'created': datetime.now().isoformat(),
+        }
+        if metadata:
+            self.metadata.update(metadata)
+        self.f = open(filename, 'wb')
+        self._write_header()
+        self.data_offset = self.f.tell()
+        self._write_metadata()
+
+    def _header_bytes(self):
+        shape = '({0},)'.format(self.rows).ljust(_NPY_SHAPE_DIGITS)
+        header = "{{'descr': {0}, 'fortran_order': False, 'shape': {1}, }}".format(
+            repr(self.dtype.descr), shape)
+        # magic(6) + version(2) + length(4), total padded to a multiple of 64
+        pad = 64 - (12 + len(header) + 1) % 64
+        header = header + ' ' * pad + '\n'
+        return b'\x93NUMPY' + bytes([2, 0]) + struct.pack('<I', len(header)) + header.encode('latin1')
+
+    def _write_header(self):
+        self.f.seek(0)
+        self.f.write(self._header_bytes())
+
+    def _write_metadata(self):
+        self.metadata['rows'] = self.rows
+        with open(self.meta_filename, 'w') as f:
+            json.dump(self.metadata, f, indent=2)
+
+    def write(self, rows):
+        rows = np.asarray(rows, dtype=np.float64)
+        if rows.size == 0:
+            return
+        records = np.empty(len(rows), dtype=self.dtype)
+        for i, name in enumerate(self.dtype.names):
+            records[name] = rows[:, i]
+        self.f.seek(0, os.SEEK_END)
+        self.f.write(records.tobytes())
+        self.rows += len(rows)
+
+    def flush(self):
+        self.f.flush()
+
+    def fsync(self):
+        # data first, then the header that makes it visible
+        self.f.flush()
+        os.fsync(self.f.fileno())
+        self._write_header()
+        self.f.flush()
+        os.fsync(self.f.fileno())
+
+    def close(self):
+        self.fsync()
+        self.f.close()
+        self._write_metadata()
+
+
+def available_codecs():
+    """Installed compression codecs, preferred first (zlib is always there)."""
+    codecs = []
+    if zstandard is not None:
+        codecs.append('zstd')
+    if lz4 is not None:
+        codecs.append('lz4')
+    codecs.append('zlib')
+    return codecs
+
+
+def _compress(codec, data):
+    if codec == 'zstd':
+        return zstandard.ZstdCompressor(level=3).compress(data)
+    if codec == 'lz4':
+        return lz4.frame.compress(data)
+    return zlib.compress(data, 6)
+
+
+def _decompress(codec, data):
+    if codec == 'zstd':
+        if zstandard is None:
+            raise ImportError('zstandard is needed to read this file (pip install zstandard)')
+        return zstandard.ZstdDecompressor().decompress(data)
+    if codec == 'lz4':
+        if lz4 is None:
+            raise ImportError('lz4 is needed to read this file (pip install lz4)')
+        return lz4.frame.decompress(data)
+    return zlib.decompress(data)
+
+
+def _encode_columns(bits, order):
+    """Zigzag residuals of an order-th difference predictor, columns of signed integer bit patterns."""
+    residual = np.diff(bits, n=order, axis=0, prepend=np.zeros((order,) + bits.shape[1:], dtype=bits.dtype))
+    shift = bits.dtype.itemsize * 8 - 1
+    return ((residual << 1) ^ (residual >> shift)).view(bits.dtype.str.replace('i', 'u'))
+
+
+def _decode_columns(zigzag, order):
+    """Inverse of _encode_columns, back to the signed integer bit patterns."""
+    signed = zigzag.dtype.str.replace('u', 'i')
+    bits = (zigzag >> 1).view(signed) ^ -(zigzag & 1).view(signed)
+    for _ in range(order):
+        bits = np.cumsum(bits, axis=0, dtype=signed)
+    return bits
+
+
+def _shuffle(values):
+    """Column-major byte planes of a (rows, columns) array: byte k of every sample of a column together."""
+    rows = values.shape[0]
+    planes = values.T.copy().view(np.uint8).reshape(values.shape[1], rows, values.dtype.itemsize)
+    return planes.transpose(0, 2, 1).tobytes()
+
+
+def _unshuffle(data, rows, columns, dtype):
+    planes = np.frombuffer(data, dtype=np.uint8).reshape(columns, dtype.itemsize, rows)
+    return planes.transpose(0, 2, 1).copy().view(dtype).reshape(columns, rows).T
+
+
+class CompressedStreamFile:
+    """Appends sample rows to a chunked, losslessly compressed .ezs file and keeps its metadata sidecar."""
+
+    def __init__(self, filename, columns, value_dtype='float64', metadata=None, codec=None,
+                 predictor='delta', chunk_rows=EZS_CHUNK_ROWS):
+        if predictor not in EZS_PREDICTORS:
+            raise ValueError('Unknown predictor ' + str(predictor) + '. Use one of ' + str(list(EZS_PREDICTORS)))
+        self.codec = codec or available_codecs()[0]
+        if self.codec not in available_codecs():
+            raise ValueError('Codec ' + str(self.codec) + ' is not installed. Use one of ' + str(available_codecs()))
+        self.filename = filename
+        self.meta_filename = os.path.splitext(filename)[0] + '.json'
+        self.value_dtype = np.dtype(value_dtype).newbyteorder('<')
+        self.predictor = predictor
+        self.chunk_rows = chunk_rows
+        self.columns = list(record_dtype(columns, value_dtype).names)
+        self.rows = 0
+        self.chunks = 0
+        self.pending = []
+        self.pending_rows = 0
+        self.metadata = {
+            'format': EZS_FORMAT_NAME,
+            'columns': self.columns,
+            'value_dtype': self.value_dtype.name,
+            'codec': self.codec,
+            'predictor': predictor,
+            'created': datetime.now().isoformat(),
+        }
+        if metadata:
+            self.metadata.update(metadata)
+        header = json.dumps({key: self.metadata[key] for key in
+                             ('format', 'columns', 'value_dtype', 'codec', 'predictor')}).encode('utf-8')
+        self.f = open(filename, 'wb')
+        self.f.write(EZS_MAGIC + struct.pack('<I', len(header)) + header)
+        self._write_metadata()
+
+    def _write_metadata(self):
+        self.metadata['rows'] = self.rows
+        self.metadata['chunks'] = self.chunks
+        with open(self.meta_filename, 'w') as f:
+            json.dump(self.metadata, f, indent=2)
+
+    def write(self, rows):
+        rows = np.asarray(rows, dtype=np.float64)
+        if rows.size == 0:
+            return
+        self.pending.append(rows)
+        self.pending_rows += len(rows)
+        self.rows += len(rows)
+        if self.pending_rows >= self.chunk_rows:
+            self._write_chunks(final=False)
+
+    def _write_chunks(self, final):
+        if not self.pending:
+            return
+        rows = np.concatenate(self.pending) if len(self.pending) > 1 else self.pending[0]
+        end = len(rows) if final else len(rows) - len(rows) % self.chunk_rows
+        for start in range(0, end, self.chunk_rows):
+            self._write_chunk(rows[start:min(start + self.chunk_rows, end)])
+        self.pending = [rows[end:]] if end < len(rows) else []
+        self.pending_rows = len(rows) - end
+
+    def _write_chunk(self, rows):
+        times = np.ascontiguousarray(rows[:, 0])
+        values = rows[:, 1:].astype(self.value_dtype)
+        int_dtype = np.dtype('<i{0}'.format(self.value_dtype.itemsize))
+        payload = (_encode_columns(times.view('<i8'), 2).tobytes()
+                   + _shuffle(_encode_columns(values.view(int_dtype), EZS_PREDICTORS[self.predictor])))
+        payload = _compress(self.codec, payload)
+        self.f.write(EZS_CHUNK_HEADER.pack(EZS_CHUNK_MAGIC, len(rows), len(payload),
+                                          float(np.nanmin(times)) if len(times) else 0.0,
+                                          float(np.nanmax(times)) if len(times) else 0.0))
+        self.f.write(payload)
+        self.chunks += 1
+
+    def flush(self):
+        self.f.flush()
+
+    def fsync(self):
+        # the samples held for a full chunk go out as a short chunk
+        self._write_chunks(final=True)
+        self.f.flush()
+        os.fsync(self.f.fileno())
+
+    def close(self):
+        self.fsync()
+        self.f.close()
+        self._write_metadata()
+
+
+class CompressedStreamReader:
+    """
+    Random access to an .ezs stream file by time.
+
+    The chunk table is built by seeking from chunk header to chunk header, so
+    opening a file reads a few bytes per chunk. A truncated last chunk (a
+    crash while writing) is ignored.
+    """
+
+    def __init__(self, filename):
+        self.filename = filename
+        with open(filename, 'rb') as f:
+            if f.read(4) != EZS_MAGIC:
+                raise ValueError(str(filename) + ' is not an ezs stream file')
+            length, = struct.unpack('<I', f.read(4))
+            self.header = json.loads(f.read(length).decode('utf-8'))
+            size = os.fstat(f.fileno()).st_size
+            offsets, rows, first, last = [], [], [], []
+            position = f.tell()
+            while position + EZS_CHUNK_HEADER.size <= size:
+                magic, n, payload, t_first, t_last = EZS_CHUNK_HEADER.unpack(f.read(EZS_CHUNK_HEADER.size))
+                position += EZS_CHUNK_HEADER.size
+                if magic != EZS_CHUNK_MAGIC or position + payload > size:
+                    break
+                offsets.append(position)
+                rows.append(n)
+                first.append(t_first)
+                last.append(t_last)
+                position += payload
+                f.seek(position)
+        self.columns = self.header['columns']
+        self.value_dtype = np.dtype(self.header['value_dtype']).newbyteorder('<')
+        self.codec = self.header['codec']
+        self.order = EZS_PREDICTORS[self.header['predictor']]
+        self.offsets = np.array(offsets, dtype=np.int64)
+        self.chunk_rows = np.array(rows, dtype=np.int64)
+        self.first_times = np.array(first, dtype=np.float64)
+        self.last_times = np.array(last, dtype=np.float64)
+        self.rows = int(self.chunk_rows.sum())
+
+    def chunks_between(self, start=None, end=None):
+        """Indices of the chunks holding samples in [start, end] (unix seconds, None for open)."""
+        keep = np.ones(len(self.offsets), dtype=bool)
+        if start is not None:
+            keep &= self.last_times >= start
+        if end is not None:
+            keep &= self.first_times <= end
+        return np.flatnonzero(keep)
+
+    def read_chunks(self, indices):
+        """(timestamps, values) of the given chunks, values of shape (rows, columns - 1)."""
+        n_values = len(self.columns) - 1
+        int_dtype = np.dtype('<u{0}'.format(self.value_dtype.itemsize))
+        times, values = [], []
+        with open(self.filename, 'rb') as f:
+            for i in indices:
+                n = int(self.chunk_rows[i])
+                f.seek(self.offsets[i] - EZS_CHUNK_HEADER.size)
+                _, _, payload, _, _ = EZS_CHUNK_HEADER.unpack(f.read(EZS_CHUNK_HEADER.size))
+                data = _decompress(self.codec, f.read(payload))
+                time_bytes = 8 * n
+                times.append(_decode_columns(np.frombuffer(data[:time_bytes], dtype='<u8'), 2).view('<f8'))
+                zigzag = _unshuffle(data[time_bytes:], n, n_values, int_dtype)
+                values.append(_decode_columns(zigzag, self.order).view(self.value_dtype))
+        if not times:
+            return np.empty(0), np.empty((0, n_values), dtype=self.value_dtype)
+        return np.concatenate(times), np.concatenate(values)
+
+    def read(self, start=None, end=None):
+        """(timestamps, values) of the samples with start <= timestamp <= end."""
+        times, values = self.read_chunks(self.chunks_between(start, end))
+        if start is None and end is None:
+            return times, values
+        keep = np.ones(len(times), dtype=bool)
+        if start is not None:
+            keep &= times >= start
+        if end is not None:
+            keep &= times <= end
+        return times[keep], values[keep]
+
+
+def open_stream_file(file_format, filename, columns, **kwargs):
+    if file_format == 'npy':
+        return NpyStreamFile(filename, columns, **kwargs)
+    if file_format == 'ezs':
+        return CompressedStreamFile(filename, columns, **kwargs)
+    if file_format == 'csv':
+        return CsvStreamFile(filename, columns)
+    raise ValueError('Unknown file format ' + str(file_format) + '. Use one of ' + str(FILE_FORMATS))
+
+
+def load_npy_stream(filename):
+    """
+    Memory-map a structured .npy stream file.
+
+    Returns
+    -------
+    (records, metadata): numpy memmap of records and the sidecar dictionary
+    (empty when the sidecar is missing).
+    """
+    records = np.load(filename, mmap_mode='r')
+    meta_filename = os.path.splitext(filename)[0] + '.json'
+    metadata = {}
+    if os.path.exists(meta_filename):
+        with open(meta_filename) as f:
+            metadata = json.load(f)
+    return records, metadata
@@ -0,0 +1,263 @@
+import numpy as np
+from scipy import signal
+from pydispatch import Dispatcher
+
+from core.eeg_stream import StreamStage, channel_indices
+
+QUALITY_STATES = ['unknown', 'good', 'fair', 'bad']
+# sys row tag of a bad segment: [end, BAD_SEGMENT_TAG, start, end, 'AF3 F7 ...']
+BAD_SEGMENT_TAG = 'bad_signal'
+
+
+class SignalQualityMonitor(StreamStage, Dispatcher):
+    """
+    Streaming per-channel signal quality of the Cortex eeg stream, fused
+    with the contact quality of the dev stream.
+
+    Uses the definitions of EEGAnalyzer._assess_signal_quality over a
+    rolling window instead of the whole recording:
+    - snr = 10 log10(var(x) / var(diff(x))),
+    - artifact_ratio = share of samples further than artifact_sigma standard
+      deviations from the mean.
+    Mean, mean square and mean squared difference are exponentially weighted
+    (time constant window_seconds, bias-corrected at the start) and updated
+    for a whole block with one lfilter call, all channels at once, so each
+    sample costs O(1) whatever the window. A sample counts as an artifact
+    against the statistics before it.
+
+    A channel is bad when its contact quality (0 none .. 4 good) is at most
+    contact_bad, its snr is below snr_bad or its artifact ratio above
+    artifact_bad; fair with the *_fair limits; good otherwise. A new state
+    has to hold for hold_seconds before it is reported, so a single
+    artifact does not flap the state.
+
+    quality_changed data:
+        {'time': sample time, 'channel': label, 'state': 'good'/'fair'/'bad',
+         'previous': previous state, 'reasons': ['contact', 'snr', 'artifacts'],
+         'snr': dB, 'artifact_ratio': share, 'contact_quality': 0..4 or None,
+         'bad_channels': every channel bad after this change}
+
+    While any channel is bad, a bad segment is open. bad_segment is emitted
+    when it closes (or on close_segment()):
+        {'start': time, 'end': time, 'channels': channels bad at any point}
+    """
+
+    _events_ = ['quality_changed', 'bad_segment']
+    _streams_ = ['eeg', 'dev']
+
+    def __init__(self, sampling_rate=128.0, window_seconds=4.0, warmup_seconds=2.0, hold_seconds=1.0,
+                 artifact_sigma=3.0, snr_bad=0.0, snr_fair=6.0, artifact_bad=0.1, artifact_fair=0.02,
+                 contact_bad=1, contact_fair=2):
+        self.sampling_rate = float(sampling_rate)
+        self.alpha = 1.0 / (window_seconds * self.sampling_rate)
+        self.warmup = int(round(warmup_seconds * self.sampling_rate))
+        self.hold = max(1, int(round(hold_seconds * self.sampling_rate)))
+        self.artifact_sigma = artifact_sigma
+        self.snr_bad = snr_bad
+        self.snr_fair = snr_fair
+        self.artifact_bad = artifact_bad
+        self.artifact_fair = artifact_fair
+        self.contact_bad = contact_bad
+        self.contact_fair = contact_fair
+        # exponential average: y[n] = alpha x[n] + (1 - alpha) y[n-1]
+        self.ewma_b = np.array([self.alpha])
+        self.ewma_a = np.array([1.0, self.alpha - 1.0])
+
+        self.channels = []
+        self.channel_index = None
+        self.dev_index = None
+        self.dev_labels = None
+        self.segments = []
+        self.changes = 0
+        self.last_time = None
+
+    def set_labels(self, labels):
+        self.channel_index = channel_indices(labels)
+        self.channels = [labels[i] for i in self.channel_index]
+        if self.dev_labels is not None:
+            self.set_dev_labels(self.dev_labels)
+        self.reset()
+
+    def set_dev_labels(self, labels):
+        """Contact quality labels of the dev stream (Cortex cols[2])."""
+        self.dev_labels = list(labels)
+        position = {label: i for i, label in enumerate(self.dev_labels)}
+        # -1 for channels without a contact quality value
+        self.dev_index = np.array([position.get(channel, -1) for channel in self.channels], dtype=np.intp)
+
+    def reset(self):
+        n_channels = len(self.channels)
+        self.count = 0
+        self.last_x = None
+        # running averages of x, x^2 and diff(x)^2 per channel, then of the artifact flag
+        self.moments = np.zeros(3 * n_channels)
+        self.artifacts = np.zeros(n_channels)
+        self.artifact_count = 0
+        self.snr = np.zeros(n_channels)
+        self.artifact_ratio = np.zeros(n_channels)
+        self.contact = np.full(n_channels, np.nan)
+        self.state = np.zeros(n_channels, dtype=np.intp)
+        self.pending = np.zeros(n_channels, dtype=np.intp)
+        self.pending_count = np.zeros(n_channels, dtype=np.intp)
+        self.segment = None
+
+    def on_new_data_labels(self, *args, **kwargs):
+        data = kwargs.get('data')
+        if data['streamName'] == 'eeg':
+            self.set_labels(data['labels'])
+        elif data['streamName'] == 'dev':
+            self.set_dev_labels(data['labels'])
+
+    def on_new_eeg_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process(np.asarray(data['eeg'], dtype=np.float64)[None, :], data['time'])
+
+    def on_new_eeg_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.process(data['eeg'], data['time'][-1])
+
+    def on_new_dev_data(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.update_contact(data['dev'])
+
+    def on_new_dev_batch(self, *args, **kwargs):
+        data = kwargs.get('data')
+        self.update_contact(data['dev'][-1])
+
+    def update_contact(self, contact_quality):
+        """Latest dev contact quality values, laid out as the dev labels."""
+        if self.dev_index is None or self.channel_index is None:
+            return
+        values = np.array([np.nan if v is None else v for v in contact_quality], dtype=np.float64)
+        known = (self.dev_index >= 0) & (self.dev_index < len(values))
+        self.contact = np.where(known, values[np.where(known, self.dev_index, 0)], np.nan)
+
+    def process(self, samples, timestamp=None):
+        """
+        Update the quality with an (n, n_values) block of eeg rows (as laid out
+        by the eeg labels). Returns the list of quality changes it triggered.
+        """
+        if self.channel_index is None:
+            self.set_labels(['ch{0}'.format(i) for i in range(samples.shape[1])])
+        x = samples[:, self.channel_index]
+        n, n_channels = x.shape
+        self.last_time = timestamp
+        previous = x[0] if self.last_x is None else self.last_x
+        d = np.diff(np.vstack((previous[None, :], x)), axis=0)
+        self.last_x = x[-1].copy()
+
+        # exponential averages of every sample of the block, and the ones before each sample
+        stacked = np.hstack((x, x * x, d * d))
+        zi = ((1.0 - self.alpha) * self.moments)[None, :]
+        averages, _ = signal.lfilter(self.ewma_b, self.ewma_a, stacked, axis=0, zi=zi)
+        before = np.vstack((self.moments[None, :], averages[:-1]))
+        counts = self.count + np.arange(n + 1)
+        self.moments = averages[-1]
+        self.count += n
+
+        # bias correction of averages that started from zero
+        with np.errstate(divide='ignore', invalid='ignore'):
+            correction = 1.0 / (1.0 - (1.0 - self.alpha) ** counts[:-1])[:, None]
+            mean_before = before[:, :n_channels] * correction
+            var_before = np.maximum(before[:, n_channels:2 * n_channels] * correction - mean_before ** 2, 0.0)
+            flags = np.abs(x - mean_before) > self.artifact_sigma * np.sqrt(var_before)
+        # only samples whose preceding statistics are warmed up count
+        flags = flags[counts[:-1] >= self.warmup].astype(np.float64)
+        if len(flags):
+            zi = ((1.0 - self.alpha) * self.artifacts)[None, :]
+            artifacts, _ = signal.lfilter(self.ewma_b, self.ewma_a, flags, axis=0, zi=zi)
+            self.artifacts = artifacts[-1]
+            self.artifact_count += len(flags)
+            self.artifact_ratio = self.artifacts / (1.0 - (1.0 - self.alpha) ** self.artifact_count)
+
+        correction = 1.0 / (1.0 - (1.0 - self.alpha) ** self.count)
+        mean = self.moments[:n_channels] * correction
+        var = np.maximum(self.moments[n_channels:2 * n_channels] * correction - mean ** 2, 0.0)
+        noise = self.moments[2 * n_channels:] * correction
+        with np.errstate(divide='ignore', invalid='ignore'):
+            self.snr = np.where((noise > 0) & (var > 0), 10 * np.log10(var / noise), 0.0)
+
+        if self.count < self.warmup:
+            return []
+        return self._update_state(n, timestamp)
+
+    def _assess(self):
+        """State index and (contact, snr, artifacts) reason masks per channel."""
+        contact = self.contact
+        with np.errstate(invalid='ignore'):
+            contact_bad = contact <= self.contact_bad
+            contact_fair = contact <= self.contact_fair
+        snr_bad = self.snr < self.snr_bad
+        snr_fair = self.snr < self.snr_fair
+        artifacts_bad = self.artifact_ratio > self.artifact_bad
+        artifacts_fair = self.artifact_ratio > self.artifact_fair
+        bad = contact_bad | snr_bad | artifacts_bad
+        fair = contact_fair | snr_fair | artifacts_fair
+        state = np.where(bad, 3, np.where(fair, 2, 1))
+        reasons = np.where(bad[:, None], np.column_stack((contact_bad, snr_bad, artifacts_bad)),
+                           np.column_stack((contact_fair, snr_fair, artifacts_fair)))
+        return state, reasons
+
+    def _update_state(self, n, timestamp):
+        candidate, reasons = self._assess()
+        same = candidate == self.pending
+        self.pending_count = np.where(same, self.pending_count + n, n)
+        self.pending = candidate
+        switch = (candidate != self.state) & ((self.pending_count >= self.hold) | (self.state == 0))
+        if not switch.any():
+            return []
+
+        previous = self.state.copy()
+        self.state = np.where(switch, candidate, self.state)
+        bad_channels = [self.channels[i] for i in np.flatnonzero(self.state == 3)]
+        self._track_segment(bad_channels, timestamp)
+
+        events = []
+        for i in np.flatnonzero(switch):
+            contact = self.contact[i]
+            events.append({
+                'time': timestamp,
+                'channel': self.channels[i],
+                'state': QUALITY_STATES[self.state[i]],
+                'previous': QUALITY_STATES[previous[i]],
+                'reasons': [name for name, flag in zip(('contact', 'snr', 'artifacts'), reasons[i]) if flag],
+                'snr': float(self.snr[i]),
+                'artifact_ratio': float(self.artifact_ratio[i]),
+                'contact_quality': None if np.isnan(contact) else float(contact),
+                'bad_channels': bad_channels,
+            })
+        self.changes += len(events)
+        for event in events:
+            self.emit('quality_changed', data=event)
+        return events
+
+    def _track_segment(self, bad_channels, timestamp):
+        if bad_channels:
+            if self.segment is None:
+                self.segment = {'start': timestamp, 'end': None, 'channels': []}
+            for channel in bad_channels:
+                if channel not in self.segment['channels']:
+                    self.segment['channels'].append(channel)
+        elif self.segment is not None:
+            self.close_segment(timestamp)
+
+    def close_segment(self, timestamp):
+        """End the open bad segment, if any (for example when the collection stops)."""
+        if self.segment is None:
+            return None
+        segment = self.segment
+        segment['end'] = timestamp
+        self.segment = None
+        self.segments.append(segment)
+        self.emit('bad_segment', data=segment)
+        return segment
+
+    def get_quality(self):
+        """Current state and metrics per channel."""
+        if self.channel_index is None:
+            return {}
+        return {channel: {'state': QUALITY_STATES[self.state[i]],
+                          'snr': float(self.snr[i]),
+                          'artifact_ratio': float(self.artifact_ratio[i]),
+                          'contact_quality': None if np.isnan(self.contact[i]) else float(self.contact[i])}
+                for i, channel in enumerate(self.channels)}
@@ -0,0 +1,197 @@
+import threading
+import numpy as np
+
+
+class StreamBuffer:
+    """
+    A columnar sample buffer for one Cortex data stream.
+
+    Every sample is written as one row of a fixed-width numpy array instead of
+    being kept as its own Python list. The buffer works in two modes:
+    - unbounded (capacity=None): rows are stored in preallocated chunks of
+      chunk_size rows. A new chunk is allocated when the current one is full,
+      nothing already written is ever copied.
+    - ring (capacity=N): a single preallocated array of N rows. When it is
+      full the oldest sample is overwritten and counted in dropped.
+
+    The width is normally set from the labels received in new_data_labels.
+    If a sample arrives before its labels, the width is taken from that sample.
+
+    A consumer such as StreamWriter drains new samples with take_pending().
+    Drained chunks are released, so memory stays bounded while a writer keeps
+    up. If max_pending is set and the consumer falls behind by that many
+    samples, append() blocks for up to backpressure_timeout seconds.
+
+    mark_gap() records an interruption of the stream (for example a
+    reconnect) in gaps and writes a marker row holding only the gap start
+    time, so files show where data is missing.
+    """
+
+    def __init__(self, width=None, capacity=None, chunk_size=4096, dtype=np.float64):
+        self.width = width
+        self.capacity = capacity
+        self.chunk_size = capacity if capacity else chunk_size
+        self.dtype = np.dtype(dtype)
+        self.total_samples = 0
+        self.dropped = 0
+        self.max_pending = None
+        self.backpressure_timeout = 1.0
+        self.on_backpressure = None
+        self.stalls = 0
+        self.lost = 0
+        self.gaps = []      # (row index of the marker, start time, end time)
+        self._chunks = []
+        self._base = 0      # global index of the first row of _chunks[0]
+        self._drained = 0   # global index of the next row take_pending() returns
+        self._pos = self.chunk_size  # forces allocation on the first append
+        self._cond = threading.Condition()
+
+    def set_width(self, width):
+        if self.total_samples > 0 and width != self.width:
+            raise ValueError('Cannot change the width of a non-empty stream buffer')
+        self.width = width
+
+    def _new_chunk(self):
+        fill = np.nan if self.dtype.kind == 'f' else None
+        return np.full((self.chunk_size, self.width), fill, dtype=self.dtype)
+
+    def _next_row(self, n_values):
+        if self.width is None:
+            self.width = n_values
+        if self._pos == self.chunk_size:
+            if self.capacity is None:
+                self._chunks.append(self._new_chunk())
+            elif not self._chunks:
+                self._chunks.append(self._new_chunk())
+            self._pos = 0
+        if self.capacity is not None and self.total_samples >= self.capacity:
+            self.dropped += 1
+        row = self._chunks[-1][self._pos]
+        self._pos += 1
+        self.total_samples += 1
+        return row
+
+    def _wait_for_consumer(self):
+        self.stalls += 1
+        if self.on_backpressure is not None:
+            self.on_backpressure()
+        self._cond.wait(self.backpressure_timeout)
+
+    def append(self, head, values=()):
+        """
+        Write one sample. head holds the leading scalar columns (timestamp and
+        any per-sample fields such as signal or battery), values is the list
+        of channel values that follows them.
+        """
+        n_head = len(head)
+        n_values = len(values)
+        with self._cond:
+            if self.max_pending is not None and self.total_samples - self._drained >= self.max_pending:
+                self._wait_for_consumer()
+            # check before taking a row, so a rejected sample leaves nothing behind
+            if self.width is not None and n_head + n_values > self.width:
+                raise ValueError('Sample has {0} columns, stream buffer holds {1}'.format(
+                    n_head + n_values, self.width))
+            row = self._next_row(n_head + n_values)
+            row[:n_head] = head
+            if n_values:
+                row[n_head:n_head + n_values] = values
+
+    def mark_gap(self, start_time, end_time):
+        with self._cond:
+            if self.width is None:
+                # nothing received yet, so there is no row layout to mark
+                self.gaps.append((None, start_time, end_time))
+                return
+            self.gaps.append((self.total_samples, start_time, end_time))
+            row = self._next_row(self.width)
+            row[:] = np.nan if self.dtype.kind == 'f' else None
+            row[0] = start_time
+
+    def __len__(self):
+        return self.total_samples - self._first_held()
+
+    @property
+    def pending(self):
+        return self.total_samples - self._drained
+
+    def _first_held(self):
+        if self.capacity is None:
+            return self._base
+        return max(0, self.total_samples - self.capacity)
+
+    def _slice(self, start, end):
+        """Copy rows [start, end) given as global sample indices."""
+        if start >= end:
+            return np.empty((0, self.width or 0), dtype=self.dtype)
+        if self.capacity is not None:
+            ring = self._chunks[0]
+            lo, hi = start % self.capacity, end % self.capacity
+            if lo < hi:
+                return ring[lo:hi].copy()
+            return np.concatenate((ring[lo:], ring[:hi]))
+        first = (start - self._base) // self.chunk_size
+        last = (end - 1 - self._base) // self.chunk_size
+        lo = (start - self._base) % self.chunk_size
+        hi = (end - 1 - self._base) % self.chunk_size + 1
+        if first == last:
+            return self._chunks[first][lo:hi].copy()
+        parts = [self._chunks[first][lo:]] + self._chunks[first + 1:last] + [self._chunks[last][:hi]]
+        return np.concatenate(parts)
+
+    def to_array(self):
+        """Return the held samples in chronological order as one (n, width) array."""
+        with self._cond:
+            return self._slice(self._first_held(), self.total_samples)
+
+    def take_pending(self):
+        """
+        Return the samples appended since the previous call, oldest first,
+        and release the chunks that are no longer needed.
+        """
+        rows, start, end = self.peek_pending()
+        self.commit_drained(start, end)
+        return rows
+
+    def peek_pending(self):
+        """
+        Return (rows, start, end): the samples not drained yet, oldest first,
+        without releasing them. Pass start and end to commit_drained() once
+        the rows are written; until then they stay pending (and count for
+        max_pending), so a failed write can be retried.
+        """
+        with self._cond:
+            start = max(self._drained, self._first_held())
+            end = self.total_samples
+            return self._slice(start, end), start, end
+
+    def commit_drained(self, start, end):
+        """Mark the rows of peek_pending() up to end as written and release their chunks."""
+        with self._cond:
+            # rows overwritten in a capacity ring before they were taken
+            self.lost += max(0, start - self._drained)
+            self._drained = max(self._drained, end)
+            if self.capacity is None:
+                # keep the chunk currently being written
+                while len(self._chunks) > 1 and self._drained - self._base >= self.chunk_size:
+                    self._chunks.pop(0)
+                    self._base += self.chunk_size
+            self._cond.notify_all()
+
+    def rows(self):
+        """Iterate over the held samples as Python lists, oldest first."""
+        for row in self.to_array():
+            yield row.tolist()
+
+    def clear(self):
+        with self._cond:
+            self._chunks = []
+            self._base = 0
+            self._drained = 0
+            self._pos = self.chunk_size
+            self.total_samples = 0
+            self.dropped = 0
+            self.stalls = 0
+            self.lost = 0
+            self.gaps = []
+            self._cond.notify_all()
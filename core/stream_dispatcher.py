@@ -0,0 +1,106 @@
+import threading
+import collections
+
+
+class StreamDispatcher:
+    """
+    Hand-off between the WebSocket thread(s) and a dispatcher thread.
+
+    The producer (Cortex.on_message) only appends parsed messages to a bounded
+    deque; deque.append and deque.popleft are atomic, so with a single
+    producer no lock is taken on the socket thread. When the queue is full
+    the oldest message is dropped and counted. The dispatcher thread wakes
+    every interval seconds, or as soon as batch_size messages are waiting,
+    and calls deliver(messages) with up to batch_size messages at a time.
+
+    With shared=True several producers may call put() (CortexPool shares
+    one dispatcher between its connections); put() then takes a lock so the
+    full-queue check and the producer counters stay exact.
+    """
+
+    def __init__(self, deliver, queue_size=4096, batch_size=64, interval=0.005, shared=False):
+        self.deliver = deliver
+        self.queue = collections.deque(maxlen=queue_size)
+        self.queue_size = queue_size
+        self.batch_size = batch_size
+        self.interval = interval
+
+        # written by the producer thread only, or under _put_lock when shared
+        self._put_lock = threading.Lock() if shared else None
+        self.enqueued = 0
+        self.dropped = 0
+        # written by the dispatcher thread only
+        self.dispatched = 0
+        self.batches = 0
+        self.max_depth = 0
+        self.errors = 0
+
+        self._wake = threading.Event()
+        self._stopping = False
+        self._thread = None
+
+    def start(self):
+        if self._thread is not None:
+            return
+        self._stopping = False
+        self._thread = threading.Thread(target=self._run, name="CortexDispatchThread", daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        self._stopping = True
+        self._wake.set()
+        if self._thread is not None and self._thread is not threading.current_thread():
+            self._thread.join()
+        self._thread = None
+
+    def put(self, message):
+        if self._put_lock is not None:
+            with self._put_lock:
+                self._put(message)
+        else:
+            self._put(message)
+
+    def _put(self, message):
+        queue = self.queue
+        if len(queue) == self.queue_size:
+            self.dropped += 1
+        queue.append(message)
+        self.enqueued += 1
+        if len(queue) >= self.batch_size:
+            self._wake.set()
+
+    def _run(self):
+        while not self._stopping:
+            self._wake.wait(self.interval)
+            self._wake.clear()
+            self._drain()
+        self._drain()
+
+    def _drain(self):
+        queue = self.queue
+        depth = len(queue)
+        if depth > self.max_depth:
+            self.max_depth = depth
+        while queue:
+            batch = []
+            for _ in range(min(len(queue), self.batch_size)):
+                batch.append(queue.popleft())
+            try:
+                self.deliver(batch)
+            except Exception as e:
+                self.errors += 1
+                print('dispatcher error: ' + str(e))
+            self.dispatched += len(batch)
+            self.batches += 1
+
+    def get_stats(self):
+        return {
+            'queue_depth': len(self.queue),
+            'queue_size': self.queue_size,
+            'max_depth': self.max_depth,
+            'enqueued': self.enqueued,
+            'dropped': self.dropped,
+            'dispatched': self.dispatched,
+            'batches': self.batches,
+            'errors': self.errors,
+        }
@@ -0,0 +1,301 @@
+"""
+Hot-path instrumentation for Cortex stream messages.
+
+Latencies go into fixed power-of-two histograms (1 us .. 33 s, one list
+increment per sample), so recording costs a bisect and a few additions and
+nothing is allocated per message. Counters are updated without locks: each
+histogram has a single writer thread and readers only take snapshots.
+
+StatsReporter prints Cortex.get_stats() periodically and/or serves it in the
+Prometheus text format on http://<host>:<port>/metrics.
+"""
+import time
+import bisect
+import threading
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+# bucket upper bounds in microseconds: 1, 2, 4, ... 2**25 (about 33 s), then +Inf
+BUCKET_BOUNDS_US = tuple(float(2 ** i) for i in range(26))
+
+# position of the sample counter in the eeg stream
+EEG_COUNTER_INDEX = 0
+
+# a sample interval this many times longer than the running mean is a gap
+GAP_FACTOR = 2.5
+
+
+class LatencyHistogram:
+    """Fixed-bucket histogram of durations."""
+
+    __slots__ = ('counts', 'count', 'total_us', 'max_us')
+
+    def __init__(self):
+        self.counts = [0] * (len(BUCKET_BOUNDS_US) + 1)
+        self.count = 0
+        self.total_us = 0.0
+        self.max_us = 0.0
+
+    def record_ns(self, duration_ns):
+        self.record_us(duration_ns / 1000.0)
+
+    def record_us(self, duration_us):
+        if duration_us < 0.0:
+            duration_us = 0.0
+        self.counts[bisect.bisect_left(BUCKET_BOUNDS_US, duration_us)] += 1
+        self.count += 1
+        self.total_us += duration_us
+        if duration_us > self.max_us:
+            self.max_us = duration_us
+
+    def percentile_us(self, q):
+        """Upper bound of the bucket holding the q-quantile (0 < q <= 1)."""
+        if self.count == 0:
+            return 0.0
+        rank = q * self.count
+        seen = 0
+        for i, n in enumerate(self.counts):
+            seen += n
+            if seen >= rank:
+                return BUCKET_BOUNDS_US[i] if i < len(BUCKET_BOUNDS_US) else self.max_us
+        return self.max_us
+
+    def snapshot(self):
+        count = self.count
+        return {
+            'count': count,
+            'mean_ms': self.total_us / count / 1000.0 if count else 0.0,
+            'p50_ms': self.percentile_us(0.50) / 1000.0,
+            'p95_ms': self.percentile_us(0.95) / 1000.0,
+            'p99_ms': self.percentile_us(0.99) / 1000.0,
+            'max_ms': self.max_us / 1000.0,
+            'buckets_us': list(self.counts),
+        }
+
+
+class StreamMonitor:
+    """Latency, sample age and gap counters of one stream."""
+
+    def __init__(self):
+        self.latency = LatencyHistogram()
+        self.sample_age = LatencyHistogram()
+        self.samples = 0
+        self.gaps = 0
+        self.max_gap = 0.0
+        self.mean_interval = None
+        self.last_time = None
+        # eeg only. The COUNTER wraps at the sampling rate: counter_modulus is
+        # set from the headset's eegRate when known (Cortex does it from
+        # queryHeadsets), otherwise the largest counter seen + 1 is used
+        self.last_counter = None
+        self.counter_modulus = None
+        self.max_counter = -1
+        self.missing_samples = 0
+
+    def check_time(self, sample_time):
+        last = self.last_time
+        self.last_time = sample_time
+        if last is None:
+            return
+        interval = sample_time - last
+        if interval <= 0:
+            return
+        mean = self.mean_interval
+        if mean is not None and interval > GAP_FACTOR * mean:
+            self.gaps += 1
+            if interval > self.max_gap:
+                self.max_gap = interval
+            return
+        # running mean of the regular intervals only
+        self.mean_interval = interval if mean is None else mean + 0.05 * (interval - mean)
+
+    def check_counter(self, counter):
+        last = self.last_counter
+        self.last_counter = counter
+        if counter > self.max_counter:
+            self.max_counter = counter
+        if last is None or counter == last:
+            return
+        if counter > last:
+            self.missing_samples += counter - last - 1
+        else:
+            # wrap-around; a loss right before the first wrap only hides the
+            # range until the top counter value has been seen once
+            modulus = self.counter_modulus or self.max_counter + 1
+            self.missing_samples += (counter - last - 1) % modulus
+
+    def snapshot(self):
+        stats = {
+            'samples': self.samples,
+            'latency': self.latency.snapshot(),
+            'sample_age': self.sample_age.snapshot(),
+            'gaps': self.gaps,
+            'max_gap_s': self.max_gap,
+            'mean_interval_s': self.mean_interval,
+        }
+        if self.last_counter is not None:
+            stats['missing_samples'] = self.missing_samples
+        return stats
+
+
+class StreamStats:
+    """
+    Per-stream and per-event statistics collected by Cortex.
+
+    latency     receive (before JSON decode) to the end of the stream's handlers,
+                including the dispatcher queue wait in threaded mode
+    sample_age  arrival wall time minus the Cortex 'time' field (transport delay
+                plus any clock offset between the Cortex host and this host)
+    handlers    execution time of all handlers bound to each emitted event
+    """
+
+    def __init__(self):
+        self.streams = {}
+        self.handlers = {}
+        self.started = time.time()
+
+    def stream(self, stream_name):
+        monitor = self.streams.get(stream_name)
+        if monitor is None:
+            monitor = self.streams[stream_name] = StreamMonitor()
+        return monitor
+
+    def on_delivered(self, stream_name, recv_dic, done_ns):
+        monitor = self.stream(stream_name)
+        monitor.samples += 1
+        recv_ns = recv_dic.get('_recv_ns')
+        if recv_ns is not None:
+            elapsed_ns = done_ns - recv_ns
+            monitor.latency.record_ns(elapsed_ns)
+        else:
+            elapsed_ns = 0
+        sample_time = recv_dic.get('time')
+        if sample_time is not None:
+            arrival = time.time() - elapsed_ns / 1e9
+            monitor.sample_age.record_us((arrival - sample_time) * 1e6)
+            monitor.check_time(sample_time)
+        if stream_name == 'eeg':
+            monitor.check_counter(int(recv_dic['eeg'][EEG_COUNTER_INDEX]))
+
+    def on_emit(self, event_name, duration_ns):
+        histogram = self.handlers.get(event_name)
+        if histogram is None:
+            histogram = self.handlers[event_name] = LatencyHistogram()
+        histogram.record_ns(duration_ns)
+
+    def snapshot(self):
+        return {
+            'uptime_s': time.time() - self.started,
+            'streams': {name: m.snapshot() for name, m in list(self.streams.items())},
+            'handlers': {name: h.snapshot() for name, h in list(self.handlers.items())},
+        }
+
+
+def _prometheus_histogram(lines, name, labels, snapshot):
+    cumulative = 0
+    for bound, n in zip(BUCKET_BOUNDS_US + (float('inf'),), snapshot['buckets_us']):
+        cumulative += n
+        le = '+Inf' if bound == float('inf') else repr(bound / 1e6)
+        lines.append('{0}_bucket{{{1},le="{2}"}} {3}'.format(name, labels, le, cumulative))
+    lines.append('{0}_sum{{{1}}} {2}'.format(name, labels, snapshot['mean_ms'] * snapshot['count'] / 1000.0))
+    lines.append('{0}_count{{{1}}} {2}'.format(name, labels, snapshot['count']))
+
+
+def format_prometheus(stats, prefix='emorobots'):
+    """Render the dictionary returned by Cortex.get_stats() in the Prometheus text format."""
+    lines = []
+    for name, s in stats.get('streams', {}).items():
+        labels = 'stream="{0}"'.format(name)
+        lines.append('{0}_stream_samples_total{{{1}}} {2}'.format(prefix, labels, s['samples']))
+        lines.append('{0}_stream_gaps_total{{{1}}} {2}'.format(prefix, labels, s['gaps']))
+        if 'missing_samples' in s:
+            lines.append('{0}_stream_missing_samples_total{{{1}}} {2}'.format(prefix, labels, s['missing_samples']))
+        _prometheus_histogram(lines, prefix + '_stream_latency_seconds', labels, s['latency'])
+        _prometheus_histogram(lines, prefix + '_stream_sample_age_seconds', labels, s['sample_age'])
+    for name, h in stats.get('handlers', {}).items():
+        _prometheus_histogram(lines, prefix + '_handler_seconds', 'event="{0}"'.format(name), h)
+    dispatch = stats.get('dispatch')
+    if dispatch:
+        for key in ('queue_depth', 'max_depth', 'queue_size'):
+            lines.append('{0}_dispatch_{1} {2}'.format(prefix, key, dispatch[key]))
+        for key in ('enqueued', 'dropped', 'dispatched', 'errors'):
+            lines.append('{0}_dispatch_{1}_total {2}'.format(prefix, key, dispatch[key]))
+    parse = stats.get('parse')
+    if parse:
+        lines.append('{0}_messages_total {1}'.format(prefix, parse['messages']))
+        lines.append('{0}_decode_seconds_total {1}'.format(prefix, parse['decode_ns'] / 1e9))
+    return '\n'.join(lines) + '\n'
+
+
+def format_summary(stats):
+    """One line per stream for the periodic log."""
+    lines = []
+    for name, s in stats.get('streams', {}).items():
+        latency = s['latency']
+        line = '  {0}: {1} samples, latency p50 {2:.2f} ms p99 {3:.2f} ms max {4:.2f} ms, gaps {5}'.format(
+            name, s['samples'], latency['p50_ms'], latency['p99_ms'], latency['max_ms'], s['gaps'])
+        if 'missing_samples' in s:
+            line += ', missing {0}'.format(s['missing_samples'])
+        lines.append(line)
+    dispatch = stats.get('dispatch')
+    if dispatch:
+        lines.append('  dispatch: depth {0}/{1} (max {2}), dropped {3}'.format(
+            dispatch['queue_depth'], dispatch['queue_size'], dispatch['max_depth'], dispatch['dropped']))
+    return '\n'.join(lines)
+
+
+class StatsReporter:
+    """Periodic stats log and/or Prometheus endpoint for a stats_fn such as Cortex.get_stats."""
+
+    def __init__(self, stats_fn, log_interval=None, port=None, host='127.0.0.1'):
+        self.stats_fn = stats_fn
+        self.log_interval = log_interval
+        self.port = port
+        self.host = host
+        self.server = None
+        self._stopping = threading.Event()
+        self._threads = []
+
+    def start(self):
+        self._stopping.clear()
+        if self.log_interval:
+            thread = threading.Thread(target=self._log_loop, name="StatsLogThread", daemon=True)
+            thread.start()
+            self._threads.append(thread)
+        if self.port is not None:
+            stats_fn = self.stats_fn
+
+            class MetricsHandler(BaseHTTPRequestHandler):
+                def do_GET(self):
+                    if self.path.split('?')[0] != '/metrics':
+                        self.send_error(404)
+                        return
+                    body = format_prometheus(stats_fn()).encode('utf-8')
+                    self.send_response(200)
+                    self.send_header('Content-Type', 'text/plain; version=0.0.4')
+                    self.send_header('Content-Length', str(len(body)))
+                    self.end_headers()
+                    self.wfile.write(body)
+
+                def log_message(self, *args):
+                    pass
+
+            self.server = ThreadingHTTPServer((self.host, self.port), MetricsHandler)
+            thread = threading.Thread(target=self.server.serve_forever, name="StatsHttpThread", daemon=True)
+            thread.start()
+            self._threads.append(thread)
+            print('stats endpoint on http://{0}:{1}/metrics'.format(self.host, self.server.server_port))
+
+    def _log_loop(self):
+        while not self._stopping.wait(self.log_interval):
+            print('stream stats ---------------------------------')
+            print(format_summary(self.stats_fn()))
+
+    def stop(self):
+        self._stopping.set()
+        if self.server is not None:
+            self.server.shutdown()
+            self.server.server_close()
+            self.server = None
+        for thread in self._threads:
+            thread.join()
+        self._threads = []
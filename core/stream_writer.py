@@ -0,0 +1,160 @@
+import time
+import threading
+from core.stream_buffer import StreamBuffer
+from core.session_format import open_stream_file, stream_filename
+
+
+class StreamWriter:
+    """
+    Background writer that appends collected samples to disk while the
+    collection is still running.
+
+    Every flush_interval seconds the writer thread drains each stream buffer
+    and appends the batch to data_{stream}_{timestamp}.{format}. Files are
+    flushed after every batch and fsync'ed at most every fsync_interval
+    seconds, so a crash loses at most that much data.
+
+    A batch is only released from its buffer after it was written. When a
+    write fails (disk full, I/O error, encoder error) the batch stays pending,
+    is retried on the next cycle together with the newer samples, and the
+    failure is counted in get_stats(). A batch that failed halfway may be
+    partly written twice.
+
+    Numeric streams are written in file_format ('csv', 'npy' or the
+    compressed 'ezs', see core.session_format); fac, com and sys always go
+    to CSV because they hold text.
+
+    When max_pending is set, each StreamBuffer blocks its producer once that
+    many samples are waiting to be written, and wakes the writer immediately.
+
+    Buffers are keyed by stream name. A caller writing several sources with
+    one writer (see core.cortex_pool) uses its own keys and passes
+    filename_fn(key, file_format) to place the files.
+    """
+
+    def __init__(self, buffers, header_fn, output_directory, timestamp,
+                 flush_interval=1.0, fsync_interval=5.0, max_pending=None,
+                 file_format='csv', value_dtype=None, metadata_fn=None, filename_fn=None):
+        self.buffers = buffers
+        self.header_fn = header_fn
+        self.output_directory = output_directory
+        self.timestamp = timestamp
+        self.flush_interval = flush_interval
+        self.fsync_interval = fsync_interval
+        self.max_pending = max_pending
+        self.file_format = file_format
+        self.value_dtype = value_dtype
+        self.metadata_fn = metadata_fn
+        self.filename_fn = filename_fn
+
+        self.files = {}
+        self.samples_written = {}
+        self._list_pos = {}
+        self.write_errors = {}
+        self.last_error = None
+        self._last_fsync = time.time()
+        self._wake = threading.Event()
+        self._stopping = False
+        self._thread = None
+
+    def start(self):
+        for buf in self.buffers.values():
+            if isinstance(buf, StreamBuffer):
+                buf.max_pending = self.max_pending
+                buf.on_backpressure = self._wake.set
+        self._thread = threading.Thread(target=self._run, name="StreamWriterThread", daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        """Stop the writer thread, write what is left and close all files."""
+        self._stopping = True
+        self._wake.set()
+        if self._thread is not None:
+            self._thread.join()
+        for buf in self.buffers.values():
+            if isinstance(buf, StreamBuffer):
+                buf.max_pending = None
+                buf.on_backpressure = None
+        self.drain()
+        for f in self.files.values():
+            f.close()
+        self.files = {}
+
+    def _run(self):
+        while not self._stopping:
+            self._wake.wait(self.flush_interval)
+            self._wake.clear()
+            try:
+                self.drain()
+                if time.time() - self._last_fsync >= self.fsync_interval:
+                    self._fsync()
+            except Exception as e:
+                print(f"❌ Stream writer error: {e}")
+
+    def _peek(self, stream_name, buf):
+        """Pending rows of a stream and a function that marks them written."""
+        if isinstance(buf, StreamBuffer):
+            rows, start, end = buf.peek_pending()
+            return rows, lambda: buf.commit_drained(start, end)
+        # plain list (sys events): remember how far it has been written
+        start = self._list_pos.get(stream_name, 0)
+        end = len(buf)
+        return buf[start:end], lambda: self._list_pos.__setitem__(stream_name, end)
+
+    def format_for(self, stream_name):
+        buf = self.buffers[stream_name]
+        if isinstance(buf, StreamBuffer) and buf.dtype.kind == 'f':
+            return self.file_format
+        return 'csv'
+
+    def _file_for(self, stream_name):
+        if stream_name not in self.files:
+            file_format = self.format_for(stream_name)
+            if self.filename_fn is not None:
+                filename = self.filename_fn(stream_name, file_format)
+            else:
+                filename = stream_filename(self.output_directory, stream_name, self.timestamp, file_format)
+            kwargs = {}
+            if file_format in ('npy', 'ezs'):
+                if self.value_dtype is not None:
+                    kwargs['value_dtype'] = self.value_dtype
+                kwargs['metadata'] = self.metadata_fn(stream_name) if self.metadata_fn else None
+            self.files[stream_name] = open_stream_file(file_format, filename,
+                                                       self.header_fn(stream_name), **kwargs)
+            self.samples_written[stream_name] = 0
+            print(f"  - Streaming {stream_name} samples to {filename}")
+        return self.files[stream_name]
+
+    def drain(self):
+        """Append every pending sample of every stream to its file."""
+        for stream_name, buf in self.buffers.items():
+            rows, commit = self._peek(stream_name, buf)
+            if len(rows) == 0:
+                continue
+            try:
+                f = self._file_for(stream_name)
+                f.write(rows)
+                f.flush()
+            except Exception as e:
+                # keep the rows pending: they are written again on the next drain
+                self.write_errors[stream_name] = self.write_errors.get(stream_name, 0) + 1
+                self.last_error = f"{stream_name}: {e}"
+                print(f"❌ Stream writer error ({stream_name}, {len(rows)} samples kept for retry): {e}")
+                continue
+            commit()
+            self.samples_written[stream_name] += len(rows)
+
+    def get_stats(self):
+        """Samples written and failed writes per stream, and samples lost before they could be written."""
+        return {
+            'samples_written': dict(self.samples_written),
+            'write_errors': dict(self.write_errors),
+            'pending': {name: buf.pending for name, buf in self.buffers.items() if isinstance(buf, StreamBuffer)},
+            'lost': {name: buf.lost for name, buf in self.buffers.items() if isinstance(buf, StreamBuffer)},
+            'last_error': self.last_error,
+        }
+
+    def _fsync(self):
+        for f in self.files.values():
+            f.fsync()
+        self._last_fsync = time.time()
@@ -0,0 +1,115 @@
+"""
+Synthetic Cortex stream messages for benchmarks and the mock Cortex server.
+
+SyntheticSession produces messages with the same layout as the Cortex
+subscription stream ({"eeg": [...], "sid": ..., "time": t}) at configurable
+rates and channel counts, with reproducible content for a given seed:
+eeg is a 10 Hz alpha rhythm plus noise around the Emotiv 4200 uV offset,
+mot a slowly rotating quaternion, met and pow smooth random walks.
+"""
+import heapq
+import json
+import time
+import numpy as np
+
+EMOTIV_CHANNELS = ['AF3', 'F7', 'F3', 'FC5', 'T7', 'P7', 'O1', 'O2', 'P8', 'T8', 'FC6', 'F4', 'F8', 'AF4']
+POW_BANDS = ['theta', 'alpha', 'betaL', 'betaH', 'gamma']
+MET_COLUMNS = ['eng.isActive', 'eng', 'exc.isActive', 'exc', 'lex', 'str.isActive', 'str',
+               'rel.isActive', 'rel', 'int.isActive', 'int', 'foc.isActive', 'foc']
+MOT_COLUMNS = ['COUNTER_MEMS', 'INTERPOLATED_MEMS', 'Q0', 'Q1', 'Q2', 'Q3',
+               'ACCX', 'ACCY', 'ACCZ', 'MAGX', 'MAGY', 'MAGZ']
+
+DEFAULT_RATES = {'eeg': 128.0, 'mot': 64.0, 'dev': 2.0, 'met': 2.0, 'pow': 8.0}
+
+
+class SyntheticSession:
+    """Reproducible Cortex stream generator."""
+
+    def __init__(self, channels=14, rates=None, seed=0, start_time=None, session_id='synthetic-session'):
+        if isinstance(channels, int):
+            self.channels = EMOTIV_CHANNELS[:channels] + ['CH{0}'.format(i) for i in range(len(EMOTIV_CHANNELS), channels)]
+        else:
+            self.channels = list(channels)
+        self.rates = dict(DEFAULT_RATES)
+        if rates:
+            self.rates.update(rates)
+        self.seed = seed
+        self.start_time = time.time() if start_time is None else start_time
+        self.session_id = session_id
+
+    def columns(self, stream_name):
+        """The 'cols' of a stream as returned by a Cortex subscribe request."""
+        if stream_name == 'eeg':
+            return ['COUNTER', 'INTERPOLATED'] + self.channels + ['RAW_CQ', 'MARKER_HARDWARE', 'MARKERS']
+        if stream_name == 'mot':
+            return list(MOT_COLUMNS)
+        if stream_name == 'met':
+            return list(MET_COLUMNS)
+        if stream_name == 'pow':
+            return ['{0}/{1}'.format(ch, band) for ch in self.channels for band in POW_BANDS]
+        if stream_name == 'dev':
+            return ['Battery', 'Signal', self.channels + ['OVERALL'], 'BatteryPercent']
+        raise ValueError('No synthetic data for stream ' + str(stream_name))
+
+    def subscribe_result(self, streams):
+        """The result of a subscribe request for the given streams."""
+        success = [{'streamName': s, 'cols': self.columns(s), 'sid': self.session_id}
+                   for s in streams if s in self.rates]
+        failure = [{'streamName': s, 'code': -32016, 'message': 'Synthetic stream not available'}
+                   for s in streams if s not in self.rates]
+        return {'success': success, 'failure': failure}
+
+    def stream_values(self, stream_name, n_samples):
+        """(times, rows) for the first n_samples of one stream, rows as Python lists."""
+        rng = np.random.default_rng([self.seed, sorted(self.rates).index(stream_name)])
+        rate = self.rates[stream_name]
+        t = np.arange(n_samples) / rate
+        times = (self.start_time + t).tolist()
+
+        if stream_name == 'eeg':
+            n_ch = len(self.channels)
+            phase = rng.uniform(0, 2 * np.pi, n_ch)
+            values = 4200.0 + 20.0 * np.sin(2 * np.pi * 10.0 * t[:, None] + phase) + rng.normal(0, 5.0, (n_samples, n_ch))
+            counter = np.arange(n_samples) % int(rate)
+            rows = np.column_stack([counter, np.zeros(n_samples), values,
+                                    np.zeros(n_samples), np.zeros(n_samples)]).tolist()
+            for row in rows:
+                row.append([])  # MARKERS
+            return times, rows
+        if stream_name == 'mot':
+            angle = 0.2 * np.sin(2 * np.pi * 0.1 * t)
+            quat = np.column_stack([np.cos(angle / 2), np.zeros(n_samples), np.sin(angle / 2), np.zeros(n_samples)])
+            acc = rng.normal(0, 0.02, (n_samples, 3)) + [0.0, 0.0, 1.0]
+            mag = rng.normal(0, 1.0, (n_samples, 3)) + [20.0, -5.0, 40.0]
+            counter = np.arange(n_samples) % int(rate)
+            return times, np.column_stack([counter, np.zeros(n_samples), quat, acc, mag]).tolist()
+        if stream_name == 'met':
+            walk = np.clip(0.5 + np.cumsum(rng.normal(0, 0.02, (n_samples, 7)), axis=0), 0.0, 1.0)
+            rows = []
+            for eng, exc, lex, stress, rel, interest, foc in walk.tolist():
+                rows.append([True, eng, True, exc, lex, True, stress, True, rel, True, interest, True, foc])
+            return times, rows
+        if stream_name == 'pow':
+            width = len(self.channels) * len(POW_BANDS)
+            walk = np.abs(1.0 + np.cumsum(rng.normal(0, 0.05, (n_samples, width)), axis=0))
+            return times, walk.tolist()
+        if stream_name == 'dev':
+            cq = [4] * (len(self.channels) + 1)
+            rows = [[4, 1.0, list(cq), max(0, 100 - i // 600)] for i in range(n_samples)]
+            return times, rows
+        raise ValueError('No synthetic data for stream ' + str(stream_name))
+
+    def messages(self, duration, streams=None):
+        """All stream messages of duration seconds, merged in time order."""
+        streams = streams or list(DEFAULT_RATES)
+        per_stream = []
+        for stream_name in streams:
+            n_samples = int(duration * self.rates[stream_name])
+            times, rows = self.stream_values(stream_name, n_samples)
+            per_stream.append([(t, i, stream_name, row) for i, (t, row) in enumerate(zip(times, rows))])
+        for t, _, stream_name, row in heapq.merge(*per_stream):
+            yield {stream_name: row, 'sid': self.session_id, 'time': t}
+
+    def encoded_messages(self, duration, streams=None):
+        """messages() as JSON text frames, as received by Cortex.on_message."""
+        return [json.dumps(message) for message in self.messages(duration, streams)]
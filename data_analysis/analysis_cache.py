@@ -0,0 +1,217 @@
+"""
+Analysis Cache Module
+
+Memoisation and a small task-graph executor for the analysis pipeline:
+- AnalysisCache stores intermediate results (filtered EEG, Euler angles,
+  synchronized frames, ...) on disk, keyed on the content hash of the input
+  files and the parameters that produced them, so a re-run only recomputes
+  what depends on changed files or parameters.
+- TaskGraph runs a set of dependent tasks, independent ones in parallel
+  worker processes.
+"""
+
+import os
+import json
+import pickle
+import hashlib
+import tempfile
+from concurrent.futures import ProcessPoolExecutor, wait, FIRST_COMPLETED
+from typing import Any, Callable, Dict, Iterable, Optional
+
+# Bump when the layout of cached results changes
+CACHE_VERSION = 1
+DEFAULT_CACHE_DIR = '.analysis_cache'
+
+
+class AnalysisCache:
+    """Content-addressed on-disk cache of analysis results."""
+
+    def __init__(self, cache_dir: Optional[str] = DEFAULT_CACHE_DIR):
+        """
+        Initialize the cache.
+
+        Args:
+            cache_dir: Directory for cached results, None keeps results in memory only
+        """
+        self.cache_dir = cache_dir
+        self.memory = {}
+        self.hits = 0
+        self.misses = 0
+        self._digests = {}
+        self._index_path = None
+        if cache_dir:
+            os.makedirs(cache_dir, exist_ok=True)
+            self._index_path = os.path.join(cache_dir, 'file_digests.json')
+            try:
+                with open(self._index_path) as f:
+                    self._digests = json.load(f)
+            except (OSError, ValueError):
+                self._digests = {}
+
+    def __getstate__(self):
+        # worker processes share the files on disk, not the in-memory results
+        state = self.__dict__.copy()
+        state['memory'] = {}
+        return state
+
+    def file_digest(self, path: str) -> str:
+        """
+        SHA-256 of a file's content.
+
+        Digests are remembered per (path, size, mtime), so unchanged files are
+        hashed only once across runs.
+        """
+        path = os.path.abspath(path)
+        st = os.stat(path)
+        stamp = f"{st.st_size}:{st.st_mtime_ns}"
+        if not self.cache_dir:
+            # in-memory results never outlive the files, the stamp is enough
+            return f"{path}:{stamp}"
+        entry = self._digests.get(path)
+        if entry and entry[0] == stamp:
+            return entry[1]
+
+        sha = hashlib.sha256()
+        with open(path, 'rb') as f:
+            for block in iter(lambda: f.read(1 << 20), b''):
+                sha.update(block)
+        digest = sha.hexdigest()
+        self._digests[path] = [stamp, digest]
+        self._save_index()
+        return digest
+
+    def _save_index(self):
+        if not self._index_path:
+            return
+        try:
+            fd, tmp_path = tempfile.mkstemp(dir=self.cache_dir, suffix='.tmp')
+            with os.fdopen(fd, 'w') as f:
+                json.dump(self._digests, f)
+            os.replace(tmp_path, self._index_path)
+        except OSError as e:
+            print(f"Cannot write cache index: {e}")
+
+    def key(self, name: str, files: Iterable[str] = (), params: Optional[Dict] = None) -> str:
+        """Cache key of a result from the given input files and parameters."""
+        payload = {
+            'version': CACHE_VERSION,
+            'name': name,
+            'files': [self.file_digest(path) for path in sorted(files)],
+            'params': params or {}
+        }
+        return hashlib.sha256(json.dumps(payload, sort_keys=True, default=str).encode()).hexdigest()
+
+    def _path(self, name: str, key: str) -> str:
+        return os.path.join(self.cache_dir, f"{name}-{key[:20]}.pkl")
+
+    def get_or_compute(self, name: str, compute: Callable[[], Any], files: Iterable[str] = (),
+                       params: Optional[Dict] = None) -> Any:
+        """
+        Return the cached result for (name, files, params), computing and storing it on a miss.
+
+        Args:
+            name: Result name, e.g. 'euler_angles'
+            compute: Function called without arguments on a miss
+            files: Input files the result depends on
+            params: Parameters the result depends on (JSON-serialisable)
+
+        Returns:
+            The (possibly cached) result
+        """
+        key = self.key(name, files, params)
+        if key in self.memory:
+            self.hits += 1
+            return self.memory[key]
+
+        if self.cache_dir:
+            path = self._path(name, key)
+            if os.path.exists(path):
+                try:
+                    with open(path, 'rb') as f:
+                        result = pickle.load(f)
+                    self.hits += 1
+                    self.memory[key] = result
+                    return result
+                except (OSError, pickle.UnpicklingError, EOFError) as e:
+                    print(f"Ignoring unreadable cache entry {path}: {e}")
+
+        self.misses += 1
+        result = compute()
+        self.memory[key] = result
+        if self.cache_dir:
+            fd, tmp_path = tempfile.mkstemp(dir=self.cache_dir, suffix='.tmp')
+            with os.fdopen(fd, 'wb') as f:
+                pickle.dump(result, f, protocol=pickle.HIGHEST_PROTOCOL)
+            os.replace(tmp_path, self._path(name, key))
+        return result
+
+
+class TaskGraph:
+    """
+    Dependency graph of analysis tasks.
+
+    Each task is called as fn(*args, *dependency_results). Tasks marked local
+    run in the calling process (for work on shared state such as figures
+    built from several results); the others must be picklable module-level
+    functions and run in worker processes when n_jobs > 1. Local tasks run
+    while the workers are busy.
+    """
+
+    def __init__(self):
+        self.tasks = {}
+
+    def add(self, name: str, fn: Callable, args: tuple = (), deps: Iterable[str] = (),
+            local: bool = False) -> None:
+        deps = list(deps)
+        unknown = [dep for dep in deps if dep not in self.tasks]
+        if unknown:
+            raise ValueError(f"Task {name} depends on unknown tasks {unknown}")
+        self.tasks[name] = {'fn': fn, 'args': tuple(args), 'deps': deps, 'local': local}
+
+    def _call(self, name: str, results: Dict[str, Any]) -> Any:
+        task = self.tasks[name]
+        return task['fn'](*task['args'], *[results[dep] for dep in task['deps']])
+
+    def run(self, n_jobs: int = 1) -> Dict[str, Any]:
+        """
+        Run every task once its dependencies are done.
+
+        Args:
+            n_jobs: Worker processes for non-local tasks, 1 runs everything in
+                    this process in insertion order
+
+        Returns:
+            Dictionary of task name -> result
+        """
+        results = {}
+        if n_jobs <= 1:
+            # tasks can only depend on earlier tasks, so insertion order is a valid order
+            for name in self.tasks:
+                results[name] = self._call(name, results)
+            return results
+
+        pending = list(self.tasks)
+        running = {}
+        with ProcessPoolExecutor(max_workers=n_jobs) as executor:
+            while pending or running:
+                ready = [name for name in pending if all(dep in results for dep in self.tasks[name]['deps'])]
+                for name in ready:
+                    if not self.tasks[name]['local']:
+                        task = self.tasks[name]
+                        args = task['args'] + tuple(results[dep] for dep in task['deps'])
+                        running[executor.submit(task['fn'], *args)] = name
+                        pending.remove(name)
+
+                local_ready = [name for name in ready if self.tasks[name]['local']]
+                if local_ready:
+                    name = local_ready[0]
+                    pending.remove(name)
+                    results[name] = self._call(name, results)
+                    continue
+
+                if not running:
+                    raise RuntimeError(f"Tasks {pending} can never run")
+                done, _ = wait(list(running), return_when=FIRST_COMPLETED)
+                for future in done:
+                    results[running.pop(future)] = future.result()
+        return results
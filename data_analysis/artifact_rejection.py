@@ -0,0 +1,176 @@
+"""
+Motion Artifact Rejection Module
+
+Finds the EEG windows contaminated by head movement in recorded sessions
+and masks or regresses them out before the EEG analysis. The movement
+features, window merging and regression are the vectorized kernels of
+core/motion_artifacts.py, which also run live as MotionArtifactFilter on
+the Cortex event pipeline, so offline and online cleaning agree.
+"""
+
+import os
+import sys
+import numpy as np
+import pandas as pd
+from typing import Dict, Optional, Tuple
+
+from data_loader import DataLoader
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.motion_artifacts import (REJECTION_MODES, QUATERNION_LABELS, ACCELEROMETER_LABELS,
+                                   motion_features, flag_windows, window_mask, fit_regression, regress_out)
+
+
+class MotionArtifactRejector:
+    """Batch motion-artifact rejection over the loaded EEG and motion data."""
+
+    def __init__(self, data_loader: DataLoader, mode: str = 'mask', pad_before: float = 0.25,
+                 pad_after: float = 0.5, angular_speed_threshold: float = 30.0,
+                 jerk_threshold: float = 2.0, ridge: float = 1e-3):
+        """
+        Initialize the rejector.
+
+        Args:
+            data_loader: DataLoader with eeg and mot data loaded
+            mode: 'mask' sets contaminated EEG samples to NaN (the analyzers drop
+                  them), 'regress' subtracts the motion-explained part there
+            pad_before, pad_after: Seconds of EEG contaminated before and after
+                                   each moving motion sample
+            angular_speed_threshold: Head rotation speed (deg/s) that counts as movement
+            jerk_threshold: Change of the acceleration magnitude per second that counts as movement
+            ridge: Relative ridge of the regression
+        """
+        if mode not in REJECTION_MODES:
+            raise ValueError(f"Unknown mode {mode}. Use one of {REJECTION_MODES}")
+        self.data_loader = data_loader
+        self.mode = mode
+        self.pad_before = pad_before
+        self.pad_after = pad_after
+        self.angular_speed_threshold = angular_speed_threshold
+        self.jerk_threshold = jerk_threshold
+        self.ridge = ridge
+        self.features = None
+        self.windows = None
+
+    @property
+    def params(self) -> Dict:
+        """Parameters that change the cleaned data (for cache keys)."""
+        return {'mode': self.mode, 'pad_before': self.pad_before, 'pad_after': self.pad_after,
+                'angular_speed_threshold': self.angular_speed_threshold,
+                'jerk_threshold': self.jerk_threshold, 'ridge': self.ridge}
+
+    def compute_features(self) -> pd.DataFrame:
+        """
+        Movement features of every motion sample.
+
+        Returns:
+            DataFrame indexed like the motion data with angular_speed (deg/s), jerk,
+            the accelerometer reference columns and a moving flag
+        """
+        if self.features is not None:
+            return self.features
+        mot = self.data_loader.loaded_data.get('mot', pd.DataFrame())
+        if mot.empty or not all(col in mot.columns for col in QUATERNION_LABELS + ACCELEROMETER_LABELS):
+            self.features = pd.DataFrame()
+            return self.features
+
+        mot = mot[QUATERNION_LABELS + ACCELEROMETER_LABELS].dropna()
+        times = mot.index.asi8 / 1e9
+        angular_speed, jerk, reference = motion_features(
+            times, mot[QUATERNION_LABELS].to_numpy(dtype=np.float64),
+            mot[ACCELEROMETER_LABELS].to_numpy(dtype=np.float64))
+        features = pd.DataFrame(reference, index=mot.index, columns=ACCELEROMETER_LABELS + ['angular_speed'])
+        features['jerk'] = jerk
+        features['moving'] = (angular_speed > self.angular_speed_threshold) | (jerk > self.jerk_threshold)
+        self.features = features
+        return features
+
+    def detect_windows(self) -> pd.DataFrame:
+        """
+        Contaminated windows, in the layout of DataLoader.get_bad_segments.
+
+        Returns:
+            DataFrame with start, end, reason ('motion') and channels (empty: all)
+        """
+        if self.windows is not None:
+            return self.windows
+        features = self.compute_features()
+        if features.empty:
+            starts, ends = np.empty(0), np.empty(0)
+        else:
+            starts, ends = flag_windows(features.index.asi8 / 1e9, features['moving'].to_numpy(),
+                                        self.pad_before, self.pad_after)
+        self.windows = pd.DataFrame({
+            'start': pd.to_datetime(starts, unit='s'),
+            'end': pd.to_datetime(ends, unit='s'),
+            'reason': 'motion',
+            'channels': [[] for _ in range(len(starts))]
+        }, columns=['start', 'end', 'reason', 'channels'])
+        return self.windows
+
+    def contamination_mask(self, index: pd.DatetimeIndex) -> np.ndarray:
+        """Boolean mask of the timestamps inside a contaminated window."""
+        windows = self.detect_windows()
+        return window_mask(index.asi8 / 1e9, windows['start'].to_numpy().astype('datetime64[ns]').astype(np.int64) / 1e9,
+                           windows['end'].to_numpy().astype('datetime64[ns]').astype(np.int64) / 1e9)
+
+    def clean_eeg(self, eeg: Optional[pd.DataFrame] = None) -> Tuple[pd.DataFrame, np.ndarray]:
+        """
+        Cleaned copy of the EEG.
+
+        Args:
+            eeg: EEG frame indexed by timestamp (default: loaded_data['eeg'])
+
+        Returns:
+            Tuple of (cleaned frame, contamination mask per row)
+        """
+        if eeg is None:
+            eeg = self.data_loader.loaded_data.get('eeg', pd.DataFrame())
+        if eeg.empty or not isinstance(eeg.index, pd.DatetimeIndex):
+            return eeg, np.zeros(len(eeg), dtype=bool)
+
+        contaminated = self.contamination_mask(eeg.index)
+        if not contaminated.any():
+            return eeg, contaminated
+        channels = [channel for channel in self.data_loader.get_eeg_channels() if channel in eeg.columns]
+        cleaned = eeg.copy()
+
+        if self.mode == 'mask':
+            cleaned.loc[contaminated, channels] = np.nan
+            return cleaned, contaminated
+
+        # regress: reference interpolated to the EEG times, fitted on the whole session
+        features = self.compute_features()
+        reference_columns = ACCELEROMETER_LABELS + ['angular_speed']
+        eeg_times = eeg.index.asi8 / 1e9
+        feature_times = features.index.asi8 / 1e9
+        reference = np.column_stack([np.interp(eeg_times, feature_times, features[col].to_numpy())
+                                     for col in reference_columns])
+        x = eeg[channels].to_numpy(dtype=np.float64)
+        valid = ~np.isnan(x).any(axis=1)
+        weights, reference_mean = fit_regression(reference[valid], x[valid], self.ridge)
+        rows = contaminated & valid
+        cleaned.loc[rows, channels] = regress_out(x[rows], reference[rows], weights, reference_mean)
+        return cleaned, contaminated
+
+    def apply(self) -> Dict[str, float]:
+        """
+        Replace loaded_data['eeg'] of the loader with the cleaned EEG, so every
+        analyzer built on it afterwards only sees clean data.
+
+        Returns:
+            Summary with the number of windows and the contaminated share of samples
+        """
+        cleaned, contaminated = self.clean_eeg()
+        if len(cleaned):
+            self.data_loader.loaded_data['eeg'] = cleaned
+        windows = self.detect_windows()
+        summary = {
+            'windows': len(windows),
+            'contaminated_ratio': float(contaminated.mean()) if len(contaminated) else 0.0,
+            'contaminated_seconds': float((windows['end'] - windows['start']).dt.total_seconds().sum())
+                                    if len(windows) else 0.0
+        }
+        print(f"Motion artifacts ({self.mode}): {summary['windows']} windows, "
+              f"{summary['contaminated_ratio']:.1%} of EEG samples")
+        return summary
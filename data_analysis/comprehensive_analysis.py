@@ -14,6 +14,9 @@ from datetime import datetime
 from typing import Dict, List, Optional
 
 from data_loader import DataLoader, load_session_data
+from analysis_cache import AnalysisCache, TaskGraph
+from plot_decimation import DEFAULT_MAX_POINTS, decimated_trace
+from artifact_rejection import MotionArtifactRejector
 from eeg_analysis import EEGAnalyzer
 from mental_state_analysis import MentalStateAnalyzer
 from motion_analysis import MotionAnalyzer
@@ -22,15 +25,32 @@ from motion_analysis import MotionAnalyzer
 class ComprehensiveAnalyzer:
     """Integrated analysis across all data types."""
     
-    def __init__(self, data_directory: str):
+    def __init__(self, data_directory: str, cache_dir: Optional[str] = None,
+                 motion_rejection: Optional[str] = None):
         """
         Initialize comprehensive analyzer.
         
         Args:
             data_directory: Path to collected_data folder
+            cache_dir: Directory for cached intermediate results (filtered EEG, Euler
+                       angles, synchronized frames), keyed on input file hashes and
+                       parameters; None caches in memory for this run only
+            motion_rejection: 'mask' or 'regress' cleans the EEG of motion artifacts
+                              before any analysis (see artifact_rejection.py), None keeps it raw
         """
         self.data_directory = data_directory
         self.loader, self.data = load_session_data(data_directory)
+        self.cache = AnalysisCache(cache_dir)
+        
+        self.artifact_rejector = None
+        self.motion_artifacts = {}
+        if motion_rejection:
+            self.artifact_rejector = MotionArtifactRejector(self.loader, mode=motion_rejection)
+            self.motion_artifacts = self.artifact_rejector.apply()
+            self.data = self.loader.loaded_data
+        
+        # synchronize_all_data results of this session, by (method, target_rate)
+        self.synchronized = {}
         
         # Initialize individual analyzers
         self.analyzers = {}
@@ -44,9 +64,31 @@ class ComprehensiveAnalyzer:
         if 'mot' in self.data and not self.data['mot'].empty:
             self.analyzers['motion'] = MotionAnalyzer(self.loader)
     
-    def synchronize_all_data(self) -> pd.DataFrame:
-        """Synchronize all data types to common timebase."""
-        return self.loader.synchronize_data()
+    def synchronize_all_data(self, method: str = 'nearest',
+                             target_rate: Optional[float] = None) -> pd.DataFrame:
+        """
+        Synchronize all data types to common timebase (see DataLoader.synchronize_data).
+        
+        The result is kept per (method, target_rate), so the report sections
+        that read it synchronize once.
+        """
+        key = (method, target_rate)
+        if key not in self.synchronized:
+            self.synchronized[key] = self.cache.get_or_compute(
+                'synchronized',
+                lambda: self.loader.synchronize_data(method=method, target_rate=target_rate),
+                files=self._input_files(*self.loader.data_types),
+                params={'method': method, 'target_rate': target_rate, 'cleaning': self._cleaning_params()}
+            )
+        return self.synchronized[key]
+    
+    def _cleaning_params(self) -> Optional[Dict]:
+        """Parameters of the EEG cleaning, part of the cache key of results computed from EEG."""
+        return self.artifact_rejector.params if self.artifact_rejector is not None else None
+    
+    def _input_files(self, *data_types: str) -> List[str]:
+        """Files behind the loaded data of the given types."""
+        return [path for data_type in data_types for path in self.loader.loaded_files.get(data_type, [])]
     
     def analyze_eeg_mental_correlations(self) -> Dict[str, pd.DataFrame]:
         """
@@ -170,8 +212,13 @@ class ComprehensiveAnalyzer:
                     
         return results
     
-    def create_integrated_dashboard(self) -> go.Figure:
-        """Create comprehensive dashboard with all analysis types."""
+    def create_integrated_dashboard(self, max_points: Optional[int] = DEFAULT_MAX_POINTS) -> go.Figure:
+        """
+        Create comprehensive dashboard with all analysis types.
+        
+        Args:
+            max_points: Samples drawn per time series (min/max decimated), None draws all
+        """
         # Calculate number of available analyzers
         n_analyzers = len(self.analyzers)
         
@@ -217,7 +264,8 @@ class ComprehensiveAnalyzer:
                 if channel in eeg_analyzer.eeg_data.columns:
                     eeg_data = eeg_analyzer.eeg_data[channel].dropna()
                     if len(eeg_data) > 100:
-                        filtered_data = eeg_analyzer.preprocess_signal(eeg_data)
+                        # filtered once by analyze_all_channels, shared with the EEG report
+                        filtered_data = eeg_analyzer.filtered_frame()[channel]
                         
                         # Calculate alpha power in windows
                         window_size = min(len(filtered_data) // 10, 1000)
@@ -251,8 +299,8 @@ class ComprehensiveAnalyzer:
                         data = mental_analyzer.mental_data[metric].dropna()
                         if len(data) > 0:
                             fig.add_trace(
-                                go.Scatter(x=data.index, y=data.values,
-                                         name=metric.capitalize(), mode='lines'),
+                                decimated_trace(data.index, data.values, max_points,
+                                                name=metric.capitalize(), mode='lines'),
                                 row=row, col=col
                             )
         
@@ -269,8 +317,8 @@ class ComprehensiveAnalyzer:
                 for angle_type in ['roll', 'pitch', 'yaw']:
                     if angle_type in angles.columns:
                         fig.add_trace(
-                            go.Scatter(x=angles.index, y=angles[angle_type],
-                                     name=angle_type.capitalize(), mode='lines'),
+                            decimated_trace(angles.index, angles[angle_type], max_points,
+                                            name=angle_type.capitalize(), mode='lines'),
                             row=row, col=col
                         )
         
@@ -391,90 +439,154 @@ class ComprehensiveAnalyzer:
                 ])
                 
                 f.write(f"  Average variability increase during motion: {avg_ratio:.2f}x\n")
+            
+            if self.motion_artifacts:
+                f.write(f"\nMotion Artifact Rejection ({self.artifact_rejector.mode}):\n")
+                f.write(f"  Contaminated windows: {self.motion_artifacts['windows']}\n")
+                f.write(f"  Contaminated EEG: {self.motion_artifacts['contaminated_ratio']:.1%} "
+                        f"({self.motion_artifacts['contaminated_seconds']:.1f} s)\n")
         
         return report_path
     
-    def run_full_analysis(self, output_dir: str = "output") -> Dict[str, str]:
+    def run_full_analysis(self, output_dir: str = "output", n_jobs: int = 1) -> Dict[str, str]:
         """
         Run complete analysis pipeline and save all outputs.
         
+        The EEG, mental state and motion analyses are independent tasks and run in
+        n_jobs worker processes; the data synchronization runs here meanwhile, and
+        the dashboard and comprehensive report (whose correlation sections read the
+        synchronized data) follow once their inputs are done.
+        Channel results and Euler angles come from the cache when the input files
+        and parameters are unchanged.
+        
         Args:
             output_dir: Directory to save analysis outputs
+            n_jobs: Worker processes (1 runs every step in this process)
             
         Returns:
             Dictionary with paths to generated files
         """
         os.makedirs(output_dir, exist_ok=True)
-        output_files = {}
         
         print("Running comprehensive analysis...")
         
-        # Generate individual analysis reports
+        graph = TaskGraph()
         if 'eeg' in self.analyzers:
-            print("- EEG analysis...")
-            eeg_report = self.analyzers['eeg'].generate_report(output_dir)
-            output_files['eeg_report'] = eeg_report
-            
-            # EEG visualizations
-            summary_fig = self.analyzers['eeg'].plot_all_channels_summary()
-            eeg_summary_path = os.path.join(output_dir, "eeg_analysis_summary.html")
-            summary_fig.write_html(eeg_summary_path)
-            output_files['eeg_summary'] = eeg_summary_path
-        
+            # cleaned EEG also depends on the motion files
+            eeg_inputs = self._input_files('eeg', 'mot') if self.artifact_rejector else self._input_files('eeg')
+            graph.add('eeg', _run_eeg_analysis,
+                      args=(self.analyzers['eeg'], self.cache, eeg_inputs, output_dir, self._cleaning_params()))
         if 'mental' in self.analyzers:
-            print("- Mental state analysis...")
-            mental_report = self.analyzers['mental'].generate_mental_state_report(output_dir)
-            output_files['mental_report'] = mental_report
-            
-            # Mental state visualizations
-            timeline_fig = self.analyzers['mental'].create_timeline_plot()
-            mental_timeline_path = os.path.join(output_dir, "mental_state_timeline.html")
-            timeline_fig.write_html(mental_timeline_path)
-            output_files['mental_timeline'] = mental_timeline_path
-        
+            graph.add('mental', _run_mental_analysis, args=(self.analyzers['mental'], output_dir))
         if 'motion' in self.analyzers:
-            print("- Motion analysis...")
-            motion_report = self.analyzers['motion'].generate_motion_report(output_dir)
-            output_files['motion_report'] = motion_report
-            
-            # Motion visualizations
-            motion_fig = self.analyzers['motion'].create_motion_timeline()
-            motion_timeline_path = os.path.join(output_dir, "motion_analysis_timeline.html")
-            motion_fig.write_html(motion_timeline_path)
-            output_files['motion_timeline'] = motion_timeline_path
+            graph.add('motion', _run_motion_analysis,
+                      args=(self.analyzers['motion'], self.cache, self._input_files('mot'), output_dir))
+        analyses = list(graph.tasks)
+        graph.add('sync', self.synchronize_all_data, local=True)
+        graph.add('integrated', self._run_integrated_analysis, args=(output_dir,), deps=['sync'] + analyses,
+                  local=True)
+        results = graph.run(n_jobs)
+        
+        output_files = {}
+        for name in analyses + ['integrated']:
+            output_files.update(results[name]['files'])
+        
+        print(f"Analysis complete! Results saved to {output_dir}")
+        if self.cache.cache_dir:
+            print(f"Cache: {self.cache.hits} hits, {self.cache.misses} misses in this process")
+        
+        return output_files
+    
+    def _run_integrated_analysis(self, output_dir: str, sync_data: pd.DataFrame, *analysis_results: Dict) -> Dict:
+        """Dashboard and comprehensive report, reusing what the sync and analysis tasks computed."""
+        # the report's correlation sections read the default synchronization
+        self.synchronized[('nearest', None)] = sync_data
+        # results of worker processes are copies; share them with the analyzers here
+        for result in analysis_results:
+            if 'channel_results' in result:
+                self.analyzers['eeg'].channel_results['matrix'] = result['channel_results']
+            if 'orientation' in result:
+                self.analyzers['motion'].orientation = result['orientation']
         
-        # Generate integrated analysis
         print("- Integrated analysis...")
+        output_files = {}
         dashboard_fig = self.create_integrated_dashboard()
         dashboard_path = os.path.join(output_dir, "comprehensive_dashboard.html")
         dashboard_fig.write_html(dashboard_path)
         output_files['dashboard'] = dashboard_path
         
         # Generate comprehensive report
-        comprehensive_report = self.generate_comprehensive_report(output_dir)
-        output_files['comprehensive_report'] = comprehensive_report
-        
-        print(f"Analysis complete! Results saved to {output_dir}")
-        
-        return output_files
+        output_files['comprehensive_report'] = self.generate_comprehensive_report(output_dir)
+        return {'files': output_files}
+
+
+# Analysis tasks of run_full_analysis. They are module-level so they can run in
+# worker processes; cached intermediates are returned to the calling process.
+
+def _run_eeg_analysis(analyzer: EEGAnalyzer, cache: AnalysisCache, files: List[str], output_dir: str,
+                      cleaning: Optional[Dict] = None) -> Dict:
+    print("- EEG analysis...")
+    params = {'sampling_rate': analyzer.sampling_rate, 'bands': analyzer.frequency_bands,
+              'channels': analyzer.channels, 'cleaning': cleaning}
+    analyzer.channel_results['matrix'] = cache.get_or_compute('eeg_channel_results', analyzer.analyze_all_channels,
+                                                              files=files, params=params)
+    output_files = {'eeg_report': analyzer.generate_report(output_dir)}
+    
+    # EEG visualizations
+    summary_fig = analyzer.plot_all_channels_summary()
+    eeg_summary_path = os.path.join(output_dir, "eeg_analysis_summary.html")
+    summary_fig.write_html(eeg_summary_path)
+    output_files['eeg_summary'] = eeg_summary_path
+    return {'files': output_files, 'channel_results': analyzer.channel_results['matrix']}
 
 
+def _run_mental_analysis(analyzer: MentalStateAnalyzer, output_dir: str) -> Dict:
+    print("- Mental state analysis...")
+    output_files = {'mental_report': analyzer.generate_mental_state_report(output_dir)}
+    
+    # Mental state visualizations
+    timeline_fig = analyzer.create_timeline_plot()
+    mental_timeline_path = os.path.join(output_dir, "mental_state_timeline.html")
+    timeline_fig.write_html(mental_timeline_path)
+    output_files['mental_timeline'] = mental_timeline_path
+    return {'files': output_files}
+
+
+def _run_motion_analysis(analyzer: MotionAnalyzer, cache: AnalysisCache, files: List[str], output_dir: str) -> Dict:
+    print("- Motion analysis...")
+    analyzer.orientation = cache.get_or_compute('euler_angles', analyzer.calculate_head_orientation, files=files)
+    output_files = {'motion_report': analyzer.generate_motion_report(output_dir)}
+    
+    # Motion visualizations
+    motion_fig = analyzer.create_motion_timeline()
+    motion_timeline_path = os.path.join(output_dir, "motion_analysis_timeline.html")
+    motion_fig.write_html(motion_timeline_path)
+    output_files['motion_timeline'] = motion_timeline_path
+    return {'files': output_files, 'orientation': analyzer.orientation}
+
 def main():
     """Main function for standalone execution."""
-    import sys
+    import argparse
     
-    # Get data directory from command line or use default
-    data_dir = sys.argv[1] if len(sys.argv) > 1 else "../collected_data"
+    parser = argparse.ArgumentParser(description="Comprehensive analysis of a collected session")
+    parser.add_argument('data_dir', nargs='?', default="../collected_data")
+    parser.add_argument('--output', default="output", help="output directory")
+    parser.add_argument('--jobs', type=int, default=1, help="worker processes for the analyses")
+    parser.add_argument('--cache-dir', help="keep intermediate results here between runs")
+    parser.add_argument('--motion-rejection', choices=['mask', 'regress'],
+                        help="clean motion artifacts from the EEG before the analysis")
+    args = parser.parse_args()
+    data_dir = args.data_dir
     
     if not os.path.exists(data_dir):
         print(f"Data directory {data_dir} not found!")
         return
     
     # Create comprehensive analyzer
-    analyzer = ComprehensiveAnalyzer(data_dir)
+    analyzer = ComprehensiveAnalyzer(data_dir, cache_dir=args.cache_dir, motion_rejection=args.motion_rejection)
     
     # Run full analysis
-    output_files = analyzer.run_full_analysis()
+    output_files = analyzer.run_full_analysis(args.output, n_jobs=args.jobs)
     
     # Print summary of generated files
     print("\nGenerated files:")
@@ -1,16 +1,53 @@
 """
 Data Loader Module for EEG and Sensor Data Analysis
 
-This module provides utilities to load and preprocess data from the collected CSV files.
+This module provides utilities to load and preprocess data from the collected CSV files,
+from the memory-mapped binary (.npy) session files and from the compressed (.ezs)
+session files written by DataCollector.
 """
 
 import pandas as pd
 import numpy as np
 import os
-from typing import Dict, List, Optional, Tuple
+import re
+import sys
+import csv
+from typing import Dict, List, Optional, Tuple, Iterator, Union
 import glob
+import json
+from concurrent.futures import ProcessPoolExecutor
 from datetime import datetime
 
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.session_format import CompressedStreamReader
+
+# data_{type}_{session}.{ext}, e.g. data_eeg_20250101_120000.csv
+DATA_FILE_PATTERN = re.compile(r'^data_(?P<data_type>[a-z]+)_(?P<session>.+)\.(?P<ext>csv|npy|ezs)$')
+# binary formats, preferred over csv when a session has both
+BINARY_EXTENSIONS = ('.npy', '.ezs')
+
+# alignment methods of DataLoader.synchronize_data
+SYNC_METHODS = ['nearest', 'zoh', 'linear']
+
+# sys event rows written by DataCollector for stretches of unusable data:
+# [time, tag, start, end, channels] (channels only for bad_signal, space separated)
+SEGMENT_TAGS = ['bad_signal', 'connection_gap']
+# sys event rows of markers: [time, 'marker', start, end, label, value, id];
+# an updated (interval) marker is written again with the same id
+MARKER_TAG = 'marker'
+
+
+def unix_seconds(value) -> float:
+    """Unix seconds of a timestamp, datetime, date string or number of seconds."""
+    if isinstance(value, (int, float, np.integer, np.floating)):
+        return float(value)
+    return pd.Timestamp(value).value / 1e9
+
+
+def _load_file_worker(file_path: str) -> pd.DataFrame:
+    """Parse a csv or decode an .ezs file in a worker process (see DataLoader.load_sessions)."""
+    return DataLoader(os.path.dirname(file_path)).load_csv_file(file_path)
+
 
 class DataLoader:
     """Unified data loader for all CSV files from the collected_data folder."""
@@ -24,11 +61,14 @@ class DataLoader:
         """
         self.data_directory = data_directory
         self.data_types = ['eeg', 'met', 'mot', 'pow', 'dev']
+        self.file_extensions = ['csv', 'npy', 'ezs']
         self.loaded_data = {}
+        # data type -> files behind loaded_data, used to key cached analysis results
+        self.loaded_files = {}
         
     def find_csv_files(self) -> Dict[str, List[str]]:
         """
-        Find all CSV files in the data directory organized by type.
+        Find all data files (CSV, binary .npy and compressed .ezs) in the data directory organized by type.
         
         Returns:
             Dictionary with data types as keys and file paths as values
@@ -36,50 +76,293 @@ class DataLoader:
         files_by_type = {}
         
         for data_type in self.data_types:
-            pattern = os.path.join(self.data_directory, f"data_{data_type}_*.csv")
-            files = glob.glob(pattern)
+            files = []
+            for extension in self.file_extensions:
+                pattern = os.path.join(self.data_directory, f"data_{data_type}_*.{extension}")
+                files.extend(glob.glob(pattern))
             files_by_type[data_type] = sorted(files)
             
         return files_by_type
     
+    def load_npy_file(self, file_path: str) -> pd.DataFrame:
+        """
+        Load a binary session file written by DataCollector (file_format='npy').
+        
+        The file is memory-mapped, so the sample columns are not parsed or
+        copied; only the timestamp index is materialised.
+        
+        Args:
+            file_path: Path to the .npy file
+            
+        Returns:
+            DataFrame indexed by timestamp, one column per data label
+        """
+        try:
+            records = np.load(file_path, mmap_mode='r')
+            names = records.dtype.names
+            if names is None or 'timestamp' not in names:
+                print(f"Error loading {file_path}: not a structured stream file")
+                return pd.DataFrame()
+            
+            index = pd.to_datetime(np.asarray(records['timestamp']), unit='s')
+            index.name = 'timestamp'
+            columns = {name: records[name] for name in names if name != 'timestamp'}
+            return pd.DataFrame(columns, index=index, copy=False)
+            
+        except Exception as e:
+            print(f"Error loading {file_path}: {e}")
+            return pd.DataFrame()
+    
+    def load_compressed_file(self, file_path: str, start: Optional[float] = None,
+                             end: Optional[float] = None) -> pd.DataFrame:
+        """
+        Load a compressed session file written by DataCollector (file_format='ezs').
+        
+        Only the chunks overlapping [start, end] are read and decoded.
+        
+        Args:
+            file_path: Path to the .ezs file
+            start, end: Time range in unix seconds (None: from the first / to the last sample)
+            
+        Returns:
+            DataFrame indexed by timestamp, one column per data label
+        """
+        try:
+            reader = CompressedStreamReader(file_path)
+            times, values = reader.read(start, end)
+            return self._records_frame(reader.columns, times, values)
+            
+        except Exception as e:
+            print(f"Error loading {file_path}: {e}")
+            return pd.DataFrame()
+    
+    @staticmethod
+    def _records_frame(columns: List[str], times: np.ndarray, values: np.ndarray) -> pd.DataFrame:
+        index = pd.to_datetime(times, unit='s')
+        index.name = 'timestamp'
+        return pd.DataFrame(values, index=index, columns=columns[1:], copy=False)
+    
+    def get_file_metadata(self, file_path: str) -> Dict:
+        """Read the JSON metadata stored next to a binary session file."""
+        meta_path = os.path.splitext(file_path)[0] + '.json'
+        if os.path.exists(meta_path):
+            with open(meta_path) as f:
+                return json.load(f)
+        return {}
+    
     def load_csv_file(self, file_path: str) -> pd.DataFrame:
         """
         Load a single CSV file with proper preprocessing.
         
+        Binary .npy session files are delegated to load_npy_file, compressed
+        .ezs files to load_compressed_file.
+        
         Args:
             file_path: Path to the CSV file
             
         Returns:
             Preprocessed DataFrame
         """
+        if file_path.endswith('.npy'):
+            return self.load_npy_file(file_path)
+        if file_path.endswith('.ezs'):
+            return self.load_compressed_file(file_path)
+        
         try:
-            df = pd.read_csv(file_path)
-            
-            # Convert timestamp to datetime if it exists
-            if 'timestamp' in df.columns:
-                df['timestamp'] = pd.to_datetime(df['timestamp'], unit='s')
-                df.set_index('timestamp', inplace=True)
-                
-            return df
+            return self._prepare_frame(pd.read_csv(file_path))
             
         except Exception as e:
             print(f"Error loading {file_path}: {e}")
             return pd.DataFrame()
     
-    def load_all_data(self) -> Dict[str, pd.DataFrame]:
+    def _prepare_frame(self, df: pd.DataFrame) -> pd.DataFrame:
+        """Convert the timestamp column to a datetime index."""
+        if 'timestamp' in df.columns:
+            df['timestamp'] = pd.to_datetime(df['timestamp'], unit='s')
+            df.set_index('timestamp', inplace=True)
+        return df
+    
+    def build_session_index(self) -> Dict[str, Dict[str, str]]:
+        """
+        Index the data directory by recording session.
+        
+        A session is the timestamp suffix shared by the files of one collection run.
+        
+        Returns:
+            Dictionary of session id -> {data type: file path}, sessions in time order
+        """
+        sessions = {}
+        
+        for file_list in self.find_csv_files().values():
+            for file_path in file_list:
+                match = DATA_FILE_PATTERN.match(os.path.basename(file_path))
+                if match is None:
+                    continue
+                session_files = sessions.setdefault(match.group('session'), {})
+                # prefer the binary file when a session has both
+                if match.group('data_type') not in session_files or file_path.endswith(BINARY_EXTENSIONS):
+                    session_files[match.group('data_type')] = file_path
+                    
+        return {session: sessions[session] for session in sorted(sessions)}
+    
+    def _select_sessions(self, sessions: Optional[List[str]] = None) -> Dict[str, Dict[str, str]]:
+        index = self.build_session_index()
+        if sessions is None:
+            return index
+        return {session: index[session] for session in sessions if session in index}
+    
+    def iter_sessions(self, data_types: Optional[List[str]] = None,
+                      sessions: Optional[List[str]] = None) -> Iterator[Tuple[str, Dict[str, pd.DataFrame]]]:
+        """
+        Load sessions one at a time, so only one session is in memory at once.
+        
+        Args:
+            data_types: Data types to load (default: all)
+            sessions: Session ids to load (default: all, in time order)
+            
+        Yields:
+            Tuple of (session id, {data type: DataFrame})
+        """
+        data_types = data_types or self.data_types
+        for session, files in self._select_sessions(sessions).items():
+            yield session, {data_type: self.load_csv_file(files[data_type])
+                            for data_type in data_types if data_type in files}
+    
+    def iter_chunks(self, data_type: str, chunksize: int = 100000,
+                    sessions: Optional[List[str]] = None) -> Iterator[Tuple[str, pd.DataFrame]]:
+        """
+        Stream one data type over many sessions in bounded-size chunks.
+        
+        CSV files are parsed chunksize rows at a time, binary files are
+        memory-mapped and sliced and compressed files are decoded a few stored
+        chunks at a time, so none is ever fully materialised.
+        
+        Args:
+            data_type: Data type to read, e.g. 'eeg'
+            chunksize: Maximum rows per chunk
+            sessions: Session ids to read (default: all, in time order)
+            
+        Yields:
+            Tuple of (session id, DataFrame chunk indexed by timestamp)
+        """
+        for session, files in self._select_sessions(sessions).items():
+            file_path = files.get(data_type)
+            if file_path is None:
+                continue
+            if file_path.endswith('.npy'):
+                frame = self.load_npy_file(file_path)
+                for start in range(0, len(frame), chunksize):
+                    yield session, frame.iloc[start:start + chunksize]
+            elif file_path.endswith('.ezs'):
+                reader = CompressedStreamReader(file_path)
+                # whole stored chunks, grouped to about chunksize rows
+                group = np.cumsum(reader.chunk_rows) // max(chunksize, 1)
+                for value in np.unique(group):
+                    yield session, self._records_frame(reader.columns, *reader.read_chunks(np.flatnonzero(group == value)))
+            else:
+                for chunk in pd.read_csv(file_path, chunksize=chunksize):
+                    yield session, self._prepare_frame(chunk)
+    
+    def load_sessions(self, data_type: str, sessions: Optional[List[str]] = None,
+                      n_jobs: Optional[int] = None) -> pd.DataFrame:
+        """
+        Load one data type from many sessions, parsing files in parallel processes.
+        
+        Args:
+            data_type: Data type to load, e.g. 'eeg'
+            sessions: Session ids to load (default: all, in time order)
+            n_jobs: Worker processes (default: one per CPU core, 1 loads in-process)
+            
+        Returns:
+            DataFrame of all selected sessions concatenated in time order
+        """
+        file_list = [files[data_type] for files in self._select_sessions(sessions).values()
+                     if data_type in files]
+        if not file_list:
+            return pd.DataFrame()
+            
+        n_jobs = n_jobs or os.cpu_count() or 1
+        # csv files are parsed and .ezs files decompressed, in the workers when there are several
+        decoded_files = [f for f in file_list if not f.endswith('.npy')]
+        if n_jobs > 1 and len(decoded_files) > 1:
+            with ProcessPoolExecutor(max_workers=min(n_jobs, len(decoded_files))) as executor:
+                parsed = dict(zip(decoded_files, executor.map(_load_file_worker, decoded_files)))
+        else:
+            parsed = {f: self.load_csv_file(f) for f in decoded_files}
+        # .npy files are memory-mapped, there's nothing to parse
+        frames = [parsed[f] if f in parsed else self.load_npy_file(f) for f in file_list]
+        frames = [df for df in frames if not df.empty]
+        
+        if not frames:
+            return pd.DataFrame()
+        return pd.concat(frames).sort_index()
+    
+    def load_time_range(self, data_type: str, start, end,
+                        sessions: Optional[List[str]] = None) -> pd.DataFrame:
+        """
+        Load the samples of one data type between two times.
+        
+        Compressed files decode only the chunks overlapping the range and
+        binary files slice their memory map; CSV files have to be parsed whole.
+        
+        Args:
+            data_type: Data type to load, e.g. 'eeg'
+            start, end: Range bounds (inclusive), as timestamps, datetimes or unix seconds
+            sessions: Session ids to read (default: all, in time order)
+            
+        Returns:
+            DataFrame of the samples in the range, indexed by timestamp
+        """
+        start_s = unix_seconds(start)
+        end_s = unix_seconds(end)
+        frames = []
+        for files in self._select_sessions(sessions).values():
+            file_path = files.get(data_type)
+            if file_path is None:
+                continue
+            if file_path.endswith('.ezs'):
+                frames.append(self.load_compressed_file(file_path, start_s, end_s))
+                continue
+            df = self.load_csv_file(file_path)
+            if df.empty or not isinstance(df.index, pd.DatetimeIndex):
+                continue
+            if not df.index.is_monotonic_increasing:
+                df = df.sort_index(kind='stable')
+            times = df.index.asi8
+            frames.append(df.iloc[np.searchsorted(times, int(round(start_s * 1e9)), side='left'):
+                                  np.searchsorted(times, int(round(end_s * 1e9)), side='right')])
+        frames = [df for df in frames if not df.empty]
+        
+        if not frames:
+            return pd.DataFrame()
+        return pd.concat(frames).sort_index()
+    
+    def load_all_data(self, sessions: Union[str, List[str], None] = None,
+                      n_jobs: Optional[int] = None) -> Dict[str, pd.DataFrame]:
         """
         Load all CSV files and return organized data.
         
+        Args:
+            sessions: None loads the first session of each type (previous behaviour),
+                      'all' combines every session, a list combines those session ids
+            n_jobs: Worker processes used when several sessions are combined
+        
         Returns:
             Dictionary with data types as keys and DataFrames as values
         """
         files_by_type = self.find_csv_files()
+        if sessions == 'all':
+            sessions = list(self.build_session_index())
         
         for data_type, file_list in files_by_type.items():
             if file_list:
-                # For now, load the first (most recent) file of each type
-                # You can modify this to combine multiple sessions
-                df = self.load_csv_file(file_list[0])
+                if sessions is None:
+                    df = self.load_csv_file(file_list[0])
+                    self.loaded_files[data_type] = [file_list[0]]
+                else:
+                    df = self.load_sessions(data_type, sessions, n_jobs=n_jobs)
+                    self.loaded_files[data_type] = [files[data_type] for files in self._select_sessions(sessions).values()
+                                                    if data_type in files]
                 self.loaded_data[data_type] = df
                 print(f"Loaded {data_type} data: {df.shape}")
             else:
@@ -143,85 +426,269 @@ class DataLoader:
             return sensors
         return []
     
-    def synchronize_data(self, tolerance_seconds: float = 0.1) -> pd.DataFrame:
+    def _sys_sessions(self, sessions: Optional[List[str]]) -> List[str]:
+        """Sessions whose sys files are read: the given ones, those behind loaded_data, or all."""
+        if sessions is not None:
+            return sessions
+        if self.loaded_files:
+            return sorted({match.group('session') for paths in self.loaded_files.values() for path in paths
+                           for match in [DATA_FILE_PATTERN.match(os.path.basename(path))] if match})
+        return list(self.build_session_index())
+    
+    def _iter_sys_rows(self, sessions: Optional[List[str]]) -> Iterator[List[str]]:
+        for session in self._sys_sessions(sessions):
+            sys_path = os.path.join(self.data_directory, f"data_sys_{session}.csv")
+            if not os.path.exists(sys_path):
+                continue
+            with open(sys_path, newline='') as f:
+                yield from csv.reader(f)
+    
+    def get_markers(self, sessions: Optional[List[str]] = None) -> pd.DataFrame:
+        """
+        Markers recorded in the sys files while collecting (DataCollector.add_marker
+        and markers injected through its Cortex connection).
+        
+        Args:
+            sessions: Session ids (default: as get_bad_segments)
+            
+        Returns:
+            DataFrame with columns time, end (timestamps, end == time for instance
+            markers), label, value and id, in time order
+        """
+        markers = {}
+        for row in self._iter_sys_rows(sessions):
+            if len(row) < 5 or row[1] != MARKER_TAG:
+                continue
+            try:
+                start = float(row[2])
+                end = float(row[3]) if row[3] != '' else start
+            except ValueError:
+                continue
+            marker_id = row[6] if len(row) > 6 and row[6] else f"{row[0]}_{len(markers)}"
+            # the last row of an id wins (interval markers are written again when they end)
+            markers[marker_id] = {'time': start, 'end': end, 'label': row[4],
+                                  'value': row[5] if len(row) > 5 else '', 'id': marker_id}
+        
+        frame = pd.DataFrame(list(markers.values()), columns=['time', 'end', 'label', 'value', 'id'])
+        frame['time'] = pd.to_datetime(frame['time'], unit='s')
+        frame['end'] = pd.to_datetime(frame['end'], unit='s')
+        return frame.sort_values('time', ignore_index=True, kind='stable')
+    
+    def get_bad_segments(self, sessions: Optional[List[str]] = None) -> pd.DataFrame:
+        """
+        Bad-signal and connection-gap segments tagged in the sys files while collecting.
+        
+        Args:
+            sessions: Session ids (default: the sessions behind loaded_data, or all
+                      sessions when nothing is loaded)
+            
+        Returns:
+            DataFrame with columns start, end (timestamps), reason (tag) and
+            channels (list of affected EEG channels, empty for all channels)
+        """
+        segments = []
+        for row in self._iter_sys_rows(sessions):
+            if len(row) < 4 or row[1] not in SEGMENT_TAGS:
+                continue
+            try:
+                start, end = float(row[2]), float(row[3])
+            except ValueError:
+                continue
+            channels = row[4].split() if len(row) > 4 else []
+            segments.append({'start': start, 'end': end, 'reason': row[1], 'channels': channels})
+                    
+        frame = pd.DataFrame(segments, columns=['start', 'end', 'reason', 'channels'])
+        frame['start'] = pd.to_datetime(frame['start'], unit='s')
+        frame['end'] = pd.to_datetime(frame['end'], unit='s')
+        return frame.sort_values('start', ignore_index=True)
+    
+    def mask_bad_segments(self, df: pd.DataFrame, segments: Optional[pd.DataFrame] = None,
+                          drop: bool = False) -> pd.DataFrame:
+        """
+        Blank out the samples of a time-indexed frame that fall in bad segments.
+        
+        Args:
+            df: Frame indexed by timestamp (e.g. loaded_data['eeg'])
+            segments: Result of get_bad_segments (default: get_bad_segments())
+            drop: Drop the rows of every segment instead of setting the affected
+                  channels to NaN
+            
+        Returns:
+            Masked copy of df
+        """
+        if segments is None:
+            segments = self.get_bad_segments()
+        if df.empty or segments.empty or not isinstance(df.index, pd.DatetimeIndex):
+            return df
+            
+        times = df.index.asi8
+        lo = np.searchsorted(times, segments['start'].to_numpy().astype('datetime64[ns]').astype(np.int64), side='left')
+        hi = np.searchsorted(times, segments['end'].to_numpy().astype('datetime64[ns]').astype(np.int64), side='right')
+        if drop:
+            keep = np.ones(len(df), dtype=bool)
+            for start, end in zip(lo, hi):
+                keep[start:end] = False
+            return df[keep]
+            
+        masked = df.copy()
+        # counters and other integer columns are left as they are
+        float_columns = [col for col in df.columns if pd.api.types.is_float_dtype(df[col])]
+        for start, end, channels in zip(lo, hi, segments['channels']):
+            if start >= end:
+                continue
+            columns = [col for col in channels if col in float_columns] if channels else float_columns
+            masked.iloc[start:end, [masked.columns.get_loc(col) for col in columns]] = np.nan
+        return masked
+    
+    def synchronize_data(self, tolerance_seconds: float = 0.1, method: str = 'nearest',
+                         target_rate: Optional[float] = None,
+                         reference: Optional[str] = None) -> pd.DataFrame:
         """
         Synchronize all data types to common timestamps.
         
+        Every stream is aligned to one time grid with a single sorted merge
+        (pd.merge_asof on int64 nanosecond timestamps), so the cost is linear
+        in the number of samples. The reference stream keeps its column names,
+        the other streams are prefixed with their data type (e.g. met_attention).
+        
         Args:
             tolerance_seconds: Maximum time difference for synchronization
+            method: 'nearest' sample, 'zoh' (last sample at or before the grid
+                time, zero-order hold) or 'linear' interpolation between the
+                samples around it (non-numeric columns fall back to 'zoh')
+            target_rate: Grid rate in Hz. None uses the reference timestamps,
+                a lower rate than the reference downsamples
+            reference: Data type that defines the grid, defaults to the stream
+                with the most samples in the common time range
             
         Returns:
             Synchronized DataFrame with all data types
         """
-        if not self.loaded_data:
+        if method not in SYNC_METHODS:
+            raise ValueError(f"Unknown method {method}. Use one of {SYNC_METHODS}")
+            
+        streams = {data_type: df for data_type, df in self.loaded_data.items()
+                   if not df.empty and isinstance(df.index, pd.DatetimeIndex)}
+        if not streams:
             return pd.DataFrame()
             
+        for data_type, df in streams.items():
+            if not df.index.is_monotonic_increasing:
+                streams[data_type] = df.sort_index(kind='stable')
+            
         # Find common time range
-        start_times = []
-        end_times = []
-        
-        for data_type, df in self.loaded_data.items():
-            if not df.empty and hasattr(df.index, 'min'):
-                start_times.append(df.index.min())
-                end_times.append(df.index.max())
-        
-        if not start_times:
+        common_start = max(df.index[0] for df in streams.values())
+        common_end = min(df.index[-1] for df in streams.values())
+        if common_start > common_end:
             return pd.DataFrame()
-            
-        common_start = max(start_times)
-        common_end = min(end_times)
         
         print(f"Synchronizing data from {common_start} to {common_end}")
         
-        # Use the highest sampling rate as reference
-        reference_data = None
-        max_samples = 0
-        
-        for data_type, df in self.loaded_data.items():
-            if not df.empty:
-                time_filtered = df[(df.index >= common_start) & (df.index <= common_end)]
-                if len(time_filtered) > max_samples:
-                    max_samples = len(time_filtered)
-                    reference_data = time_filtered
+        # Positional bounds of the common range, no copies
+        bounds = {data_type: (df.index.searchsorted(common_start, side='left'),
+                              df.index.searchsorted(common_end, side='right'))
+                  for data_type, df in streams.items()}
         
-        if reference_data is None:
-            return pd.DataFrame()
+        if reference is None:
+            # Use the highest sampling rate as reference
+            reference = max(bounds, key=lambda data_type: bounds[data_type][1] - bounds[data_type][0])
+        elif reference not in streams:
+            raise ValueError(f"Reference stream {reference} is not loaded")
+            
+        if target_rate:
+            step_ns = int(round(1e9 / target_rate))
+            grid_ns = np.arange(common_start.value, common_end.value + 1, step_ns, dtype=np.int64)
+        else:
+            lo, hi = bounds[reference]
+            grid_ns = streams[reference].index.asi8[lo:hi]
             
-        # Resample other data to match reference timestamps
-        synchronized_df = reference_data.copy()
+        tolerance_ns = int(round(tolerance_seconds * 1e9))
+        aligned = []
         
-        for data_type, df in self.loaded_data.items():
-            if not df.empty and data_type != 'eeg':  # Assuming EEG has highest sampling rate
-                time_filtered = df[(df.index >= common_start) & (df.index <= common_end)]
-                
-                # Resample to match reference timestamps
-                resampled = time_filtered.reindex(
-                    synchronized_df.index, 
-                    method='nearest',
-                    tolerance=pd.Timedelta(seconds=tolerance_seconds)
-                )
+        for data_type, df in streams.items():
+            lo, hi = bounds[data_type]
+            block = df.iloc[lo:hi]
+            
+            if data_type == reference and not target_rate:
+                aligned.append(block.reset_index(drop=True))
+                continue
                 
-                # Add prefix to column names to avoid conflicts
+            resampled = self._align_stream(block, grid_ns, method, tolerance_ns)
+            
+            # Add prefix to column names to avoid conflicts
+            if data_type != reference:
                 resampled.columns = [f"{data_type}_{col}" for col in resampled.columns]
-                
-                # Merge with synchronized data
-                synchronized_df = synchronized_df.join(resampled, how='inner')
+            aligned.append(resampled)
+            
+        synchronized_df = pd.concat(aligned, axis=1)
+        synchronized_df.index = pd.DatetimeIndex(grid_ns.view('datetime64[ns]'), name='timestamp')
         
         return synchronized_df
+    
+    @staticmethod
+    def _align_stream(block: pd.DataFrame, grid_ns: np.ndarray, method: str,
+                      tolerance_ns: int) -> pd.DataFrame:
+        """
+        Align one time-sorted stream to grid_ns.
+        
+        Returns:
+            DataFrame with one row per grid time and a RangeIndex
+        """
+        times_ns = block.index.asi8
+        left = pd.DataFrame({'_t': grid_ns})
+        
+        numeric_columns = []
+        if method == 'linear':
+            numeric_columns = [col for col in block.columns if pd.api.types.is_numeric_dtype(block[col])]
+        other_columns = [col for col in block.columns if col not in numeric_columns]
+        
+        result = {}
+        if other_columns:
+            right = block[other_columns].reset_index(drop=True)
+            right.insert(0, '_t', times_ns)
+            merged = pd.merge_asof(left, right, on='_t',
+                                   direction='backward' if method != 'nearest' else 'nearest',
+                                   tolerance=tolerance_ns, allow_exact_matches=True)
+            for col in other_columns:
+                result[col] = merged[col].to_numpy()
+            
+        if numeric_columns:
+            values = block[numeric_columns].to_numpy(dtype=np.float64)
+            n = len(times_ns)
+            # samples at or before / at or after each grid time
+            before = np.searchsorted(times_ns, grid_ns, side='right') - 1
+            after = np.searchsorted(times_ns, grid_ns, side='left')
+            valid = (before >= 0) & (after < n)
+            before_c = np.clip(before, 0, max(n - 1, 0))
+            after_c = np.clip(after, 0, max(n - 1, 0))
+            t0 = times_ns[before_c]
+            t1 = times_ns[after_c]
+            valid &= (grid_ns - t0 <= tolerance_ns) & (t1 - grid_ns <= tolerance_ns)
+            span = (t1 - t0).astype(np.float64)
+            frac = np.divide((grid_ns - t0).astype(np.float64), span,
+                             out=np.zeros(len(grid_ns)), where=span > 0)
+            interpolated = values[before_c] + (values[after_c] - values[before_c]) * frac[:, None]
+            interpolated[~valid] = np.nan
+            for i, col in enumerate(numeric_columns):
+                result[col] = interpolated[:, i]
+                
+        return pd.DataFrame({col: result[col] for col in block.columns})
 
 
-def load_session_data(data_directory: str) -> Tuple[DataLoader, Dict[str, pd.DataFrame]]:
+def load_session_data(data_directory: str,
+                      sessions: Optional[Union[str, List[str]]] = None) -> Tuple[DataLoader, Dict[str, pd.DataFrame]]:
     """
     Convenience function to load session data.
     
     Args:
         data_directory: Path to the collected_data directory
+        sessions: Passed to DataLoader.load_all_data ('all', a list of session ids, or None for the first files)
         
     Returns:
         Tuple of (DataLoader instance, loaded data dictionary)
     """
     loader = DataLoader(data_directory)
-    data = loader.load_all_data()
+    data = loader.load_all_data(sessions=sessions)
     return loader, data
 
 
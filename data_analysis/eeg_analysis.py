@@ -17,8 +17,76 @@ from scipy.fft import fft, fftfreq
 import plotly.graph_objects as go
 from plotly.subplots import make_subplots
 import os
+import sys
+from concurrent.futures import ProcessPoolExecutor
 from typing import Dict, List, Tuple, Optional
 from data_loader import DataLoader
+from plot_decimation import DEFAULT_MAX_POINTS, decimated_trace
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+# the same filter design as the live EEGStreamProcessor
+from core.eeg_stream import design_eeg_sos
+
+
+def analyze_channel_block(data: np.ndarray, sampling_rate: float,
+                          frequency_bands: Dict[str, Tuple[float, float]],
+                          sos: np.ndarray) -> Dict[str, np.ndarray]:
+    """
+    Statistics, band powers and quality for a (samples, channels) block in one pass.
+    
+    Every step runs along axis 0 for all channels at once. This is a module-level
+    function so it can run in worker processes.
+    
+    Args:
+        data: Raw EEG samples without NaN rows, one column per channel
+        sampling_rate: Sampling rate in Hz
+        frequency_bands: Band name -> (low, high) frequency
+        sos: Filter cascade from design_eeg_sos
+        
+    Returns:
+        Dictionary of per-channel arrays (float32 'filtered' block included)
+    """
+    n_samples = data.shape[0]
+    results = {
+        'mean': data.mean(axis=0),
+        'std': data.std(axis=0, ddof=1),
+        'min': data.min(axis=0),
+        'max': data.max(axis=0),
+        'skewness': stats.skew(data, axis=0),
+        'kurtosis': stats.kurtosis(data, axis=0)
+    }
+    
+    # Filter all channels in one call (same minimum length as preprocess_signal)
+    if n_samples >= 100:
+        filtered = signal.sosfiltfilt(sos, data, axis=0)
+    else:
+        filtered = data
+    
+    # PSD for all channels
+    window_length = min(n_samples // 4, int(2 * sampling_rate))
+    frequencies, psd = signal.welch(filtered, fs=sampling_rate, nperseg=window_length,
+                                    noverlap=window_length // 2, axis=0)
+    for band_name, (low_freq, high_freq) in frequency_bands.items():
+        freq_mask = (frequencies >= low_freq) & (frequencies <= high_freq)
+        if np.any(freq_mask):
+            results[band_name] = np.trapz(psd[freq_mask], frequencies[freq_mask], axis=0)
+        else:
+            results[band_name] = np.zeros(data.shape[1])
+    
+    # Signal quality (same definitions as EEGAnalyzer._assess_signal_quality)
+    signal_power = np.var(data, axis=0)
+    if n_samples > 100:
+        noise_power = np.var(np.diff(data, axis=0), axis=0)
+        with np.errstate(divide='ignore', invalid='ignore'):
+            snr = np.where(noise_power > 0, 10 * np.log10(signal_power / noise_power), 0.0)
+    else:
+        snr = np.zeros(data.shape[1])
+    threshold = 3 * results['std']
+    results['snr'] = snr
+    results['artifact_ratio'] = (np.abs(data - results['mean']) > threshold).mean(axis=0)
+    results['filtered'] = filtered.astype(np.float32)
+    
+    return results
 
 
 class EEGAnalyzer:
@@ -45,6 +113,9 @@ class EEGAnalyzer:
             'gamma': (30, 100)
         }
         
+        # analyze_all_channels results per mode, reused by the plots and reports
+        self.channel_results = {}
+        
     def _get_sampling_rate(self) -> float:
         """Estimate sampling rate from EEG data."""
         info = self.data_loader.get_data_info()
@@ -74,23 +145,9 @@ class EEGAnalyzer:
         if len(data) < 100:  # Need minimum data for filtering
             return data
             
-        # Design filters
-        nyquist = self.sampling_rate / 2
-        
-        # High-pass filter (remove DC and low-frequency drift)
-        if highpass > 0:
-            high_b, high_a = signal.butter(4, highpass/nyquist, btype='high')
-            data = pd.Series(signal.filtfilt(high_b, high_a, data), index=data.index)
-        
-        # Low-pass filter (anti-aliasing)
-        if lowpass < nyquist:
-            low_b, low_a = signal.butter(4, lowpass/nyquist, btype='low')
-            data = pd.Series(signal.filtfilt(low_b, low_a, data), index=data.index)
-        
-        # Notch filter (remove power line noise)
-        if notch > 0:
-            notch_b, notch_a = signal.iirnotch(notch, 30, self.sampling_rate)
-            data = pd.Series(signal.filtfilt(notch_b, notch_a, data), index=data.index)
+        # Cached filter design, applied as one zero-phase cascade
+        sos = design_eeg_sos(self.sampling_rate, lowpass, highpass, notch)
+        data = pd.Series(signal.sosfiltfilt(sos, data.to_numpy(dtype=np.float64)), index=data.index)
             
         return data
     
@@ -113,7 +170,7 @@ class EEGAnalyzer:
             channel_data.dropna(), 
             fs=self.sampling_rate,
             nperseg=window_length,
-            overlap=window_length//2
+            noverlap=window_length//2
         )
         
         return frequencies, psd
@@ -144,13 +201,80 @@ class EEGAnalyzer:
                 
         return band_powers
     
-    def analyze_all_channels(self) -> Dict[str, Dict]:
+    def analyze_all_channels(self, mode: str = 'matrix', n_jobs: int = 1) -> Dict[str, Dict]:
         """
         Perform comprehensive analysis on all EEG channels.
         
+        Args:
+            mode: 'matrix' filters and computes the PSD for all channels in single
+                  vectorized calls and returns float32 arrays as 'filtered_data';
+                  'per_channel' runs the original one-channel-at-a-time pipeline
+                  and returns filtered pandas Series
+            n_jobs: Number of worker processes for matrix mode; channels are split
+                    into n_jobs blocks (useful for long, many-channel files)
+            
+        Returns:
+            Dictionary with analysis results for each channel (computed once per mode)
+        """
+        if mode in self.channel_results:
+            return self.channel_results[mode]
+        if mode == 'per_channel':
+            self.channel_results[mode] = self._analyze_channels_individually()
+            return self.channel_results[mode]
+        if mode != 'matrix':
+            raise ValueError(f"Unknown analysis mode: {mode}")
+            
+        channels = [ch for ch in self.channels if ch in self.eeg_data.columns]
+        if not channels:
+            return {}
+            
+        print(f"Analyzing {len(channels)} channels")
+        data = self.eeg_data[channels].dropna().to_numpy(dtype=np.float64)
+        if len(data) == 0:
+            return {}
+        sos = design_eeg_sos(self.sampling_rate)
+        
+        if n_jobs > 1 and len(channels) > 1:
+            blocks = np.array_split(np.arange(len(channels)), min(n_jobs, len(channels)))
+            with ProcessPoolExecutor(max_workers=len(blocks)) as executor:
+                futures = [executor.submit(analyze_channel_block, data[:, block], self.sampling_rate,
+                                           self.frequency_bands, sos) for block in blocks]
+                parts = [future.result() for future in futures]
+            # channels are the last axis of every result array
+            block_results = {key: np.concatenate([part[key] for part in parts], axis=-1) for key in parts[0]}
+        else:
+            block_results = analyze_channel_block(data, self.sampling_rate, self.frequency_bands, sos)
+        
+        results = {}
+        for i, channel in enumerate(channels):
+            results[channel] = {
+                'statistics': {key: float(block_results[key][i])
+                               for key in ['mean', 'std', 'min', 'max', 'skewness', 'kurtosis']},
+                'band_powers': {band: float(block_results[band][i]) for band in self.frequency_bands},
+                'quality': {'snr': float(block_results['snr'][i]),
+                            'artifact_ratio': float(block_results['artifact_ratio'][i])},
+                'filtered_data': block_results['filtered'][:, i]
+            }
+            
+        self.channel_results[mode] = results
+        return results
+    
+    def filtered_frame(self) -> pd.DataFrame:
+        """
+        Filtered EEG of all channels from the matrix analysis, without filtering again.
+        
         Returns:
-            Dictionary with analysis results for each channel
+            DataFrame of filtered channels indexed by timestamp
         """
+        results = self.analyze_all_channels()
+        if not results:
+            return pd.DataFrame()
+        channels = list(results)
+        index = self.eeg_data[channels].dropna().index
+        return pd.DataFrame({channel: results[channel]['filtered_data'] for channel in channels}, index=index)
+    
+    def _analyze_channels_individually(self) -> Dict[str, Dict]:
+        """Analyze one channel at a time (original pipeline, keeps filtered Series)."""
         results = {}
         
         for channel in self.channels:
@@ -216,13 +340,15 @@ class EEGAnalyzer:
         }
     
     def plot_channel_overview(self, channel: str, 
-                            time_window: int = 10) -> go.Figure:
+                            time_window: Optional[int] = 10,
+                            max_points: Optional[int] = DEFAULT_MAX_POINTS) -> go.Figure:
         """
         Create comprehensive visualization for a single channel.
         
         Args:
             channel: Channel name
-            time_window: Time window in seconds to display
+            time_window: Time window in seconds to display (None shows the whole session)
+            max_points: Samples drawn per time-domain trace (min/max decimated), None draws all
             
         Returns:
             Plotly figure
@@ -236,11 +362,15 @@ class EEGAnalyzer:
         filtered_data = self.preprocess_signal(raw_data)
         
         # Limit to time window
-        end_time = raw_data.index[-1]
-        start_time = end_time - pd.Timedelta(seconds=time_window)
-        
-        raw_windowed = raw_data[raw_data.index >= start_time]
-        filtered_windowed = filtered_data[filtered_data.index >= start_time]
+        if time_window is None:
+            raw_windowed = raw_data
+            filtered_windowed = filtered_data
+        else:
+            end_time = raw_data.index[-1]
+            start_time = end_time - pd.Timedelta(seconds=time_window)
+            
+            raw_windowed = raw_data[raw_data.index >= start_time]
+            filtered_windowed = filtered_data[filtered_data.index >= start_time]
         
         # Create subplots
         fig = make_subplots(
@@ -259,14 +389,14 @@ class EEGAnalyzer:
         
         # Time domain plots
         fig.add_trace(
-            go.Scatter(x=raw_windowed.index, y=raw_windowed.values,
-                      name='Raw', line=dict(color='blue')),
+            decimated_trace(raw_windowed.index, raw_windowed.values, max_points,
+                            name='Raw', line=dict(color='blue')),
             row=1, col=1
         )
         
         fig.add_trace(
-            go.Scatter(x=filtered_windowed.index, y=filtered_windowed.values,
-                      name='Filtered', line=dict(color='red')),
+            decimated_trace(filtered_windowed.index, filtered_windowed.values, max_points,
+                            name='Filtered', line=dict(color='red')),
             row=1, col=2
         )
         
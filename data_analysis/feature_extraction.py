@@ -0,0 +1,384 @@
+"""
+Feature Extraction Module
+
+Dense float32 feature matrices for training our own classifiers (instead of
+the server-side mental command and facial expression detections). Epochs
+are read through SessionStore, either sliding windows over each session or
+windows around markers, and every feature is computed for all epochs and
+channels at once:
+- EEG band powers per channel (Welch), band power ratios and Hjorth
+  activity, mobility and complexity,
+- the mean of every pow and met column over the epoch.
+
+Sessions are processed in parallel worker processes. write_training_set
+stores the result as .npy files that load_training_set memory-maps, so a
+model can be trained repeatedly without re-running the pandas pipeline.
+"""
+
+import os
+import sys
+import json
+import numpy as np
+from datetime import datetime
+from concurrent.futures import ProcessPoolExecutor
+from typing import Dict, List, Optional, Tuple
+
+from data_loader import DataLoader
+from session_store import SessionStore
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.eeg_stream import NON_CHANNEL_LABELS, FREQUENCY_BANDS, epoch_band_powers
+
+EPOCH_MODES = ['windows', 'markers']
+# (numerator, denominator) band power ratios per channel
+BAND_RATIOS = [('theta', 'beta'), ('alpha', 'theta'), ('beta', 'alpha')]
+HJORTH_NAMES = ['activity', 'mobility', 'complexity']
+TRAINING_SET_FORMAT = 'emorobots-features-1'
+
+
+def band_powers(epochs: np.ndarray, sampling_rate: float,
+                bands: Dict[str, Tuple[float, float]] = FREQUENCY_BANDS) -> np.ndarray:
+    """
+    Band powers of every epoch and channel (core.eeg_stream.epoch_band_powers,
+    the same routine InferenceStage runs live).
+
+    Args:
+        epochs: Array of shape (n_epochs, n_samples, n_channels)
+        sampling_rate: Sampling rate in Hz
+        bands: Band name -> (low, high) frequency
+
+    Returns:
+        Array of shape (n_epochs, n_channels, n_bands)
+    """
+    return epoch_band_powers(epochs, sampling_rate, bands)
+
+
+def band_ratios(powers: np.ndarray, band_names: List[str],
+                ratios: List[Tuple[str, str]] = BAND_RATIOS) -> np.ndarray:
+    """(n_epochs, n_channels, n_ratios) ratios of the band powers of band_powers()."""
+    position = {band: i for i, band in enumerate(band_names)}
+    numerators = powers[:, :, [position[num] for num, _ in ratios]]
+    denominators = powers[:, :, [position[den] for _, den in ratios]]
+    with np.errstate(divide='ignore', invalid='ignore'):
+        return np.where(denominators > 0, numerators / denominators, np.nan)
+
+
+def hjorth_parameters(epochs: np.ndarray) -> np.ndarray:
+    """
+    Hjorth activity, mobility and complexity of every epoch and channel.
+
+    Returns:
+        Array of shape (n_epochs, n_channels, 3)
+    """
+    d1 = np.diff(epochs, axis=1)
+    d2 = np.diff(d1, axis=1)
+    activity = epochs.var(axis=1)
+    var_d1 = d1.var(axis=1)
+    var_d2 = d2.var(axis=1)
+    with np.errstate(divide='ignore', invalid='ignore'):
+        mobility = np.sqrt(var_d1 / activity)
+        complexity = np.sqrt(var_d2 / var_d1) / mobility
+    return np.stack((activity, mobility, complexity), axis=-1)
+
+
+def window_means(times: np.ndarray, values: np.ndarray, starts: np.ndarray, ends: np.ndarray) -> np.ndarray:
+    """
+    NaN-ignoring mean of every column over each [start, end] window, from cumulative sums.
+
+    Args:
+        times: Sorted sample times, shape (n,)
+        values: Samples, shape (n, n_columns)
+        starts, ends: Window bounds in the unit of times
+
+    Returns:
+        Array of shape (n_windows, n_columns), NaN for windows without samples
+    """
+    valid = ~np.isnan(values)
+    zeros = np.zeros((1, values.shape[1]))
+    sums = np.vstack((zeros, np.cumsum(np.where(valid, values, 0.0), axis=0)))
+    counts = np.vstack((zeros, np.cumsum(valid, axis=0)))
+    lo = np.searchsorted(times, starts, side='left')
+    hi = np.searchsorted(times, ends, side='right')
+    with np.errstate(divide='ignore', invalid='ignore'):
+        return (sums[hi] - sums[lo]) / (counts[hi] - counts[lo])
+
+
+def _session_worker(data_directory: str, params: Dict, session: str) -> Dict:
+    """Features of one session in a worker process (see FeatureExtractor.extract)."""
+    return FeatureExtractor(data_directory, **params).session_features(session)
+
+
+class FeatureExtractor:
+    """Epoch feature matrices of the collected sessions."""
+
+    def __init__(self, data_directory: str, epoch_mode: str = 'windows', epoch_seconds: float = 2.0,
+                 step_seconds: float = 1.0, pre: float = 0.0, post: float = 2.0,
+                 marker_labels: Optional[List[str]] = None,
+                 bands: Optional[Dict[str, Tuple[float, float]]] = None,
+                 ratios: Optional[List[Tuple[str, str]]] = None, log_power: bool = True,
+                 streams: Tuple[str, ...] = ('eeg', 'pow', 'met')):
+        """
+        Initialize the extractor.
+
+        Args:
+            data_directory: Directory of the collected sessions
+            epoch_mode: 'windows' slides epoch_seconds windows by step_seconds over
+                        each session, labelled with the last marker before the window;
+                        'markers' takes pre seconds before to post seconds after every
+                        marker, labelled with the marker
+            epoch_seconds, step_seconds: Window length and step ('windows')
+            pre, post: Seconds before and after each marker ('markers')
+            marker_labels: Markers used ('markers') or as labels ('windows'), default all
+            bands: Band name -> (low, high) frequency (default FREQUENCY_BANDS)
+            ratios: Band power ratios (default BAND_RATIOS)
+            log_power: Store log10 band powers
+            streams: Streams that contribute features ('eeg', 'pow', 'met')
+        """
+        if epoch_mode not in EPOCH_MODES:
+            raise ValueError(f"Unknown epoch mode {epoch_mode}. Use one of {EPOCH_MODES}")
+        self.data_directory = data_directory
+        self.epoch_mode = epoch_mode
+        self.epoch_seconds = epoch_seconds
+        self.step_seconds = step_seconds
+        self.pre = pre
+        self.post = post
+        self.marker_labels = marker_labels
+        self.bands = bands or FREQUENCY_BANDS
+        self.ratios = ratios if ratios is not None else BAND_RATIOS
+        self.log_power = log_power
+        self.streams = tuple(streams)
+
+    @property
+    def params(self) -> Dict:
+        """Constructor arguments besides the directory (for workers and the training set metadata)."""
+        return {'epoch_mode': self.epoch_mode, 'epoch_seconds': self.epoch_seconds,
+                'step_seconds': self.step_seconds, 'pre': self.pre, 'post': self.post,
+                'marker_labels': self.marker_labels, 'bands': self.bands,
+                'ratios': [list(ratio) for ratio in self.ratios], 'log_power': self.log_power,
+                'streams': list(self.streams)}
+
+    def _epoch_windows(self, store: SessionStore) -> Tuple[np.ndarray, np.ndarray, List[str]]:
+        """(window starts, window ends, labels) in unix seconds."""
+        markers = store.markers(self.marker_labels)
+        marker_times = markers['time'].to_numpy().astype('datetime64[ns]').astype(np.int64) / 1e9
+        if self.epoch_mode == 'markers':
+            return marker_times - self.pre, marker_times + self.post, markers['label'].tolist()
+
+        start, end = store.time_range('eeg' if 'eeg' in store.files else store.streams()[0])
+        starts = np.arange(start.value / 1e9, end.value / 1e9 - self.epoch_seconds, self.step_seconds)
+        # label of a window: the last marker at or before its start
+        last = np.searchsorted(marker_times, starts, side='right') - 1
+        names = np.array(markers['label'].tolist() + [''], dtype=object)
+        return starts, starts + self.epoch_seconds, names[np.where(last >= 0, last, len(markers))].tolist()
+
+    def _eeg_features(self, store: SessionStore, starts: np.ndarray,
+                      ends: np.ndarray) -> Tuple[np.ndarray, List[str]]:
+        columns = store.files['eeg'][0].columns
+        channels = [c for c in columns if c not in NON_CHANNEL_LABELS]
+        rate = store.sampling_rate('eeg')
+        epochs, _ = store.epochs('eeg', starts, 0.0, float(np.median(ends - starts)), channels, rate)
+        epochs = epochs.astype(np.float64)
+
+        band_names = list(self.bands)
+        powers = band_powers(np.nan_to_num(epochs), rate, self.bands)
+        ratios = band_ratios(powers, band_names, self.ratios)
+        hjorth = hjorth_parameters(epochs)
+        if self.log_power:
+            with np.errstate(divide='ignore'):
+                powers = np.log10(powers)
+
+        # epochs not fully covered by the recording stay NaN
+        missing = np.isnan(epochs).any(axis=(1, 2))
+        blocks = [powers, ratios, hjorth]
+        features = np.concatenate([block.reshape(len(epochs), -1) for block in blocks], axis=1)
+        features[missing] = np.nan
+        names = ([f"{c}_{band}" for c in channels for band in band_names]
+                 + [f"{c}_{num}/{den}" for c in channels for num, den in self.ratios]
+                 + [f"{c}_hjorth_{name}" for c in channels for name in HJORTH_NAMES])
+        return features, names
+
+    def _mean_features(self, store: SessionStore, stream: str, starts: np.ndarray,
+                       ends: np.ndarray) -> Tuple[np.ndarray, List[str]]:
+        t0, t1 = store.time_range(stream)
+        frame = store.slice(stream, t0, t1)
+        if stream == 'met':
+            frame = frame[[c for c in frame.columns if not c.endswith('.isActive')]]
+        means = window_means(frame.index.asi8 / 1e9, frame.to_numpy(dtype=np.float64), starts, ends)
+        return means, [f"{stream}_{c}" for c in frame.columns]
+
+    def session_features(self, session: str) -> Dict:
+        """
+        Features of every epoch of one session.
+
+        Returns:
+            Dictionary with features (float32, (n_epochs, n_features)), names,
+            labels, times (epoch start, unix seconds) and session
+        """
+        store = SessionStore(DataLoader(self.data_directory), sessions=[session])
+        result = {'session': session, 'features': np.empty((0, 0), dtype=np.float32),
+                  'names': [], 'labels': [], 'times': np.empty(0)}
+        if not store.files:
+            return result
+        starts, ends, labels = self._epoch_windows(store)
+        if not len(starts):
+            return result
+
+        blocks, names = [], []
+        for stream in self.streams:
+            if stream not in store.files:
+                continue
+            if stream == 'eeg':
+                features, stream_names = self._eeg_features(store, starts, ends)
+            else:
+                features, stream_names = self._mean_features(store, stream, starts, ends)
+            blocks.append(features)
+            names.extend(stream_names)
+        if blocks:
+            result['features'] = np.concatenate(blocks, axis=1).astype(np.float32)
+        result.update({'names': names, 'labels': labels, 'times': starts})
+        return result
+
+    def extract(self, sessions: Optional[List[str]] = None, n_jobs: Optional[int] = None) -> List[Dict]:
+        """
+        Features of many sessions, one worker process per session.
+
+        Args:
+            sessions: Session ids (default: all, in time order)
+            n_jobs: Worker processes (default: one per CPU core, 1 runs in-process)
+
+        Returns:
+            session_features() results in session order
+        """
+        if sessions is None:
+            sessions = list(DataLoader(self.data_directory).build_session_index())
+        n_jobs = n_jobs or os.cpu_count() or 1
+        if n_jobs > 1 and len(sessions) > 1:
+            with ProcessPoolExecutor(max_workers=min(n_jobs, len(sessions))) as executor:
+                futures = [executor.submit(_session_worker, self.data_directory, self.params, session)
+                           for session in sessions]
+                return [future.result() for future in futures]
+        return [self.session_features(session) for session in sessions]
+
+    def write_training_set(self, output_dir: str, sessions: Optional[List[str]] = None,
+                           n_jobs: Optional[int] = None, drop_incomplete: bool = True) -> Dict:
+        """
+        Extract the features of many sessions and store them for load_training_set.
+
+        Writes to output_dir:
+        - features.npy: float32 (n_epochs, n_features), written through a memory map
+        - labels.npy: int32 label code per epoch (-1 without label)
+        - times.npy: float64 epoch start (unix seconds), sessions.npy: int32 session index
+        - meta.json: feature names, label names, sessions and the extractor parameters
+
+        Feature columns follow the first session; columns missing in another
+        session are NaN there.
+
+        Args:
+            output_dir: Directory of the training set (created if missing)
+            sessions: Session ids (default: all)
+            n_jobs: Worker processes
+            drop_incomplete: Leave out epochs with any NaN feature
+
+        Returns:
+            Summary with the shape, label counts and output directory
+        """
+        results = [r for r in self.extract(sessions, n_jobs) if len(r['features'])]
+        names = []
+        for r in results:
+            names.extend(name for name in r['names'] if name not in names)
+        position = {name: i for i, name in enumerate(names)}
+
+        keep = [~np.isnan(r['features']).any(axis=1) if drop_incomplete else np.ones(len(r['features']), dtype=bool)
+                for r in results]
+        n_epochs = int(sum(rows.sum() for rows in keep))
+
+        label_names = sorted({label for r, rows in zip(results, keep)
+                              for label, k in zip(r['labels'], rows) if k and label})
+        label_codes = {label: i for i, label in enumerate(label_names)}
+
+        os.makedirs(output_dir, exist_ok=True)
+        features = np.lib.format.open_memmap(os.path.join(output_dir, 'features.npy'), mode='w+',
+                                             dtype=np.float32, shape=(n_epochs, len(names)))
+        labels = np.empty(n_epochs, dtype=np.int32)
+        times = np.empty(n_epochs, dtype=np.float64)
+        session_index = np.empty(n_epochs, dtype=np.int32)
+        row = 0
+        for i, (r, rows) in enumerate(zip(results, keep)):
+            n = int(rows.sum())
+            columns = [position[name] for name in r['names']]
+            block = np.full((n, len(names)), np.nan, dtype=np.float32)
+            block[:, columns] = r['features'][rows]
+            features[row:row + n] = block
+            labels[row:row + n] = [label_codes.get(label, -1) for label, k in zip(r['labels'], rows) if k]
+            times[row:row + n] = r['times'][rows]
+            session_index[row:row + n] = i
+            row += n
+        features.flush()
+        del features
+        np.save(os.path.join(output_dir, 'labels.npy'), labels)
+        np.save(os.path.join(output_dir, 'times.npy'), times)
+        np.save(os.path.join(output_dir, 'sessions.npy'), session_index)
+
+        meta = {
+            'format': TRAINING_SET_FORMAT,
+            'created': datetime.now().isoformat(),
+            'data_directory': os.path.abspath(self.data_directory),
+            'shape': [n_epochs, len(names)],
+            'feature_names': names,
+            'label_names': label_names,
+            'sessions': [r['session'] for r in results],
+            'params': self.params,
+        }
+        with open(os.path.join(output_dir, 'meta.json'), 'w') as f:
+            json.dump(meta, f, indent=2)
+
+        summary = {'output_dir': output_dir, 'epochs': n_epochs, 'features': len(names),
+                   'sessions': len(results),
+                   'label_counts': {name: int((labels == code).sum()) for name, code in label_codes.items()}}
+        print(f"Training set: {n_epochs} epochs x {len(names)} features from {len(results)} sessions in {output_dir}")
+        return summary
+
+
+def load_training_set(directory: str) -> Dict:
+    """
+    Open a training set written by FeatureExtractor.write_training_set.
+
+    Returns:
+        Dictionary with features (read-only float32 memmap), labels, times,
+        sessions (per-epoch session index) and the meta.json entries
+    """
+    with open(os.path.join(directory, 'meta.json')) as f:
+        meta = json.load(f)
+    training_set = dict(meta)
+    training_set['features'] = np.load(os.path.join(directory, 'features.npy'), mmap_mode='r')
+    training_set['labels'] = np.load(os.path.join(directory, 'labels.npy'))
+    training_set['times'] = np.load(os.path.join(directory, 'times.npy'))
+    training_set['session_index'] = np.load(os.path.join(directory, 'sessions.npy'))
+    return training_set
+
+
+def main():
+    """Write a training set from the command line."""
+    import argparse
+    parser = argparse.ArgumentParser(description='Write an epoch feature training set')
+    parser.add_argument('--data-dir', default='../collected_data')
+    parser.add_argument('--output-dir', default='output/training_set')
+    parser.add_argument('--mode', choices=EPOCH_MODES, default='windows')
+    parser.add_argument('--epoch-seconds', type=float, default=2.0)
+    parser.add_argument('--step-seconds', type=float, default=1.0)
+    parser.add_argument('--pre', type=float, default=0.0, help='seconds before each marker (--mode markers)')
+    parser.add_argument('--post', type=float, default=2.0, help='seconds after each marker (--mode markers)')
+    parser.add_argument('--labels', nargs='+', default=None, help='marker labels to use')
+    parser.add_argument('--jobs', type=int, default=None)
+    args = parser.parse_args()
+
+    extractor = FeatureExtractor(args.data_dir, epoch_mode=args.mode, epoch_seconds=args.epoch_seconds,
+                                 step_seconds=args.step_seconds, pre=args.pre, post=args.post,
+                                 marker_labels=args.labels)
+    summary = extractor.write_training_set(args.output_dir, n_jobs=args.jobs)
+    for label, count in summary['label_counts'].items():
+        print(f"  {label}: {count} epochs")
+
+
+if __name__ == "__main__":
+    main()
@@ -15,8 +15,153 @@ import plotly.graph_objects as go
 from plotly.subplots import make_subplots
 from scipy import stats
 import os
+import sys
 from typing import Dict, List, Tuple, Optional
 from data_loader import DataLoader
+from plot_decimation import DEFAULT_MAX_POINTS, decimated_trace
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.rolling_stats import RollingStatistics, StreamingCovariance
+
+# rows fed to the rolling and covariance engines at a time
+STREAM_CHUNK_ROWS = 4096
+
+
+def state_labels(n_bins: int) -> List[str]:
+    """Names of the quantile states: Low/Medium/High for 3 bins, Q1..Qn otherwise."""
+    if n_bins == 3:
+        return ['Low', 'Medium', 'High']
+    return [f'Q{i + 1}' for i in range(n_bins)]
+
+
+def quantile_edges(values: np.ndarray, n_bins: int) -> np.ndarray:
+    """
+    Inner quantile edges of every column.
+    
+    Args:
+        values: (n_samples, n_metrics) array, NaN for missing samples
+        n_bins: Number of quantile bins
+        
+    Returns:
+        (n_bins - 1, n_metrics) array of edges
+    """
+    quantiles = np.linspace(0, 1, n_bins + 1)[1:-1]
+    return np.atleast_2d(np.nanquantile(values, quantiles, axis=0))
+
+
+def encode_states(values: np.ndarray, edges: np.ndarray) -> np.ndarray:
+    """
+    Integer state codes (0 .. n_bins - 1) of every sample, -1 for NaN.
+    
+    A value equal to an edge falls in the lower bin, as in pd.qcut.
+    """
+    values = np.atleast_2d(values)
+    codes = (values[:, None, :] > edges[None, :, :]).sum(axis=1)
+    codes[np.isnan(values)] = -1
+    return codes
+
+
+def count_transitions(codes: np.ndarray, n_states: int, order: int = 1) -> np.ndarray:
+    """
+    Count state transitions of all metrics with one bincount.
+    
+    The history of a transition is the previous `order` states, encoded as
+    sum(state_j * n_states ** j). Only windows of consecutive valid samples count.
+    
+    Args:
+        codes: (n_samples, n_metrics) state codes from encode_states
+        n_states: Number of states
+        order: Number of previous states a transition depends on
+        
+    Returns:
+        (n_metrics, n_states ** order, n_states) count array
+    """
+    n_samples, n_metrics = codes.shape
+    n_histories = n_states ** order
+    counts_shape = (n_metrics, n_histories, n_states)
+    if n_samples <= order:
+        return np.zeros(counts_shape, dtype=np.int64)
+    
+    history = np.zeros((n_samples - order, n_metrics), dtype=np.int64)
+    valid = codes[order:] >= 0
+    for j in range(order):
+        step = codes[j:n_samples - order + j]
+        history += step * n_states ** (order - 1 - j)
+        valid &= step >= 0
+    nxt = codes[order:]
+    
+    metric = np.broadcast_to(np.arange(n_metrics), history.shape)
+    flat = (metric * n_histories + history) * n_states + nxt
+    counts = np.bincount(flat[valid], minlength=n_metrics * n_histories * n_states)
+    return counts.reshape(counts_shape)
+
+
+def transition_frame(counts: np.ndarray, labels: List[str], order: int = 1) -> pd.DataFrame:
+    """Row-normalised transition probabilities of one metric as a DataFrame."""
+    row_sums = counts.sum(axis=1, keepdims=True)
+    probabilities = np.divide(counts, row_sums, out=np.zeros(counts.shape), where=row_sums > 0)
+    if order == 1:
+        index = pd.Index(labels)
+    else:
+        index = pd.MultiIndex.from_product([labels] * order,
+                                           names=[f't-{order - j}' for j in range(order)])
+    return pd.DataFrame(probabilities, index=index, columns=labels)
+
+
+class TransitionCounter:
+    """
+    Incremental transition counts for live met samples.
+    
+    Bin edges are fixed (usually taken from a recording, see
+    MentalStateAnalyzer.create_transition_counter); every update() encodes one
+    sample of all metrics and adds its transitions with np.add.at.
+    """
+    
+    def __init__(self, metrics: List[str], edges: np.ndarray, order: int = 1):
+        self.metrics = list(metrics)
+        self.edges = edges
+        self.n_states = edges.shape[0] + 1
+        self.order = order
+        self.labels = state_labels(self.n_states)
+        self.counts = np.zeros((len(self.metrics), self.n_states ** order, self.n_states), dtype=np.int64)
+        # last `order` states of every metric, oldest first
+        self.history = np.full((order, len(self.metrics)), -1, dtype=np.int64)
+        self._metric_index = np.arange(len(self.metrics))
+        self._weights = self.n_states ** np.arange(order - 1, -1, -1)
+        
+    def update(self, values) -> np.ndarray:
+        """
+        Add one sample.
+        
+        Args:
+            values: Metric values in self.metrics order, or a dict metric -> value
+            
+        Returns:
+            State codes of the sample
+        """
+        if isinstance(values, dict):
+            values = [values.get(metric, np.nan) for metric in self.metrics]
+        x = np.array([np.nan if v is None else v for v in values], dtype=np.float64)
+        codes = encode_states(x[None, :], self.edges)[0]
+        
+        valid = (codes >= 0) & (self.history >= 0).all(axis=0)
+        if valid.any():
+            hist = self._weights @ np.where(self.history >= 0, self.history, 0)
+            np.add.at(self.counts, (self._metric_index[valid], hist[valid], codes[valid]), 1)
+            
+        self.history = np.roll(self.history, -1, axis=0)
+        self.history[-1] = codes
+        return codes
+    
+    def update_many(self, values: np.ndarray) -> None:
+        """Add an (n_samples, n_metrics) block, continuing from the current history."""
+        codes = np.vstack([self.history, encode_states(np.asarray(values, dtype=np.float64), self.edges)])
+        self.counts += count_transitions(codes, self.n_states, self.order)
+        self.history = codes[-self.order:].copy()
+        
+    def get_transition_matrices(self) -> Dict[str, pd.DataFrame]:
+        return {metric: transition_frame(self.counts[i], self.labels, self.order)
+                for i, metric in enumerate(self.metrics)}
 
 
 class MentalStateAnalyzer:
@@ -70,32 +215,53 @@ class MentalStateAnalyzer:
                     
         return stats_results
     
-    def analyze_temporal_patterns(self, window_size: str = '30S') -> Dict[str, pd.DataFrame]:
+    def analyze_temporal_patterns(self, window_size: str = '30S',
+                                  step: Optional[str] = None) -> Dict[str, pd.DataFrame]:
         """
         Analyze temporal patterns in mental state metrics.
         
+        The rolling statistics come from one RollingStatistics pass over all
+        metrics (the same engine as the live summary), fed in blocks of
+        STREAM_CHUNK_ROWS: the working state is one window, whatever the
+        session length. Values match pandas' rolling(window_size) on each
+        metric with its missing samples dropped.
+        
         Args:
             window_size: Window size for rolling statistics
+            step: Keep only the first row of every step (e.g. '1min') instead
+                  of one row per sample, so the result stays small for long sessions
             
         Returns:
             Dictionary with temporal analysis results
         """
+        metrics, values = self._metric_matrix()
+        if not metrics or len(values) == 0 or not isinstance(self.mental_data.index, pd.DatetimeIndex):
+            return {}
+        
+        times = self.mental_data.index.asi8 / 1e9
+        keep = np.ones(len(times), dtype=bool)
+        if step is not None:
+            bins = np.floor((times - times[0]) / pd.Timedelta(step).total_seconds())
+            keep[1:] = bins[1:] != bins[:-1]
+        
+        rolling = RollingStatistics(metrics, pd.Timedelta(window_size).total_seconds())
+        parts = {name: [] for name in ('mean', 'std', 'min', 'max')}
+        for start in range(0, len(values), STREAM_CHUNK_ROWS):
+            stop = start + STREAM_CHUNK_ROWS
+            block = rolling.update_many(times[start:stop], values[start:stop])
+            rows = keep[start:stop]
+            for name in parts:
+                parts[name].append(block[name][rows])
+        
+        index = self.mental_data.index[keep]
+        present = ~np.isnan(values[keep])
+        columns = {name: np.concatenate(part) for name, part in parts.items()}
         temporal_results = {}
-        
-        for metric in self.metrics:
-            if metric in self.mental_data.columns:
-                data = self.mental_data[metric].dropna()
-                
-                if len(data) > 0:
-                    # Rolling statistics
-                    rolling_stats = pd.DataFrame({
-                        'mean': data.rolling(window_size).mean(),
-                        'std': data.rolling(window_size).std(),
-                        'min': data.rolling(window_size).min(),
-                        'max': data.rolling(window_size).max()
-                    })
-                    
-                    temporal_results[metric] = rolling_stats
+        for i, metric in enumerate(metrics):
+            rows = present[:, i]
+            if rows.any():
+                temporal_results[metric] = pd.DataFrame(
+                    {name: column[rows, i] for name, column in columns.items()}, index=index[rows])
                     
         return temporal_results
     
@@ -103,17 +269,19 @@ class MentalStateAnalyzer:
         """
         Compute correlation matrix between mental state metrics.
         
+        Streamed through StreamingCovariance in blocks, with pairwise complete
+        samples like DataFrame.corr.
+        
         Returns:
             Correlation matrix DataFrame
         """
         # Select only numeric mental state columns
-        metric_data = self.mental_data[self.metrics]
-        
-        # Remove any non-numeric columns that might have slipped through
-        numeric_columns = metric_data.select_dtypes(include=[np.number]).columns
-        correlation_matrix = metric_data[numeric_columns].corr()
+        metrics, values = self._metric_matrix()
+        covariance = StreamingCovariance(metrics)
+        for start in range(0, len(values), STREAM_CHUNK_ROWS):
+            covariance.update_many(values[start:start + STREAM_CHUNK_ROWS])
         
-        return correlation_matrix
+        return pd.DataFrame(covariance.correlation(), index=metrics, columns=metrics)
     
     def detect_state_changes(self, threshold_std: float = 2.0) -> Dict[str, pd.DataFrame]:
         """
@@ -150,56 +318,94 @@ class MentalStateAnalyzer:
                     
         return changes
     
-    def analyze_state_transitions(self, quantile_bins: int = 3) -> Dict[str, pd.DataFrame]:
+    def _metric_matrix(self) -> Tuple[List[str], np.ndarray]:
+        """Numeric mental state columns as one float array."""
+        metrics = [m for m in self.metrics if m in self.mental_data.columns
+                   and pd.api.types.is_numeric_dtype(self.mental_data[m])]
+        return metrics, self.mental_data[metrics].to_numpy(dtype=np.float64)
+    
+    def analyze_state_transitions(self, quantile_bins: int = 3, order: int = 1) -> Dict[str, pd.DataFrame]:
         """
         Analyze transitions between different mental state levels.
         
+        All metrics are binned and counted at once: values are coded by their
+        per-metric quantile bin and the (history, next state) pairs are counted
+        with a single bincount. A missing sample breaks the chain.
+        
         Args:
-            quantile_bins: Number of quantile bins to create (low, medium, high states)
+            quantile_bins: Number of quantile bins to create (low, medium, high states for 3)
+            order: Number of previous states a transition depends on; for order > 1
+                the rows are a MultiIndex of the previous states
             
         Returns:
             Dictionary with transition matrices for each metric
         """
-        transitions = {}
+        metrics, values = self._metric_matrix()
+        if not metrics or len(values) == 0:
+            return {}
+            
+        edges = quantile_edges(values, quantile_bins)
+        codes = encode_states(values, edges)
+        counts = count_transitions(codes, quantile_bins, order)
+        labels = state_labels(quantile_bins)
         
-        for metric in self.metrics:
-            if metric in self.mental_data.columns:
-                data = self.mental_data[metric].dropna()
+        transitions = {}
+        for i, metric in enumerate(metrics):
+            if np.any(codes[:, i] >= 0):
+                transitions[metric] = transition_frame(counts[i], labels, order)
                 
-                if len(data) > 0:
-                    # Create quantile bins
-                    data_binned = pd.qcut(data, q=quantile_bins, 
-                                        labels=[f'Low', f'Medium', f'High'])
-                    
-                    # Create transition matrix
-                    transition_matrix = pd.DataFrame(
-                        index=data_binned.cat.categories,
-                        columns=data_binned.cat.categories,
-                        dtype=float
-                    ).fillna(0)
-                    
-                    # Count transitions
-                    for i in range(len(data_binned) - 1):
-                        current_state = data_binned.iloc[i]
-                        next_state = data_binned.iloc[i + 1]
-                        
-                        if pd.notna(current_state) and pd.notna(next_state):
-                            transition_matrix.loc[current_state, next_state] += 1
-                    
-                    # Normalize to get probabilities
-                    row_sums = transition_matrix.sum(axis=1)
-                    transition_matrix = transition_matrix.div(row_sums, axis=0).fillna(0)
-                    
-                    transitions[metric] = transition_matrix
-                    
         return transitions
     
-    def create_timeline_plot(self, metrics_to_plot: List[str] = None) -> go.Figure:
+    def create_transition_counter(self, quantile_bins: int = 3, order: int = 1,
+                                  include_history: bool = True) -> TransitionCounter:
+        """
+        Create an incremental TransitionCounter for live met data, with bin
+        edges (and optionally counts) taken from the loaded recording.
+        
+        Args:
+            quantile_bins: Number of quantile bins
+            order: Transition order
+            include_history: Start from the counts of the loaded data
+            
+        Returns:
+            TransitionCounter whose update() takes one met sample
+        """
+        metrics, values = self._metric_matrix()
+        counter = TransitionCounter(metrics, quantile_edges(values, quantile_bins), order)
+        if include_history and len(values) > 0:
+            counter.update_many(values)
+        return counter
+    
+    def create_rolling_statistics(self, window_size: str = '30S',
+                                  include_history: bool = True) -> RollingStatistics:
+        """
+        Create a RollingStatistics for live met data, with the metrics of the
+        loaded recording.
+        
+        Args:
+            window_size: Window size for rolling statistics
+            include_history: Start from the last window of the loaded data
+            
+        Returns:
+            RollingStatistics whose update() takes one met sample and its time
+        """
+        metrics, values = self._metric_matrix()
+        rolling = RollingStatistics(metrics, pd.Timedelta(window_size).total_seconds())
+        if include_history and len(values) > 0 and isinstance(self.mental_data.index, pd.DatetimeIndex):
+            times = self.mental_data.index.asi8 / 1e9
+            recent = times > times[-1] - rolling.window_seconds
+            for t, x in zip(times[recent], values[recent]):
+                rolling.update(x, t)
+        return rolling
+    
+    def create_timeline_plot(self, metrics_to_plot: List[str] = None,
+                             max_points: Optional[int] = DEFAULT_MAX_POINTS) -> go.Figure:
         """
         Create timeline plot of mental state metrics.
         
         Args:
             metrics_to_plot: List of metrics to plot (default: all)
+            max_points: Samples drawn per metric (min/max decimated), None draws all
             
         Returns:
             Plotly figure
@@ -216,9 +422,10 @@ class MentalStateAnalyzer:
                 data = self.mental_data[metric].dropna()
                 
                 if len(data) > 0:
-                    fig.add_trace(go.Scatter(
-                        x=data.index,
-                        y=data.values,
+                    fig.add_trace(decimated_trace(
+                        data.index,
+                        data.values,
+                        max_points,
                         mode='lines',
                         name=metric.capitalize(),
                         line={'color': colors[i % len(colors)]}
@@ -13,6 +13,69 @@ from scipy import signal
 import os
 from typing import Dict, List, Tuple, Optional
 from data_loader import DataLoader
+from plot_decimation import DEFAULT_MAX_POINTS, decimated_trace
+
+try:
+    import numba
+except ImportError:
+    numba = None
+
+
+def quaternion_to_euler(q0, q1, q2, q3) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+    """
+    Convert quaternions to Euler angles (roll, pitch, yaw) in degrees.
+    
+    Works element-wise on whole arrays and equally on single samples, so the
+    same kernel serves offline files and the live per-sample path.
+    
+    Args:
+        q0, q1, q2, q3: Quaternion components (scalars or equal-length arrays)
+        
+    Returns:
+        Tuple of (roll, pitch, yaw) in degrees
+    """
+    # Roll (x-axis rotation)
+    roll = np.arctan2(2 * (q0 * q1 + q2 * q3), 1 - 2 * (q1 * q1 + q2 * q2))
+    
+    # Pitch (y-axis rotation), clamped to avoid numerical errors
+    pitch = np.arcsin(np.clip(2 * (q0 * q2 - q3 * q1), -1, 1))
+    
+    # Yaw (z-axis rotation)
+    yaw = np.arctan2(2 * (q0 * q3 + q1 * q2), 1 - 2 * (q2 * q2 + q3 * q3))
+    
+    return np.degrees(roll), np.degrees(pitch), np.degrees(yaw)
+
+
+if numba is not None:
+    @numba.njit(cache=True, fastmath=True)
+    def _quaternion_to_euler_numba(q):
+        n = q.shape[0]
+        angles = np.empty((n, 3))
+        for i in range(n):
+            q0, q1, q2, q3 = q[i, 0], q[i, 1], q[i, 2], q[i, 3]
+            sinp = 2 * (q0 * q2 - q3 * q1)
+            sinp = min(max(sinp, -1.0), 1.0)
+            angles[i, 0] = np.degrees(np.arctan2(2 * (q0 * q1 + q2 * q3), 1 - 2 * (q1 * q1 + q2 * q2)))
+            angles[i, 1] = np.degrees(np.arcsin(sinp))
+            angles[i, 2] = np.degrees(np.arctan2(2 * (q0 * q3 + q1 * q2), 1 - 2 * (q2 * q2 + q3 * q3)))
+        return angles
+
+
+def quaternions_to_euler_array(q: np.ndarray, use_numba: bool = False) -> np.ndarray:
+    """
+    Convert an (n, 4) array of quaternions to an (n, 3) array of roll, pitch, yaw in degrees.
+    
+    Args:
+        q: Array with columns Q0, Q1, Q2, Q3
+        use_numba: Use the numba-compiled kernel when numba is installed
+        
+    Returns:
+        Array with columns roll, pitch, yaw
+    """
+    q = np.ascontiguousarray(q, dtype=np.float64)
+    if use_numba and numba is not None:
+        return _quaternion_to_euler_numba(q)
+    return np.column_stack(quaternion_to_euler(q[:, 0], q[:, 1], q[:, 2], q[:, 3]))
 
 
 class MotionAnalyzer:
@@ -30,50 +93,49 @@ class MotionAnalyzer:
             'accelerometer': ['ACCX', 'ACCY', 'ACCZ'],
             'magnetometer': ['MAGX', 'MAGY', 'MAGZ']
         }
+        
+        # computed once and shared by the detectors, plots and reports
+        self.orientation = None
+        # kernel the cached orientation was computed with (part of its cache key)
+        self.orientation_numba = False
+        self.acc_magnitude = None
     
-    def calculate_head_orientation(self) -> pd.DataFrame:
-        """Calculate head orientation from quaternions."""
+    def calculate_head_orientation(self, use_numba: bool = False) -> pd.DataFrame:
+        """
+        Calculate head orientation from quaternions.
+        
+        Args:
+            use_numba: Use the numba-compiled kernel when numba is installed
+            
+        Returns:
+            DataFrame with roll, pitch and yaw in degrees
+        """
+        use_numba = bool(use_numba and numba is not None)
+        if self.orientation is not None and self.orientation_numba == use_numba:
+            return self.orientation
         if not all(q in self.motion_data.columns for q in self.sensor_groups['quaternion']):
             return pd.DataFrame()
             
         q_data = self.motion_data[self.sensor_groups['quaternion']]
         
-        # Calculate Euler angles from quaternions
-        angles = pd.DataFrame(index=q_data.index)
+        # Calculate Euler angles from quaternions for all samples at once
+        angles = quaternions_to_euler_array(q_data.to_numpy(dtype=np.float64), use_numba=use_numba)
         
-        for i, row in q_data.iterrows():
-            q0, q1, q2, q3 = row['Q0'], row['Q1'], row['Q2'], row['Q3']
-            
-            # Roll (x-axis rotation)
-            sinr_cosp = 2 * (q0 * q1 + q2 * q3)
-            cosr_cosp = 1 - 2 * (q1 * q1 + q2 * q2)
-            roll = np.arctan2(sinr_cosp, cosr_cosp)
-            
-            # Pitch (y-axis rotation)
-            sinp = 2 * (q0 * q2 - q3 * q1)
-            sinp = np.clip(sinp, -1, 1)  # Clamp to avoid numerical errors
-            pitch = np.arcsin(sinp)
-            
-            # Yaw (z-axis rotation)
-            siny_cosp = 2 * (q0 * q3 + q1 * q2)
-            cosy_cosp = 1 - 2 * (q2 * q2 + q3 * q3)
-            yaw = np.arctan2(siny_cosp, cosy_cosp)
-            
-            angles.loc[i, 'roll'] = np.degrees(roll)
-            angles.loc[i, 'pitch'] = np.degrees(pitch)
-            angles.loc[i, 'yaw'] = np.degrees(yaw)
-            
-        return angles
+        self.orientation = pd.DataFrame(angles, index=q_data.index, columns=['roll', 'pitch', 'yaw'])
+        self.orientation_numba = use_numba
+        return self.orientation
     
     def calculate_acceleration_magnitude(self) -> pd.Series:
         """Calculate total acceleration magnitude."""
+        if self.acc_magnitude is not None:
+            return self.acc_magnitude
         if not all(acc in self.motion_data.columns for acc in self.sensor_groups['accelerometer']):
             return pd.Series()
             
         acc_data = self.motion_data[self.sensor_groups['accelerometer']]
-        magnitude = np.sqrt(acc_data['ACCX']**2 + acc_data['ACCY']**2 + acc_data['ACCZ']**2)
+        self.acc_magnitude = np.sqrt(acc_data['ACCX']**2 + acc_data['ACCY']**2 + acc_data['ACCZ']**2)
         
-        return magnitude
+        return self.acc_magnitude
     
     def detect_head_movements(self, threshold_angle: float = 5.0, 
                             threshold_acceleration: float = 0.1) -> Dict[str, pd.DataFrame]:
@@ -161,8 +223,13 @@ class MotionAnalyzer:
             
         return stability_metrics
     
-    def create_motion_timeline(self) -> go.Figure:
-        """Create timeline visualization of motion data."""
+    def create_motion_timeline(self, max_points: Optional[int] = DEFAULT_MAX_POINTS) -> go.Figure:
+        """
+        Create timeline visualization of motion data.
+        
+        Args:
+            max_points: Samples drawn per trace (min/max decimated), None draws all
+        """
         if self.motion_data.empty:
             return go.Figure()
             
@@ -178,8 +245,8 @@ class MotionAnalyzer:
             for angle_type in ['roll', 'pitch', 'yaw']:
                 if angle_type in angles.columns:
                     fig.add_trace(
-                        go.Scatter(x=angles.index, y=angles[angle_type],
-                                 name=angle_type.capitalize(), mode='lines'),
+                        decimated_trace(angles.index, angles[angle_type], max_points,
+                                        name=angle_type.capitalize(), mode='lines'),
                         row=1, col=1
                     )
         
@@ -187,8 +254,8 @@ class MotionAnalyzer:
         if all(acc in self.motion_data.columns for acc in self.sensor_groups['accelerometer']):
             for acc_axis in ['ACCX', 'ACCY', 'ACCZ']:
                 fig.add_trace(
-                    go.Scatter(x=self.motion_data.index, y=self.motion_data[acc_axis],
-                             name=acc_axis, mode='lines'),
+                    decimated_trace(self.motion_data.index, self.motion_data[acc_axis], max_points,
+                                    name=acc_axis, mode='lines'),
                     row=2, col=1
                 )
         
@@ -196,8 +263,8 @@ class MotionAnalyzer:
         if all(mag in self.motion_data.columns for mag in self.sensor_groups['magnetometer']):
             for mag_axis in ['MAGX', 'MAGY', 'MAGZ']:
                 fig.add_trace(
-                    go.Scatter(x=self.motion_data.index, y=self.motion_data[mag_axis],
-                             name=mag_axis, mode='lines'),
+                    decimated_trace(self.motion_data.index, self.motion_data[mag_axis], max_points,
+                                    name=mag_axis, mode='lines'),
                     row=3, col=1
                 )
         
@@ -0,0 +1,214 @@
+"""
+Plot Decimation Module
+
+Level-of-detail helpers that keep Plotly figures small at any session length:
+- minmax_indices / lttb_indices pick the samples to draw. Min/max keeps the
+  extremes of every bucket, so spikes and artifacts stay visible; LTTB
+  (largest triangle three buckets) keeps the visual shape with fewer points.
+- decimated_trace builds a Scatter, or a WebGL Scattergl for large traces,
+  from at most max_points samples.
+- LevelOfDetail precomputes a min/max pyramid (tiles halving the resolution
+  at each level) and serves any x range from the coarsest level that still
+  has max_points samples in it; bind_zoom reloads the detail of a
+  FigureWidget trace whenever its x axis is zoomed (Jupyter).
+"""
+
+import numpy as np
+import pandas as pd
+import plotly.graph_objects as go
+from typing import Dict, Optional, Tuple
+
+# Samples per trace in saved reports; about 2 points per horizontal pixel of a wide plot
+DEFAULT_MAX_POINTS = 4000
+# Traces with more points than this are drawn with WebGL
+WEBGL_MIN_POINTS = 10000
+DECIMATION_METHODS = ['minmax', 'lttb']
+
+
+def _as_float(x) -> np.ndarray:
+    """x positions as float64 (datetimes as nanoseconds)."""
+    if isinstance(x, pd.DatetimeIndex):
+        return x.asi8.astype(np.float64)
+    x = np.asarray(x)
+    if np.issubdtype(x.dtype, np.datetime64):
+        return x.astype('datetime64[ns]').astype(np.int64).astype(np.float64)
+    return x.astype(np.float64)
+
+
+def minmax_indices(y: np.ndarray, n_out: int) -> np.ndarray:
+    """
+    Indices of the minimum and maximum of n_out // 2 equal buckets, in order.
+
+    Args:
+        y: Values, NaN allowed
+        n_out: Maximum number of indices to return
+
+    Returns:
+        Sorted sample indices, always including the first and last sample
+    """
+    y = np.asarray(y, dtype=np.float64)
+    n = len(y)
+    if n <= n_out or n_out < 4:
+        return np.arange(n)
+
+    n_buckets = (n_out - 2) // 2
+    bucket = -(-n // n_buckets)  # ceil
+    padded = np.full(n_buckets * bucket, np.nan)
+    padded[:n] = y
+    blocks = padded.reshape(n_buckets, bucket)
+
+    offsets = np.arange(n_buckets) * bucket
+    i_min = np.argmin(np.where(np.isnan(blocks), np.inf, blocks), axis=1) + offsets
+    i_max = np.argmax(np.where(np.isnan(blocks), -np.inf, blocks), axis=1) + offsets
+    indices = np.concatenate(([0], np.sort(np.stack([i_min, i_max], axis=1), axis=1).ravel(), [n - 1]))
+    return np.unique(np.minimum(indices, n - 1))
+
+
+def lttb_indices(x: np.ndarray, y: np.ndarray, n_out: int) -> np.ndarray:
+    """
+    Largest-triangle-three-buckets downsampling.
+
+    Args:
+        x: Positions as float (see _as_float)
+        y: Values without NaN
+        n_out: Number of indices to return
+
+    Returns:
+        Sorted sample indices, including the first and last sample
+    """
+    n = len(y)
+    if n <= n_out or n_out < 3:
+        return np.arange(n)
+
+    x = np.asarray(x, dtype=np.float64)
+    y = np.asarray(y, dtype=np.float64)
+    edges = np.linspace(1, n - 1, n_out - 1).astype(np.intp)
+    selected = np.empty(n_out, dtype=np.intp)
+    selected[0] = 0
+    selected[-1] = n - 1
+    previous = 0
+    for i in range(n_out - 2):
+        start, end = edges[i], edges[i + 1]
+        # average point of the next bucket
+        next_end = edges[i + 2] if i + 2 < len(edges) else n
+        avg_x = x[end:next_end].mean()
+        avg_y = y[end:next_end].mean()
+        area = np.abs((x[previous] - avg_x) * (y[start:end] - y[previous])
+                      - (x[previous] - x[start:end]) * (avg_y - y[previous]))
+        previous = start + int(np.argmax(area))
+        selected[i + 1] = previous
+    return selected
+
+
+def decimate_indices(x, y, max_points: Optional[int] = DEFAULT_MAX_POINTS,
+                     method: str = 'minmax') -> np.ndarray:
+    """Indices of at most max_points samples to draw (None keeps every sample)."""
+    y = np.asarray(y, dtype=np.float64)
+    if max_points is None or len(y) <= max_points:
+        return np.arange(len(y))
+    if method == 'minmax':
+        return minmax_indices(y, max_points)
+    if method == 'lttb':
+        valid = np.flatnonzero(~np.isnan(y))
+        return valid[lttb_indices(_as_float(x)[valid], y[valid], max_points)]
+    raise ValueError(f"Unknown decimation method: {method}")
+
+
+def decimate(x, y, max_points: Optional[int] = DEFAULT_MAX_POINTS,
+             method: str = 'minmax') -> Tuple[np.ndarray, np.ndarray]:
+    """Decimated (x, y) arrays."""
+    indices = decimate_indices(x, y, max_points, method)
+    return np.asarray(x)[indices], np.asarray(y, dtype=np.float64)[indices]
+
+
+def decimated_trace(x, y, max_points: Optional[int] = DEFAULT_MAX_POINTS, method: str = 'minmax',
+                    webgl: Optional[bool] = None, **trace_kwargs):
+    """
+    Scatter trace of at most max_points samples.
+
+    Args:
+        x, y: Full-resolution data (index/array and values)
+        max_points: Sample budget, None draws every sample
+        method: 'minmax' (keeps peaks) or 'lttb' (keeps shape)
+        webgl: Use Scattergl; None decides from the number of points drawn
+        **trace_kwargs: Passed to the trace (name, mode, line, ...)
+
+    Returns:
+        go.Scatter or go.Scattergl
+    """
+    x_plot, y_plot = decimate(x, y, max_points, method)
+    if webgl is None:
+        webgl = len(y_plot) > WEBGL_MIN_POINTS
+    trace_type = go.Scattergl if webgl else go.Scatter
+    return trace_type(x=x_plot, y=y_plot, **trace_kwargs)
+
+
+class LevelOfDetail:
+    """Min/max pyramid of one series for zoom-dependent detail."""
+
+    def __init__(self, x, y, max_points: int = DEFAULT_MAX_POINTS):
+        """
+        Build the pyramid.
+
+        Args:
+            x: Positions (DatetimeIndex, datetime64 or numeric array)
+            y: Values
+            max_points: Samples returned per view
+        """
+        self.x = np.asarray(x)
+        self.y = np.asarray(y, dtype=np.float64)
+        self.max_points = max_points
+        # level 0 holds every sample; each level keeps the min and max of pairs of
+        # buckets of the level below, until a level fits in max_points
+        self.levels = [np.arange(len(self.y))]
+        while len(self.levels[-1]) > max_points:
+            below = self.levels[-1]
+            level = below[minmax_indices(self.y[below], len(below) // 2)]
+            if len(level) == len(below):
+                break
+            self.levels.append(level)
+        self.level_x = [_as_float(self.x[level]) for level in self.levels]
+
+    def view(self, x0=None, x1=None) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        (x, y) samples between x0 and x1 at the detail that fits max_points.
+
+        Args:
+            x0, x1: Range limits in the units of x (strings are parsed as
+                    timestamps for datetime data); None means open-ended
+        """
+        lo = -np.inf if x0 is None else self._position(x0)
+        hi = np.inf if x1 is None else self._position(x1)
+        # coarsest tiles first; use the finest level needed to fill the view
+        for level, positions in zip(reversed(self.levels), reversed(self.level_x)):
+            i0, i1 = np.searchsorted(positions, [lo, hi], side='left')
+            if i1 - i0 >= self.max_points or level is self.levels[0]:
+                break
+        indices = level[i0:i1]
+        indices = indices[minmax_indices(self.y[indices], self.max_points)]
+        return self.x[indices], self.y[indices]
+
+    def _position(self, value) -> float:
+        if np.issubdtype(self.x.dtype, np.datetime64):
+            return float(pd.Timestamp(value).value)
+        return float(value)
+
+
+def bind_zoom(figure_widget, details: Dict[int, LevelOfDetail], xaxis: str = 'xaxis') -> None:
+    """
+    Reload trace detail when the figure is zoomed.
+
+    Args:
+        figure_widget: plotly.graph_objects.FigureWidget
+        details: Trace index -> LevelOfDetail of that trace's full data
+        xaxis: Layout axis whose range drives the traces
+    """
+    def on_range(axis, x_range):
+        x0, x1 = x_range if x_range else (None, None)
+        with figure_widget.batch_update():
+            for trace_index, lod in details.items():
+                x, y = lod.view(x0, x1)
+                figure_widget.data[trace_index].x = x
+                figure_widget.data[trace_index].y = y
+
+    figure_widget.layout[xaxis].on_change(on_range, 'range')
@@ -0,0 +1,322 @@
+"""
+Session Store Module
+
+Time-indexed access to the collected sessions. Every numeric stream keeps a
+sparse time index: the first and last timestamp of each block of samples
+(the stored chunks of compressed .ezs files, index_step rows of .npy and CSV
+files). Range queries and epochs look up the blocks they need in that index
+and only read those, so epoching EEG around thousands of markers reads the
+samples around the markers instead of scanning the recording.
+
+Markers and the bad-signal / connection-gap segments of the sys files form
+one event table next to the streams.
+"""
+
+import os
+import sys
+import numpy as np
+import pandas as pd
+from typing import Dict, List, Optional, Tuple, Union
+
+from data_loader import DataLoader, unix_seconds
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.session_format import CompressedStreamReader
+from core.eeg_stream import epoch_length
+
+# columns of SessionStore.events
+EVENT_COLUMNS = ['time', 'end', 'kind', 'label', 'value', 'channels']
+
+
+def _to_datetime(values: pd.Series) -> pd.Series:
+    """Timestamps of a column of timestamps, date strings or unix seconds."""
+    if pd.api.types.is_numeric_dtype(values):
+        return pd.to_datetime(values, unit='s')
+    return pd.to_datetime(values)
+
+
+class _StreamFile:
+    """
+    Sparse time index and block reader of one session file.
+
+    Timestamps are assumed non-decreasing within a file, as DataCollector
+    writes them.
+    """
+
+    def __init__(self, loader: DataLoader, path: str, index_step: int):
+        self.path = path
+        self.reader = None
+        if path.endswith('.ezs'):
+            self.reader = CompressedStreamReader(path)
+            self.columns = self.reader.columns[1:]
+            self.first_times = self.reader.first_times
+            self.last_times = self.reader.last_times
+            self.block_rows = self.reader.chunk_rows
+            return
+
+        if path.endswith('.npy'):
+            records = np.load(path, mmap_mode='r')
+            self.columns = [name for name in records.dtype.names if name != 'timestamp']
+            # memory-mapped: only the pages of the requested rows are read
+            self.times = records['timestamp']
+            self.records = records
+        else:
+            frame = loader.load_csv_file(path)
+            if not frame.index.is_monotonic_increasing:
+                frame = frame.sort_index(kind='stable')
+            frame = frame.select_dtypes(include=[np.number])
+            self.columns = list(frame.columns)
+            self.times = frame.index.asi8 / 1e9
+            self.values = frame.to_numpy(dtype=np.float64)
+            self.records = None
+        n = len(self.times)
+        self.index_step = index_step
+        starts = np.arange(0, n, index_step)
+        self.first_times = np.asarray(self.times[::index_step], dtype=np.float64)
+        self.last_times = np.asarray(self.times[np.minimum(starts + index_step, n) - 1], dtype=np.float64)
+        self.block_rows = np.minimum(starts + index_step, n) - starts
+
+    def read_blocks(self, blocks: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+        """(timestamps, values) of the given blocks, in order."""
+        if self.reader is not None:
+            return self.reader.read_chunks(blocks)
+        times, values = [], []
+        # contiguous runs of blocks are read as one row range
+        breaks = np.flatnonzero(np.diff(blocks) != 1) + 1
+        for run in np.split(blocks, breaks):
+            if not len(run):
+                continue
+            lo = int(run[0]) * self.index_step
+            hi = min((int(run[-1]) + 1) * self.index_step, len(self.times))
+            times.append(np.asarray(self.times[lo:hi], dtype=np.float64))
+            if self.records is not None:
+                rows = self.records[lo:hi]
+                values.append(np.column_stack([rows[name] for name in self.columns]))
+            else:
+                values.append(self.values[lo:hi])
+        if not times:
+            return np.empty(0), np.empty((0, len(self.columns)))
+        return np.concatenate(times), np.concatenate(values)
+
+
+class SessionStore:
+    """Time-indexed streams and event table of one or more collected sessions."""
+
+    def __init__(self, data_loader: Union[DataLoader, str], sessions: Union[str, List[str], None] = 'all',
+                 index_step: int = 4096):
+        """
+        Initialize the store.
+
+        Only the sparse time indexes are built here (CSV files are parsed,
+        .npy files memory-mapped, .ezs files read chunk header by chunk header).
+
+        Args:
+            data_loader: DataLoader, or a data directory
+            sessions: Session ids, or 'all' (default)
+            index_step: Samples per index block of .npy and CSV files
+        """
+        self.data_loader = data_loader if isinstance(data_loader, DataLoader) else DataLoader(data_loader)
+        index = self.data_loader.build_session_index()
+        self.sessions = list(index) if sessions in (None, 'all') else [s for s in sessions if s in index]
+        self.index_step = index_step
+
+        self.files = {}
+        for data_type in self.data_loader.data_types:
+            paths = [index[session][data_type] for session in self.sessions if data_type in index[session]]
+            files = [_StreamFile(self.data_loader, path, index_step) for path in paths]
+            files = [f for f in files if len(f.block_rows)]
+            if files:
+                self.files[data_type] = sorted(files, key=lambda f: f.first_times[0])
+
+        # block table per stream over all files: file, block, first and last time
+        self.blocks = {}
+        for data_type, files in self.files.items():
+            self.blocks[data_type] = {
+                'file': np.concatenate([np.full(len(f.block_rows), i) for i, f in enumerate(files)]),
+                'block': np.concatenate([np.arange(len(f.block_rows)) for f in files]),
+                'first': np.concatenate([f.first_times for f in files]),
+                'last': np.concatenate([f.last_times for f in files]),
+                'rows': np.concatenate([f.block_rows for f in files]),
+            }
+        self.events = self._load_events()
+
+    def _load_events(self) -> pd.DataFrame:
+        markers = self.data_loader.get_markers(self.sessions)
+        segments = self.data_loader.get_bad_segments(self.sessions)
+        events = pd.concat([
+            pd.DataFrame({'time': markers['time'], 'end': markers['end'], 'kind': 'marker',
+                          'label': markers['label'], 'value': markers['value'],
+                          'channels': [[] for _ in range(len(markers))]}),
+            pd.DataFrame({'time': segments['start'], 'end': segments['end'], 'kind': segments['reason'],
+                          'label': segments['reason'], 'value': '', 'channels': segments['channels']}),
+        ], ignore_index=True)
+        return events[EVENT_COLUMNS].sort_values('time', ignore_index=True, kind='stable')
+
+    def add_events(self, events: pd.DataFrame, kind: str = 'marker'):
+        """
+        Add events from elsewhere, e.g. markers of an exported Cortex record.
+
+        Args:
+            events: Frame with a time column (timestamps or unix seconds) and
+                    optionally end, label, value and channels
+            kind: Kind of the events without a kind column
+        """
+        added = pd.DataFrame({'time': _to_datetime(events['time'])})
+        added['end'] = _to_datetime(events['end']) if 'end' in events else added['time']
+        added['kind'] = events['kind'].to_numpy() if 'kind' in events else kind
+        added['label'] = events['label'].astype(str).to_numpy() if 'label' in events else kind
+        added['value'] = events['value'].to_numpy() if 'value' in events else ''
+        added['channels'] = events['channels'].to_numpy() if 'channels' in events else [[] for _ in range(len(added))]
+        self.events = pd.concat([self.events, added[EVENT_COLUMNS]], ignore_index=True).sort_values(
+            'time', ignore_index=True, kind='stable')
+
+    def streams(self) -> List[str]:
+        return list(self.files)
+
+    def time_range(self, stream: str) -> Tuple[pd.Timestamp, pd.Timestamp]:
+        """First and last timestamp of a stream, from the index alone."""
+        blocks = self._blocks(stream)
+        return (pd.Timestamp(blocks['first'][0], unit='s'), pd.Timestamp(blocks['last'][-1], unit='s'))
+
+    def sampling_rate(self, stream: str) -> float:
+        """Mean sampling rate of a stream over its index blocks (gaps between files excluded)."""
+        blocks = self._blocks(stream)
+        span = np.sum(blocks['last'] - blocks['first'])
+        return float(np.sum(blocks['rows'] - 1) / span) if span > 0 else 0.0
+
+    def _blocks(self, stream: str) -> Dict[str, np.ndarray]:
+        if stream not in self.blocks:
+            raise ValueError(f"Stream {stream} is not in the store. Use one of {self.streams()}")
+        return self.blocks[stream]
+
+    def _read(self, stream: str, needed: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+        """(timestamps, values) of the needed global blocks, in time order."""
+        blocks = self._blocks(stream)
+        times, values = [], []
+        for file_id in np.unique(blocks['file'][needed]):
+            selected = needed[blocks['file'][needed] == file_id]
+            t, v = self.files[stream][file_id].read_blocks(blocks['block'][selected])
+            times.append(t)
+            values.append(v)
+        if not times:
+            return np.empty(0), np.empty((0, len(self.files[stream][0].columns)))
+        return np.concatenate(times), np.concatenate(values)
+
+    def _blocks_between(self, stream: str, starts: np.ndarray, ends: np.ndarray) -> np.ndarray:
+        """Global blocks overlapping any of the [start, end] windows."""
+        blocks = self._blocks(stream)
+        lo = np.searchsorted(blocks['last'], starts, side='left')
+        hi = np.searchsorted(blocks['first'], ends, side='right')
+        cover = np.zeros(len(blocks['first']) + 1, dtype=np.int64)
+        np.add.at(cover, lo, 1)
+        np.add.at(cover, np.maximum(hi, lo), -1)
+        return np.flatnonzero(np.cumsum(cover[:-1]) > 0)
+
+    def slice(self, stream: str, t0, t1, channels: Optional[List[str]] = None) -> pd.DataFrame:
+        """
+        Samples of a stream with t0 <= timestamp <= t1.
+
+        Args:
+            stream: Data type, e.g. 'eeg'
+            t0, t1: Range bounds, as timestamps, datetimes or unix seconds
+            channels: Columns to return (default: all)
+
+        Returns:
+            DataFrame indexed by timestamp
+        """
+        start, end = unix_seconds(t0), unix_seconds(t1)
+        times, values = self._read(stream, self._blocks_between(stream, np.array([start]), np.array([end])))
+        lo, hi = np.searchsorted(times, start, side='left'), np.searchsorted(times, end, side='right')
+        columns = self.files[stream][0].columns
+        frame = pd.DataFrame(values[lo:hi], index=pd.to_datetime(times[lo:hi], unit='s'), columns=columns)
+        frame.index.name = 'timestamp'
+        return frame[channels] if channels is not None else frame
+
+    def markers(self, label: Union[str, List[str], None] = None) -> pd.DataFrame:
+        """Marker events, optionally only those with the given label(s)."""
+        markers = self.events[self.events['kind'] == 'marker']
+        if label is not None:
+            markers = markers[markers['label'].isin([label] if isinstance(label, str) else label)]
+        return markers.reset_index(drop=True)
+
+    def events_between(self, t0, t1) -> pd.DataFrame:
+        """Events starting between t0 and t1."""
+        times = self.events['time'].to_numpy().astype('datetime64[ns]').astype(np.int64)
+        lo = np.searchsorted(times, int(round(unix_seconds(t0) * 1e9)), side='left')
+        hi = np.searchsorted(times, int(round(unix_seconds(t1) * 1e9)), side='right')
+        return self.events.iloc[lo:hi].reset_index(drop=True)
+
+    def epochs(self, stream: str, onsets, pre: float, post: float, channels: Optional[List[str]] = None,
+               sampling_rate: Optional[float] = None) -> Tuple[np.ndarray, np.ndarray]:
+        """
+        Fixed-length windows of a stream around onset times.
+
+        Only the index blocks overlapping a window are read. Every epoch
+        starts at the first sample at or after onset - pre and holds
+        round((pre + post) * rate) + 1 samples; epochs not fully covered by
+        the recording (start, end, gaps) are NaN.
+
+        Args:
+            stream: Data type, e.g. 'eeg'
+            onsets: Onset times (timestamps or unix seconds)
+            pre, post: Seconds before and after each onset
+            channels: Columns to return (default: all)
+            sampling_rate: Samples per second (default: estimated from the index)
+
+        Returns:
+            Tuple of (epochs of shape (n_onsets, n_samples, n_channels),
+            offsets of the samples from the onset in seconds)
+        """
+        rate = sampling_rate or self.sampling_rate(stream)
+        n_samples = epoch_length(pre + post, rate)
+        offsets = np.arange(n_samples) / rate - pre
+        columns = self.files[stream][0].columns
+        selected = np.arange(len(columns)) if channels is None else np.array([columns.index(c) for c in channels])
+        onsets = _to_datetime(pd.Series(onsets)).to_numpy().astype('datetime64[ns]').astype(np.int64) / 1e9
+        if not len(onsets):
+            return np.empty((0, n_samples, len(selected))), offsets
+
+        times, values = self._read(stream, self._blocks_between(stream, onsets - pre, onsets + post))
+        epochs = np.full((len(onsets), n_samples, len(selected)), np.nan,
+                         dtype=np.result_type(values.dtype, np.float32))
+        if not len(times):
+            return epochs, offsets
+        start = np.searchsorted(times, onsets - pre, side='left')
+        index = start[:, None] + np.arange(n_samples)[None, :]
+        valid = index[:, -1] < len(times)
+        index = np.minimum(index, len(times) - 1)
+        # a window across unread blocks or a gap spans more time than it should
+        span = times[index[:, -1]] - times[index[:, 0]]
+        valid &= (span <= (n_samples - 1) / rate * 1.5) & (times[index[:, 0]] <= onsets - pre + 1.5 / rate)
+        epochs[valid] = values[index[valid][:, :, None], selected[None, None, :]]
+        return epochs, offsets
+
+    def around_marker(self, label: Union[str, List[str], None], pre: float, post: float, stream: str = 'eeg',
+                      channels: Optional[List[str]] = None,
+                      sampling_rate: Optional[float] = None) -> Tuple[np.ndarray, np.ndarray, pd.DataFrame]:
+        """
+        Epochs of a stream around every marker with the given label(s).
+
+        Args:
+            label: Marker label, list of labels, or None for every marker
+            pre, post: Seconds before and after each marker
+            stream: Data type to epoch (default 'eeg')
+            channels: Columns to return (default: all)
+            sampling_rate: Samples per second (default: estimated from the index)
+
+        Returns:
+            Tuple of (epochs of shape (n_markers, n_samples, n_channels),
+            offsets from the marker in seconds, the markers, row i for epoch i)
+        """
+        markers = self.markers(label)
+        epochs, offsets = self.epochs(stream, markers['time'], pre, post, channels, sampling_rate)
+        return epochs, offsets, markers
+
+    def get_summary(self) -> Dict[str, Dict]:
+        """Samples, blocks and time range per stream, and event counts per kind."""
+        summary = {stream: {'samples': int(blocks['rows'].sum()), 'blocks': len(blocks['rows']),
+                            'files': len(self.files[stream]),
+                            'start': self.time_range(stream)[0], 'end': self.time_range(stream)[1]}
+                   for stream, blocks in self.blocks.items()}
+        summary['events'] = self.events['kind'].value_counts().to_dict()
+        return summary
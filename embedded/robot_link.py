@@ -0,0 +1,252 @@
+"""
+Serial output stage from the emotion pipeline to the Arduino.
+
+Frame layout (little endian):
+
+    0xAA 0x55 | type (1) | length (1) | payload (length bytes) | crc8 (1)
+
+The CRC-8 (polynomial 0x07) covers type, length and payload. The receiver
+resynchronises on the 0xAA 0x55 preamble, so a lost byte costs one frame.
+
+Frame types:
+    FRAME_MOOD     payload: mood (uint8, MOOD_*), intensity (uint8, 0-255)
+    FRAME_METRICS  payload: engagement, excitement, stress, relaxation,
+                   interest, focus (uint8 each, 0-255)
+    FRAME_PING     empty payload, keeps the link checked while idle
+
+Commands are coalesced: one slot per frame type holds only the newest
+command, so a slow or reconnecting port never builds a backlog and the robot
+always receives the latest state. A frame type is sent at most once every
+min_interval seconds.
+"""
+import time
+import struct
+import threading
+import collections
+
+try:
+    import serial
+except ImportError:  # the pipeline still runs without a robot attached
+    serial = None
+
+SYNC = b'\xaa\x55'
+
+FRAME_MOOD = 0x01
+FRAME_METRICS = 0x02
+FRAME_PING = 0x03
+
+MOOD_NEUTRAL = 0
+MOOD_EXCITED = 1
+MOOD_RELAXED = 2
+MOOD_STRESSED = 3
+
+
+def _crc8_table():
+    table = []
+    for byte in range(256):
+        crc = byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+        table.append(crc)
+    return bytes(table)
+
+
+_CRC8_TABLE = _crc8_table()
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc = _CRC8_TABLE[crc ^ byte]
+    return crc
+
+
+def encode_frame(frame_type, payload=b''):
+    body = struct.pack('<BB', frame_type, len(payload)) + payload
+    return SYNC + body + bytes([crc8(body)])
+
+
+def scale_unit(value):
+    """Map a 0-1 metric to one byte, clamping out-of-range and missing values."""
+    if value is None or value != value:
+        return 0
+    return max(0, min(255, int(round(value * 255))))
+
+
+class RobotLink:
+    """
+    Persistent, non-blocking serial link to the robot.
+
+    send() only stores the command in its coalescing slot and wakes the writer
+    thread, so it is safe to call from the Cortex WebSocket thread. The writer
+    thread keeps the port open, writes due frames and reopens the port with a
+    backoff when it fails.
+
+    Opening the port resets most Arduinos through DTR; reset_delay seconds are
+    waited after each (re)connect before the first frame, once per connection
+    instead of once per command.
+
+    Latency is measured from the headset sample time passed to send() to the
+    moment the frame has been handed to the OS (after write() and flush()).
+    """
+
+    def __init__(self, port='/dev/ttyACM0', baudrate=115200, min_interval=0.02,
+                 reset_delay=2.0, reconnect_delay=0.5, max_reconnect_delay=5.0,
+                 ping_interval=1.0, latency_window=1000):
+        self.port = port
+        self.baudrate = baudrate
+        self.min_interval = min_interval
+        self.reset_delay = reset_delay
+        self.reconnect_delay = reconnect_delay
+        self.max_reconnect_delay = max_reconnect_delay
+        self.ping_interval = ping_interval
+
+        self.serial = None
+        self.connected = False
+        self.frames_sent = 0
+        self.frames_coalesced = 0
+        self.reconnects = 0
+        self.write_errors = 0
+        self.latencies = collections.deque(maxlen=latency_window)
+
+        self._slots = {}        # frame type -> (payload, sample time)
+        self._last_sent = {}    # frame type -> monotonic time of the last write
+        self._cond = threading.Condition()
+        self._stopping = False
+        self._thread = None
+
+    def start(self):
+        if serial is None:
+            raise RuntimeError('pyserial is required for the robot link (pip install pyserial)')
+        if self._thread is not None:
+            return
+        self._stopping = False
+        self._thread = threading.Thread(target=self._run, name="RobotLinkThread", daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        with self._cond:
+            self._stopping = True
+            self._cond.notify_all()
+        if self._thread is not None:
+            self._thread.join()
+        self._thread = None
+        self._close()
+
+    def send(self, frame_type, payload=b'', sample_time=None):
+        """Queue a frame, replacing any unsent frame of the same type."""
+        with self._cond:
+            if frame_type in self._slots:
+                self.frames_coalesced += 1
+            self._slots[frame_type] = (payload, sample_time)
+            self._cond.notify()
+
+    def send_mood(self, mood, intensity, sample_time=None):
+        self.send(FRAME_MOOD, struct.pack('<BB', mood, scale_unit(intensity)), sample_time)
+
+    def send_metrics(self, metrics, sample_time=None):
+        """metrics: sequence of engagement, excitement, stress, relaxation, interest, focus."""
+        self.send(FRAME_METRICS, bytes(scale_unit(v) for v in metrics), sample_time)
+
+    def _open(self):
+        port = serial.Serial()
+        port.port = self.port
+        port.baudrate = self.baudrate
+        port.timeout = 0
+        port.write_timeout = 0.1
+        port.open()
+        if self.reset_delay:
+            time.sleep(self.reset_delay)
+        port.reset_input_buffer()
+        self.serial = port
+        self.connected = True
+        print('robot link connected on ' + self.port)
+
+    def _close(self):
+        if self.serial is not None:
+            try:
+                self.serial.close()
+            except Exception:
+                pass
+        self.serial = None
+        self.connected = False
+
+    def _connect(self):
+        delay = self.reconnect_delay
+        while not self._stopping:
+            try:
+                self._open()
+                return True
+            except (serial.SerialException, OSError) as e:
+                print('robot link: cannot open ' + self.port + ': ' + str(e))
+            with self._cond:
+                self._cond.wait(delay)
+            delay = min(delay * 2, self.max_reconnect_delay)
+        return False
+
+    def _due_frames(self, now):
+        """Pop the slots whose rate limit has expired; return them and the next wake-up delay."""
+        due = []
+        wait = None
+        for frame_type in list(self._slots):
+            ready_at = self._last_sent.get(frame_type, 0.0) + self.min_interval
+            if now >= ready_at:
+                due.append((frame_type,) + self._slots.pop(frame_type))
+            else:
+                wait = ready_at - now if wait is None else min(wait, ready_at - now)
+        if not due and self.ping_interval:
+            # empty frame while idle so a dropped port is noticed and reopened
+            idle = now - max(self._last_sent.values(), default=now)
+            if idle >= self.ping_interval:
+                due.append((FRAME_PING, b'', None))
+            else:
+                ping_wait = self.ping_interval - idle
+                wait = ping_wait if wait is None else min(wait, ping_wait)
+        return due, wait
+
+    def _run(self):
+        while not self._stopping:
+            if not self.connected and not self._connect():
+                break
+            with self._cond:
+                due, wait = self._due_frames(time.monotonic())
+                if not due:
+                    self._cond.wait(wait)
+                    continue
+            try:
+                self.serial.write(b''.join(encode_frame(t, p) for t, p, _ in due))
+                self.serial.flush()
+            except (serial.SerialException, OSError) as e:
+                self.write_errors += 1
+                print('robot link write failed, reconnecting: ' + str(e))
+                with self._cond:
+                    # keep the newest command of each type for the next connection
+                    for frame_type, payload, sample_time in due:
+                        if frame_type != FRAME_PING:
+                            self._slots.setdefault(frame_type, (payload, sample_time))
+                self._close()
+                self.reconnects += 1
+                continue
+            sent_at = time.monotonic()
+            wall = time.time()
+            for frame_type, _, sample_time in due:
+                self._last_sent[frame_type] = sent_at
+                if sample_time is not None:
+                    self.latencies.append(wall - sample_time)
+            self.frames_sent += len(due)
+
+    def get_stats(self):
+        latencies = sorted(self.latencies)
+        stats = {
+            'connected': self.connected,
+            'frames_sent': self.frames_sent,
+            'frames_coalesced': self.frames_coalesced,
+            'reconnects': self.reconnects,
+            'write_errors': self.write_errors,
+            'latency_samples': len(latencies),
+        }
+        if latencies:
+            stats['latency_mean_ms'] = 1000.0 * sum(latencies) / len(latencies)
+            stats['latency_p95_ms'] = 1000.0 * latencies[int(0.95 * (len(latencies) - 1))]
+            stats['latency_max_ms'] = 1000.0 * latencies[-1]
+        return stats
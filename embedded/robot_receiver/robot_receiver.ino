@@ -0,0 +1,85 @@
+// Receiver for the frames sent by embedded/robot_link.py
+//   0xAA 0x55 | type | length | payload | crc8 (poly 0x07 over type, length, payload)
+
+const unsigned long BAUDRATE = 115200;
+const uint8_t FRAME_MOOD = 0x01;
+const uint8_t FRAME_METRICS = 0x02;
+const uint8_t FRAME_PING = 0x03;
+const uint8_t MAX_PAYLOAD = 32;
+
+enum ParserState { WAIT_SYNC1, WAIT_SYNC2, READ_TYPE, READ_LENGTH, READ_PAYLOAD, READ_CRC };
+
+ParserState state = WAIT_SYNC1;
+uint8_t frameType = 0;
+uint8_t frameLength = 0;
+uint8_t payload[MAX_PAYLOAD];
+uint8_t received = 0;
+uint8_t crc = 0;
+
+uint8_t crc8Update(uint8_t value, uint8_t data) {
+  value ^= data;
+  for (uint8_t i = 0; i < 8; i++) {
+    value = (value & 0x80) ? (uint8_t)((value << 1) ^ 0x07) : (uint8_t)(value << 1);
+  }
+  return value;
+}
+
+void handleMood(uint8_t mood, uint8_t intensity) {
+  // 0 neutral, 1 excited, 2 relaxed, 3 stressed
+  analogWrite(LED_BUILTIN, mood == 0 ? 0 : intensity);
+}
+
+void handleMetrics(const uint8_t *metrics, uint8_t count) {
+  // engagement, excitement, stress, relaxation, interest, focus
+}
+
+void handleFrame() {
+  if (frameType == FRAME_MOOD && frameLength >= 2) {
+    handleMood(payload[0], payload[1]);
+  } else if (frameType == FRAME_METRICS) {
+    handleMetrics(payload, frameLength);
+  }
+}
+
+void parseByte(uint8_t b) {
+  switch (state) {
+    case WAIT_SYNC1:
+      if (b == 0xAA) state = WAIT_SYNC2;
+      break;
+    case WAIT_SYNC2:
+      state = (b == 0x55) ? READ_TYPE : (b == 0xAA ? WAIT_SYNC2 : WAIT_SYNC1);
+      break;
+    case READ_TYPE:
+      frameType = b;
+      crc = crc8Update(0, b);
+      state = READ_LENGTH;
+      break;
+    case READ_LENGTH:
+      frameLength = b;
+      crc = crc8Update(crc, b);
+      received = 0;
+      if (frameLength > MAX_PAYLOAD) state = WAIT_SYNC1;
+      else state = frameLength ? READ_PAYLOAD : READ_CRC;
+      break;
+    case READ_PAYLOAD:
+      payload[received++] = b;
+      crc = crc8Update(crc, b);
+      if (received == frameLength) state = READ_CRC;
+      break;
+    case READ_CRC:
+      if (b == crc) handleFrame();
+      state = WAIT_SYNC1;
+      break;
+  }
+}
+
+void setup() {
+  pinMode(LED_BUILTIN, OUTPUT);
+  Serial.begin(BAUDRATE);
+}
+
+void loop() {
+  while (Serial.available() > 0) {
+    parseByte((uint8_t)Serial.read());
+  }
+}
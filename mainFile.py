@@ -4,9 +4,19 @@ from datetime import datetime
 import time
 
 from EmoRobots.core.cortex import Cortex
+from EmoRobots.core.rolling_stats import RollingStatistics
+from EmoRobots.embedded.robot_link import (RobotLink, MOOD_NEUTRAL, MOOD_EXCITED,
+                                           MOOD_RELAXED, MOOD_STRESSED)
+
+MOOD_NAMES = {
+    MOOD_EXCITED: "积极兴奋",
+    MOOD_RELAXED: "平静放松",
+    MOOD_STRESSED: "压力状态",
+    MOOD_NEUTRAL: "中性状态",
+}
     
 class EmotionMetrics:
-    def __init__(self):
+    def __init__(self, window_seconds=30.0):
         # 核心情绪指标
         self.engagement = 0.0      # 专注度 (0-1)
         self.excitement = 0.0      # 兴奋度 (0-1)
@@ -19,6 +29,12 @@ class EmotionMetrics:
         self.signal_quality = 0    # 信号质量 (1-5, 1=最佳)
         self.battery_level = 0     # 电池电量 (0-100%)
         self.last_update = None    # 最后更新时间
+        self.sample_time = None    # 最新样本的头戴设备时间 (秒)
+        
+        # 最近 window_seconds 秒的滚动统计 (内存只与窗口长度有关)
+        self.window_seconds = window_seconds
+        self.rolling = RollingStatistics(['engagement', 'excitement', 'stress', 'relaxation', 'interest', 'focus'],
+                                         window_seconds)
         
     def update_from_met_data(self, met_data):
         """
@@ -32,6 +48,9 @@ class EmotionMetrics:
         self.relaxation = metrics[4]  # 放松度
         self.interest = metrics[5]    # 兴趣度
         self.focus = metrics[6]       # 集中度
+        self.rolling.update([self.engagement, self.excitement, self.stress,
+                             self.relaxation, self.interest, self.focus], met_data['time'])
+        self.sample_time = met_data['time']
         self.last_update = datetime.fromtimestamp(met_data['time'])
         
     def update_from_dev_data(self, dev_data):
@@ -48,31 +67,47 @@ class EmotionMetrics:
         return {
             "专注状态": f"{self.engagement:.2f} ({'高' if self.engagement > 0.7 else '低'})",
             "压力水平": f"{self.stress:.2f} ({'高' if self.stress > 0.5 else '正常'})",
+            f"近{self.window_seconds:.0f}秒": self._get_rolling_summary(),
             "整体情绪": self._get_mood_summary(),
             "信号质量": f"{self.signal_quality}/5",
             "电池电量": f"{self.battery_level}%"
         }
     
-    def _get_mood_summary(self):
-        """综合情绪分析"""
+    def _get_rolling_summary(self):
+        stats = self.rolling.get_summary()
+        engagement, stress = stats['engagement'], stats['stress']
+        return (f"专注 {engagement['mean']:.2f} ({engagement['min']:.2f}-{engagement['max']:.2f}), "
+                f"压力 {stress['mean']:.2f} ± {stress['std']:.2f}")
+    
+    def _get_mood(self):
+        """综合情绪分析, 返回 (情绪代码, 强度 0-1)"""
         if self.excitement > 0.7 and self.stress < 0.3:
-            return "积极兴奋"
+            return MOOD_EXCITED, self.excitement
         elif self.relaxation > 0.6 and self.stress < 0.4:
-            return "平静放松"
+            return MOOD_RELAXED, self.relaxation
         elif self.stress > 0.6:
-            return "压力状态"
+            return MOOD_STRESSED, self.stress
         else:
-            return "中性状态"
-    def other(self):
-        pass
-        #补充其他 f:数据->指令
+            return MOOD_NEUTRAL, 0.0
+        
+    def _get_mood_summary(self):
+        return MOOD_NAMES[self._get_mood()[0]]
+        
+    def send_to_robot(self, robot):
+        """数据->指令: 把当前情绪状态发送给机器人"""
+        mood, intensity = self._get_mood()
+        robot.send_mood(mood, intensity, self.sample_time)
+        robot.send_metrics([self.engagement, self.excitement, self.stress,
+                            self.relaxation, self.interest, self.focus], self.sample_time)
         
         
 
 class EmotionTracker():
-    def __init__(self, client_id, client_secret):
+    def __init__(self, client_id, client_secret, robot_port=None):
         self.emotion_metrics = EmotionMetrics()
         self.cortex = Cortex(client_id, client_secret, debug_mode=False)
+        # 串口输出: 常驻连接, 自动重连, 不阻塞数据流线程
+        self.robot = RobotLink(robot_port) if robot_port else None
         # self.user.do_prepare_steps()
         
          # 绑定事件处理器
@@ -83,6 +118,8 @@ class EmotionTracker():
         
     def start(self):
         """启动情绪追踪"""
+        if self.robot:
+            self.robot.start()
         print("启动Emotiv设备连接...")
         self.cortex.open()
         
@@ -95,8 +132,11 @@ class EmotionTracker():
         
     def _on_met_data(self, data):
         """处理性能指标数据"""
-        print("收到新数据:", data)
         self.emotion_metrics.update_from_met_data(data)
+        # 先发送指令, 打印放在后面, 不增加延迟
+        if self.robot:
+            self.emotion_metrics.send_to_robot(self.robot)
+        print("收到新数据:", data)
         self.print_summary()
         
     def _on_dev_data(self, data):
@@ -125,6 +165,9 @@ class EmotionTracker():
         self.cortex.unsub_request(['met', 'dev'])
         self.cortex.close_session()
         self.cortex.close()
+        if self.robot:
+            print("机器人链路:", self.robot.get_stats())
+            self.robot.stop()
 
 
         
@@ -133,12 +176,15 @@ if __name__ == "__main__":
     load_dotenv("emotiv_config.env")
     CLIENT_ID = os.getenv("CLIENT_ID")
     CLIENT_SECRET = os.getenv("CLIENT_SECRET")
-    tracker = EmotionTracker(CLIENT_ID, CLIENT_SECRET)
+    ROBOT_PORT = os.getenv("ROBOT_PORT", "/dev/ttyACM0")  # 为空则不连接机器人
+    tracker = EmotionTracker(CLIENT_ID, CLIENT_SECRET, robot_port=ROBOT_PORT)
     
     try:
         tracker.start()
         while True:
             print("主循环运行中，last_update:", tracker.emotion_metrics.last_update)
+            if tracker.robot:
+                print("机器人链路:", tracker.robot.get_stats())
             time.sleep(10)
     except KeyboardInterrupt:
         tracker.stop()
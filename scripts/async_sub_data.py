@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""
+Subscribe to data streams with the asyncio client (core.async_cortex).
+
+Every stream is consumed by its own task; the prepare steps (access,
+authorize, headset connection) run concurrently.
+
+Usage:
+    python async_sub_data.py
+"""
+
+import os
+import sys
+import asyncio
+from dotenv import load_dotenv
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.async_cortex import AsyncCortex
+
+
+async def print_stream(subscription, count):
+    received = 0
+    async for sample in subscription:
+        print(subscription.stream_name, sample)
+        received += 1
+        if received >= count:
+            break
+    subscription.close()
+
+
+async def run(client_id, client_secret, streams, count=100):
+    async with AsyncCortex(client_id, client_secret) as cortex:
+        # iterators are created before subscribing so no sample is missed
+        consumers = [print_stream(cortex.stream(stream_name), count) for stream_name in streams]
+        session_id = await cortex.prepare(streams=streams)
+        print('session', session_id, 'labels', cortex.data_labels)
+        await asyncio.gather(*consumers)
+        await cortex.unsubscribe(streams)
+        await cortex.close_session()
+
+
+def main():
+    load_dotenv(dotenv_path=os.path.join(os.path.dirname(__file__), '..', 'emotiv_config.env'))
+    client_id = os.getenv('CLIENT_ID')
+    client_secret = os.getenv('CLIENT_SECRET')
+    asyncio.run(run(client_id, client_secret, ['met', 'pow']))
+
+
+if __name__ == '__main__':
+    main()
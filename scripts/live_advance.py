@@ -2,6 +2,7 @@ import cortex
 from cortex import Cortex
 from dotenv import load_dotenv
 import os
+import sys
 
 class LiveAdvance():
     """
@@ -29,6 +30,8 @@ class LiveAdvance():
         To set the sensitivity of the 4 active mental command actions.
     """
     def __init__(self, app_client_id, app_client_secret, **kwargs):
+        # optional core.inference.InferenceStage: our own model next to Cortex's com stream
+        self.inference = kwargs.pop('inference', None)
         self.c = Cortex(app_client_id, app_client_secret, debug_mode=True, **kwargs)
         self.c.bind(create_session_done=self.on_create_session_done)
         self.c.bind(query_profile_done=self.on_query_profile_done)
@@ -38,6 +41,9 @@ class LiveAdvance():
         self.c.bind(get_mc_active_action_done=self.on_get_mc_active_action_done)
         self.c.bind(mc_action_sensitivity_done=self.on_mc_action_sensitivity_done)
         self.c.bind(inform_error=self.on_inform_error)
+        if self.inference is not None:
+            self.inference.attach(self.c)
+            self.inference.bind(new_custom_com_data=self.on_new_custom_com_data)
 
     def start(self, profile_name, headset_id=''):
         """
@@ -213,8 +219,8 @@ class LiveAdvance():
 
     def on_save_profile_done (self, *args, **kwargs):
         print('Save profile ' + self.profile_name + " successfully")
-        # subscribe mental command data
-        stream = ['com']
+        # subscribe mental command data (and eeg for the custom model)
+        stream = ['com'] if self.inference is None else ['com', 'eeg']
         self.c.sub_request(stream)
 
     def on_new_com_data(self, *args, **kwargs):
@@ -229,6 +235,18 @@ class LiveAdvance():
         data = kwargs.get('data')
         print('mc data: {}'.format(data))
 
+    def on_new_custom_com_data(self, *args, **kwargs):
+        """
+        To handle the decisions of the custom model (core.inference.InferenceStage)
+
+        Returns
+        -------
+        data: dictionary
+             the format such as {'action': 'push', 'power': 0.91, 'time': 1590736942.8479, 'latency_ms': 0.4, ...}
+        """
+        data = kwargs.get('data')
+        print('custom mc data: {0} ({1:.2f}), {2:.2f} ms'.format(data['action'], data['power'], data['latency_ms']))
+
     def on_get_mc_active_action_done(self, *args, **kwargs):
         data = kwargs.get('data')
         print('on_get_mc_active_action_done: {}'.format(data))
@@ -281,8 +299,16 @@ def main():
     your_app_client_id = os.getenv('CLIENT_ID')
     your_app_client_secret = os.getenv('CLIENT_SECRET')
 
+    # Optional own model next to Cortex's detections, e.g. CUSTOM_MODEL=model.onnx CUSTOM_ACTIONS=neutral,push
+    inference = None
+    if os.getenv('CUSTOM_MODEL'):
+        sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+        from core.inference import InferenceStage, OnnxModel
+        actions = os.getenv('CUSTOM_ACTIONS', 'neutral,push,pull').split(',')
+        inference = InferenceStage(OnnxModel(os.getenv('CUSTOM_MODEL')), actions)
+
     # Init live advance
-    l = LiveAdvance(your_app_client_id, your_app_client_secret)
+    l = LiveAdvance(your_app_client_id, your_app_client_secret, inference=inference)
 
     trained_profile_name = '' # Please set a trained profile name here
     l.start(trained_profile_name)
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+Watch a Cortex session live in the browser (core.live_dashboard).
+
+Subscribes to the streams and serves the dashboard page until Ctrl+C;
+nothing is saved. Open the printed http:// address. Against the mock
+service:
+    python mock_cortex_server.py &
+    CORTEX_URL=ws://localhost:6868 python live_dashboard.py
+
+Usage:
+    python live_dashboard.py
+    python live_dashboard.py --streams eeg dev met --fps 5 --http-port 8080 --host 0.0.0.0
+"""
+
+import os
+import sys
+import argparse
+from dotenv import load_dotenv
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.cortex import Cortex
+from core.live_dashboard import LiveDashboard
+
+
+class LiveView:
+    """Cortex client that subscribes once the session is created and feeds a LiveDashboard."""
+
+    def __init__(self, app_client_id, app_client_secret, streams, **dashboard_options):
+        self.streams = streams
+        self.c = Cortex(app_client_id, app_client_secret, debug_mode=False)
+        self.c.bind(create_session_done=self.on_create_session_done)
+        self.c.bind(inform_error=self.on_inform_error)
+        self.dashboard = LiveDashboard(self.c, **dashboard_options)
+
+    def start(self, headset_id=''):
+        if headset_id != '':
+            self.c.set_wanted_headset(headset_id)
+        self.dashboard.start()
+        self.c.open()
+
+    def stop(self):
+        self.dashboard.stop()
+        self.c.close()
+
+    def on_create_session_done(self, *args, **kwargs):
+        self.c.sub_request(self.streams)
+
+    def on_inform_error(self, *args, **kwargs):
+        print(kwargs.get('error_data'))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Live dashboard of a Cortex session')
+    parser.add_argument('--streams', nargs='+', default=['eeg', 'mot', 'dev', 'met', 'pow'])
+    parser.add_argument('--host', default='127.0.0.1', help='address to serve the page on')
+    parser.add_argument('--port', type=int, default=8765, help='WebSocket port of the frames')
+    parser.add_argument('--http-port', type=int, default=8080, help='port of the page')
+    parser.add_argument('--fps', type=float, default=10.0)
+    parser.add_argument('--points-per-second', type=int, default=64, help='eeg/mot envelope resolution')
+    parser.add_argument('--history', type=float, default=10.0, help='seconds shown in the page')
+    parser.add_argument('--headset', default='')
+    args = parser.parse_args()
+
+    load_dotenv(dotenv_path=os.path.join(os.path.dirname(__file__), '..', 'emotiv_config.env'))
+    view = LiveView(os.getenv('CLIENT_ID'), os.getenv('CLIENT_SECRET'), args.streams,
+                    host=args.host, port=args.port, http_port=args.http_port, fps=args.fps,
+                    points_per_second=args.points_per_second, history=args.history)
+    try:
+        view.start(args.headset)
+    except KeyboardInterrupt:
+        view.stop()
+
+
+if __name__ == '__main__':
+    main()
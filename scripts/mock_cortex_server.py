@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""
+Run the mock Cortex service (core.mock_cortex) for tests without a headset.
+
+Serves synthetic data, or replays a session saved by DataCollector, at
+1x, Nx or maximum speed. Point clients at it with
+    CORTEX_URL=ws://localhost:6868 python scripts/data_collector_test.py
+
+Usage:
+    python mock_cortex_server.py                                  # synthetic, real time
+    python mock_cortex_server.py --channels 32 --eeg-rate 256 --speed 10
+    python mock_cortex_server.py --replay ../collected_data --session 20250101_120000 --speed max --loop
+"""
+
+import os
+import sys
+import ssl
+import asyncio
+import argparse
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..'))
+from core.mock_cortex import MockCortexServer, RecordedSession
+from core.synthetic_stream import SyntheticSession
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Mock Cortex service')
+    parser.add_argument('--host', default='localhost')
+    parser.add_argument('--port', type=int, default=6868)
+    parser.add_argument('--speed', default='1', help="replay speed factor, or 'max'")
+    parser.add_argument('--replay', help='directory of a DataCollector session to replay')
+    parser.add_argument('--session', help='session timestamp in the replay directory (default: newest)')
+    parser.add_argument('--loop', action='store_true', help='restart the data when it ends')
+    parser.add_argument('--channels', type=int, default=14, help='synthetic EEG channel count')
+    parser.add_argument('--eeg-rate', type=float, default=128.0, help='synthetic EEG sampling rate in Hz')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--certfile', help='serve wss:// with this certificate')
+    parser.add_argument('--keyfile')
+    args = parser.parse_args()
+
+    if args.replay:
+        source = RecordedSession(args.replay, timestamp=args.session)
+        print('replaying session {0}: {1}'.format(source.timestamp, ', '.join(
+            '{0} {1} samples'.format(name, len(samples)) for name, samples in source.samples.items())))
+    else:
+        source = SyntheticSession(channels=args.channels, rates={'eeg': args.eeg_rate}, seed=args.seed)
+
+    ssl_context = None
+    if args.certfile:
+        ssl_context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        ssl_context.load_cert_chain(args.certfile, args.keyfile)
+
+    speed = None if args.speed == 'max' else float(args.speed)
+    server = MockCortexServer(source, host=args.host, port=args.port, speed=speed, loop=args.loop,
+                              ssl_context=ssl_context)
+    try:
+        asyncio.run(server.serve_forever())
+    except KeyboardInterrupt:
+        print('messages sent:', server.get_stats()['messages_sent'])
+
+
+if __name__ == '__main__':
+    main()
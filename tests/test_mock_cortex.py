@@ -0,0 +1,49 @@
+"""
+MockCortexServer start-up errors.
+
+Run from the repository root:
+    python -m unittest discover tests
+"""
+import os
+import sys
+import socket
+import unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+try:
+    from core.mock_cortex import MockCortexServer, websockets
+except ImportError:
+    MockCortexServer = websockets = None
+
+
+@unittest.skipIf(websockets is None, 'requires websockets, numpy and pydispatch')
+class MockCortexServerStartTest(unittest.TestCase):
+
+    def test_busy_port_raises(self):
+        busy = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        busy.bind(('127.0.0.1', 0))
+        busy.listen(1)
+        try:
+            server = MockCortexServer(host='127.0.0.1', port=busy.getsockname()[1])
+            server.start_timeout = 5.0
+            with self.assertRaises(OSError) as raised:
+                server.start()
+            # TimeoutError is an OSError too: the failure must come from the bind
+            self.assertNotIsInstance(raised.exception, TimeoutError)
+            # nothing to stop, the failed start left no loop behind
+            server.stop()
+        finally:
+            busy.close()
+
+    def test_free_port_starts(self):
+        server = MockCortexServer(host='127.0.0.1', port=0)
+        server.start()
+        try:
+            self.assertNotEqual(server.port, 0)
+        finally:
+            server.stop()
+
+
+if __name__ == '__main__':
+    unittest.main()